@@ -0,0 +1,161 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_BENCHMARK_BENCH_H
+#define _BUL_BENCHMARK_BENCH_H
+
+#include <cstdint>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bul {
+namespace bench {
+/// Timing state handed to a benchmark body, setup work can be kept out of the measurement.
+class State {
+public:
+	typedef std::chrono::steady_clock clock_type;
+
+	State() : _M_elapsed(0), _M_items(1) { }
+
+	/// Stop / restart the clock around work which should not be measured.
+	void Pause() {
+		_M_elapsed += clock_type::now() - _M_start;
+	}
+
+	void Resume() {
+		_M_start = clock_type::now();
+	}
+
+	/// Number of operations performed by one call of the body.
+	void SetItems(std::size_t __items) {
+		_M_items = __items;
+	}
+
+	std::size_t GetItems() const {
+		return _M_items;
+	}
+
+	double GetSeconds() const {
+		return std::chrono::duration<double>(_M_elapsed).count();
+	}
+
+private:
+	clock_type::duration _M_elapsed;
+	clock_type::time_point _M_start;
+	std::size_t _M_items;
+};
+
+/// Sink written by Keep(...), defined in main.cpp.
+extern volatile std::uintptr_t _G_sink;
+
+/// Keeps a value alive so that the computation producing it is not optimized away.
+template<typename _Tp>
+inline void Keep(_Tp const& __value) {
+	_G_sink = static_cast<std::uintptr_t>(__value);
+}
+
+template<typename _Tp>
+inline void Keep(_Tp* __value) {
+	_G_sink = reinterpret_cast<std::uintptr_t>(__value);
+}
+
+/// Builds a fixture on first use, outside of the measurement, so filtered-out cases cost nothing.
+template<typename _Tp>
+class Lazy {
+public:
+	Lazy(std::function<_Tp*()> const& __make) : _M_make(__make) { }
+
+	_Tp& Get(State& __state) {
+		if(!_M_value) {
+			__state.Pause();
+			_M_value.reset(_M_make());
+			__state.Resume();
+		}
+		return *_M_value;
+	}
+
+private:
+	std::function<_Tp*()> _M_make;
+	std::unique_ptr<_Tp> _M_value;
+};
+
+/// Parameters of one benchmark case, printed as key / value pairs.
+typedef std::vector<std::pair<std::string, std::string>> Params;
+
+/// Result of one benchmark case.
+struct Result {
+	std::string Name;
+	Params Parameters;
+	std::size_t Iterations;
+	std::size_t Items;
+	double Seconds;
+};
+
+/// Holds the registered cases and runs those matching the filter.
+class Runner {
+public:
+	typedef std::function<void(State&)> body_type;
+
+	/// Options from the command line.
+	struct Options {
+		std::string Filter;
+		std::string Format = "json";
+		std::string Output;
+		std::size_t MaxSize = 1000000;
+		double MinTime = 0.2;
+		std::size_t MaxIterations = 1000000;
+	};
+
+	Runner(Options const& __options) : _M_options(__options) { }
+
+	Options const& GetOptions() const {
+		return _M_options;
+	}
+
+	/// Sizes 1e3, 1e4, ... up to the --max-size option.
+	std::vector<std::size_t> Sizes(std::size_t __from = 1000, std::size_t __to = 1000000) const {
+		std::vector<std::size_t> sizes;
+		for(std::size_t size = __from; size <= __to && size <= _M_options.MaxSize; size *= 10) {
+			sizes.push_back(size);
+		}
+		return sizes;
+	}
+
+	/// Register a case.
+	void Add(std::string const& __name, Params const& __params, body_type const& __body) {
+		_M_case.push_back(_Case { __name, __params, __body });
+	}
+
+	/// Run every case matching the filter; each one repeats until MinTime seconds were measured.
+	std::vector<Result> Run() const;
+
+	/// Write results as JSON or CSV.
+	void Write(std::vector<Result> const& __results) const;
+
+private:
+	struct _Case {
+		std::string Name;
+		Params Parameters;
+		body_type Body;
+	};
+
+	Options _M_options;
+	std::vector<_Case> _M_case;
+};
+
+/// Registration functions, one per source file.
+void RegisterContainer(Runner& __runner);
+void RegisterDataPool(Runner& __runner);
+void RegisterScene(Runner& __runner);
+void RegisterSpatial(Runner& __runner);
+
+} /* namespace bench */
+} /* namespace bul */
+
+#endif /* _BUL_BENCHMARK_BENCH_H */
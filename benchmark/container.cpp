@@ -0,0 +1,310 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+#include "../common/container.h"
+#include "../common/handle.h"
+#include "bench.h"
+
+namespace bul {
+namespace bench {
+namespace {
+/// Element stored in the benchmarked containers.
+struct Item {
+	std::size_t Value;
+};
+
+/// Items, their keys in shuffled order, and their tags (one tag per 100 items).
+struct Fixture {
+	Fixture(std::size_t __size) : Items(__size), Order(__size) {
+		for(std::size_t i = 0; i < __size; i++) {
+			Items[i].Value = i;
+			Order[i] = i;
+		}
+		std::mt19937_64 rng(42);
+		std::shuffle(Order.begin(), Order.end(), rng);
+	}
+
+	static unsigned int TagOf(std::size_t __i) {
+		return static_cast<unsigned int>(__i / 100);
+	}
+
+	std::vector<Item> Items;
+	std::vector<std::size_t> Order;
+};
+
+template<template<typename...> class _Map, template<typename> class _Bucket>
+void _Register(Runner& __runner, std::string const& __map, std::string const& __bucket) {
+	typedef common::Container<Item*, common::Key<std::size_t>, common::Tag<unsigned int>, _Map, _Bucket> container_type;
+
+	for(std::size_t size : __runner.Sizes()) {
+		Params params { { "map", __map }, { "bucket", __bucket }, { "n", std::to_string(size) } };
+		std::shared_ptr<Lazy<Fixture>> fixture(new Lazy<Fixture>([size] { return new Fixture(size); }));
+		std::shared_ptr<Lazy<container_type>> filled(new Lazy<container_type>([fixture, size] {
+			State state;
+			auto& items = fixture->Get(state).Items;
+			container_type* container = new container_type();
+			for(std::size_t i = 0; i < size; i++) {
+				container->Insert(&items[i], i, Fixture::TagOf(i));
+			}
+			return container;
+		}));
+
+		__runner.Add("Container::Insert", params, [fixture, size](State& __state) {
+			auto& items = fixture->Get(__state).Items;
+			__state.Pause();
+			std::unique_ptr<container_type> container(new container_type());
+			__state.Resume();
+			for(std::size_t i = 0; i < size; i++) {
+				container->Insert(&items[i], i, Fixture::TagOf(i));
+			}
+			__state.Pause();
+			container.reset();
+			__state.Resume();
+			__state.SetItems(size);
+		});
+
+		__runner.Add("Container::EraseByValue", params, [fixture, size](State& __state) {
+			auto& data = fixture->Get(__state);
+			__state.Pause();
+			std::unique_ptr<container_type> container(new container_type());
+			for(std::size_t i = 0; i < size; i++) {
+				container->Insert(&data.Items[i], i, Fixture::TagOf(i));
+			}
+			__state.Resume();
+			for(std::size_t i : data.Order) {
+				container->EraseByValue(&data.Items[i]);
+			}
+			__state.SetItems(size);
+		});
+
+		__runner.Add("Container::InsertBatch", params, [fixture, size](State& __state) {
+			auto& data = fixture->Get(__state);
+			__state.Pause();
+			std::unique_ptr<container_type> container(new container_type());
+			std::vector<Item*> values(size);
+			for(std::size_t i = 0; i < size; i++) {
+				values[i] = &data.Items[i];
+			}
+			__state.Resume();
+			container->InsertBatch(values.begin(), values.end(), [](Item* __item) {
+				return typename container_type::entry_type(__item->Value, Fixture::TagOf(__item->Value));
+			});
+			__state.Pause();
+			container.reset();
+			__state.Resume();
+			__state.SetItems(size);
+		});
+
+		__runner.Add("Container::EraseBatch", params, [fixture, size](State& __state) {
+			auto& data = fixture->Get(__state);
+			__state.Pause();
+			std::unique_ptr<container_type> container(new container_type());
+			std::vector<Item*> values(size);
+			for(std::size_t i = 0; i < size; i++) {
+				container->Insert(&data.Items[i], i, Fixture::TagOf(i));
+				values[i] = &data.Items[data.Order[i]];
+			}
+			__state.Resume();
+			container->EraseBatch(values.begin(), values.end());
+			__state.SetItems(size);
+		});
+
+		__runner.Add("Container::ClearTag", params, [fixture, size](State& __state) {
+			auto& data = fixture->Get(__state);
+			__state.Pause();
+			std::unique_ptr<container_type> container(new container_type());
+			for(std::size_t i = 0; i < size; i++) {
+				container->Insert(&data.Items[i], i, Fixture::TagOf(i));
+			}
+			__state.Resume();
+			unsigned int tags = Fixture::TagOf(size - 1) + 1;
+			for(unsigned int tag = 0; tag < tags; tag++) {
+				container->template ClearTag<0>(tag);
+			}
+			__state.SetItems(size);
+		});
+
+		__runner.Add("Container::GetByKey", params, [fixture, filled, size](State& __state) {
+			auto& order = fixture->Get(__state).Order;
+			auto& container = filled->Get(__state);
+			std::size_t sum = 0;
+			for(std::size_t i : order) {
+				sum += container.template GetByKey<0>(i)->Value;
+			}
+			Keep(sum);
+			__state.SetItems(size);
+		});
+
+		__runner.Add("Container::GetByTag", params, [filled, size](State& __state) {
+			auto& container = filled->Get(__state);
+			std::size_t sum = 0;
+			unsigned int tags = Fixture::TagOf(size - 1) + 1;
+			for(unsigned int tag = 0; tag < tags; tag++) {
+				for(auto item : container.template GetByTag<0>(tag)) {
+					sum += item->Value;
+				}
+			}
+			Keep(sum);
+			__state.SetItems(size);
+		});
+	}
+}
+
+/// Elements carrying two tags at once, through a lazy query and by intersecting the two buckets by hand.
+void _Register_Query(Runner& __runner) {
+	typedef common::Container<Item*, common::Key<std::size_t>, common::Tag<unsigned int, unsigned int>,
+			std::unordered_map, common::VectorBucket> container_type;
+
+	for(std::size_t size : __runner.Sizes()) {
+		Params params { { "n", std::to_string(size) }, { "tags", "2" } };
+		std::shared_ptr<Lazy<Fixture>> fixture(new Lazy<Fixture>([size] { return new Fixture(size); }));
+		std::shared_ptr<Lazy<container_type>> filled(new Lazy<container_type>([fixture, size] {
+			State state;
+			auto& items = fixture->Get(state).Items;
+			container_type* container = new container_type();
+			for(std::size_t i = 0; i < size; i++) {
+				container->Insert(&items[i], i, Fixture::TagOf(i), static_cast<unsigned int>(i % 8));
+			}
+			return container;
+		}));
+
+		__runner.Add("Container::Query", params, [filled, size](State& __state) {
+			auto& container = filled->Get(__state);
+			std::size_t sum = 0;
+			unsigned int tags = Fixture::TagOf(size - 1) + 1;
+			for(unsigned int tag = 0; tag < tags; tag++) {
+				for(auto item : container.Query().template Tag<0>(tag).template Tag<1>(0)) {
+					sum += item->Value;
+				}
+			}
+			Keep(sum);
+			__state.SetItems(size);
+		});
+
+		__runner.Add("Container::GetByTag/intersect", params, [filled, size](State& __state) {
+			auto& container = filled->Get(__state);
+			std::size_t sum = 0;
+			unsigned int tags = Fixture::TagOf(size - 1) + 1;
+			std::vector<Item*> second(container.template GetByTag<1>(0).begin(), container.template GetByTag<1>(0).end());
+			std::sort(second.begin(), second.end());
+			for(unsigned int tag = 0; tag < tags; tag++) {
+				std::vector<Item*> first(container.template GetByTag<0>(tag).begin(), container.template GetByTag<0>(tag).end());
+				std::sort(first.begin(), first.end());
+				std::vector<Item*> both;
+				std::set_intersection(first.begin(), first.end(), second.begin(), second.end(), std::back_inserter(both));
+				for(auto item : both) {
+					sum += item->Value;
+				}
+			}
+			Keep(sum);
+			__state.SetItems(size);
+		});
+	}
+}
+
+/// Many containers of 4 elements each, shaped like the component storage of actors.
+template<template<typename...> class _Map, template<typename> class _Bucket>
+void _Register_Tiny(Runner& __runner, std::string const& __map) {
+	typedef common::Container<Item*, common::Key<std::size_t>, common::Tag<std::size_t, unsigned int>,
+			_Map, _Bucket> container_type;
+	std::size_t const per = 4;
+
+	for(std::size_t size : __runner.Sizes()) {
+		if(size < per) {
+			continue;
+		}
+		Params params { { "map", __map }, { "n", std::to_string(size) }, { "per", std::to_string(per) } };
+		std::shared_ptr<Lazy<Fixture>> fixture(new Lazy<Fixture>([size] { return new Fixture(size); }));
+		auto fill = [size, per](std::vector<Item>& __items) {
+			std::unique_ptr<container_type[]> containers(new container_type[size / per]);
+			for(std::size_t i = 0; i < size / per * per; i++) {
+				containers[i / per].Insert(&__items[i], i, i % per, 0);
+			}
+			return containers;
+		};
+
+		__runner.Add("Container::Insert/tiny", params, [fixture, fill, size](State& __state) {
+			auto& items = fixture->Get(__state).Items;
+			auto containers = fill(items);
+			__state.Pause();
+			containers.reset();
+			__state.Resume();
+			__state.SetItems(size);
+		});
+
+		__runner.Add("Container::GetByKey/tiny", params, [fixture, fill, size, per](State& __state) {
+			__state.Pause();
+			auto& order = fixture->Get(__state).Order;
+			auto containers = fill(fixture->Get(__state).Items);
+			__state.Resume();
+			std::size_t sum = 0;
+			for(std::size_t i : order) {
+				if(i < size / per * per) {
+					sum += containers[i / per].template GetByKey<0>(i)->Value;
+				}
+			}
+			Keep(sum);
+			__state.Pause();
+			containers.reset();
+			__state.Resume();
+			__state.SetItems(size);
+		});
+	}
+}
+
+/// Lookups through generational handles, to compare with GetByKey.
+void _Register_Handle(Runner& __runner) {
+	typedef common::HandleTable<Item> table_type;
+
+	for(std::size_t size : __runner.Sizes()) {
+		Params params { { "n", std::to_string(size) } };
+		std::shared_ptr<Lazy<Fixture>> fixture(new Lazy<Fixture>([size] { return new Fixture(size); }));
+		std::shared_ptr<std::vector<common::Handle>> handles(new std::vector<common::Handle>());
+		std::shared_ptr<Lazy<table_type>> filled(new Lazy<table_type>([fixture, handles, size] {
+			State state;
+			auto& items = fixture->Get(state).Items;
+			table_type* table = new table_type();
+			for(std::size_t i = 0; i < size; i++) {
+				handles->push_back(table->Insert(&items[i]));
+			}
+			return table;
+		}));
+
+		__runner.Add("HandleTable::Get", params, [fixture, filled, handles, size](State& __state) {
+			auto& order = fixture->Get(__state).Order;
+			auto& table = filled->Get(__state);
+			std::size_t sum = 0;
+			for(std::size_t i : order) {
+				sum += table.Get((*handles)[i])->Value;
+			}
+			Keep(sum);
+			__state.SetItems(size);
+		});
+	}
+}
+
+} /* namespace */
+
+void RegisterContainer(Runner& __runner) {
+	_Register<std::map, common::ListBucket>(__runner, "map", "list");
+	_Register<std::map, common::VectorBucket>(__runner, "map", "vector");
+	_Register<std::unordered_map, common::ListBucket>(__runner, "unordered_map", "list");
+	_Register<std::unordered_map, common::VectorBucket>(__runner, "unordered_map", "vector");
+	_Register<std::unordered_map, common::OrderedVectorBucket>(__runner, "unordered_map", "ordered");
+	_Register_Handle(__runner);
+	_Register_Query(__runner);
+	_Register_Tiny<std::map, common::OrderedVectorBucket>(__runner, "map");
+	_Register_Tiny<common::Small<4>::Map, common::Small<4, 2>::Bucket>(__runner, "small");
+}
+
+} /* namespace bench */
+} /* namespace bul */
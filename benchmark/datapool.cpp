@@ -0,0 +1,88 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#include <memory>
+#include <string>
+
+#include "../common/datapool.h"
+#include "bench.h"
+
+namespace bul {
+namespace bench {
+namespace {
+/// Slots of the schema pool, same capacity per type as the runtime pool below.
+struct Ints : common::Slot<int, 128> { };
+struct Floats : common::Slot<float, 128> { };
+typedef common::Schema<Ints, Floats> schema_type;
+typedef common::DataPool<int, float, void*, false> datapool_type;
+typedef common::SoADataPool<schema_type> soa_datapool_type;
+
+static const std::size_t _S_pool_size = 128;
+static const std::size_t _S_operations = 1 << 20;
+
+} /* namespace */
+
+void RegisterDataPool(Runner& __runner) {
+	Params params { { "slots", std::to_string(_S_pool_size) } };
+
+	__runner.Add("DataPool::Set<int>", params, [](State& __state) {
+		datapool_type pool;
+		pool.Resize(_S_pool_size);
+		for(std::size_t i = 0; i < _S_operations; i++) {
+			pool.Set<int>(i & (_S_pool_size - 1), static_cast<int>(i));
+		}
+		Keep(pool.Get<int>(7));
+		__state.SetItems(_S_operations);
+	});
+
+	// Read benchmarks keep their pool across calls so that the loads cannot be folded away.
+	std::shared_ptr<Lazy<datapool_type>> datapool(new Lazy<datapool_type>([] {
+		datapool_type* pool = new datapool_type();
+		pool->Resize(_S_pool_size);
+		return pool;
+	}));
+	std::shared_ptr<Lazy<soa_datapool_type>> soa_datapool(new Lazy<soa_datapool_type>([] { return new soa_datapool_type(); }));
+
+	__runner.Add("DataPool::Get<int>", params, [datapool](State& __state) {
+		auto& pool = datapool->Get(__state);
+		int sum = 0;
+		for(std::size_t i = 0; i < _S_operations; i++) {
+			sum += pool.Get<int>(i & (_S_pool_size - 1));
+		}
+		Keep(sum);
+		__state.SetItems(_S_operations);
+	});
+
+	__runner.Add("DataPool::Set<float>/union", params, [](State& __state) {
+		common::DataPool<int, float, void*, true> pool;
+		pool.Resize(_S_pool_size);
+		for(std::size_t i = 0; i < _S_operations; i++) {
+			pool.Set<float>(i & (_S_pool_size - 1), static_cast<float>(i));
+		}
+		Keep(pool.Get<float>(7));
+		__state.SetItems(_S_operations);
+	});
+
+	__runner.Add("SoADataPool::Set<int>", params, [](State& __state) {
+		soa_datapool_type pool;
+		for(std::size_t i = 0; i < _S_operations; i++) {
+			pool.Set<Ints>(i & (_S_pool_size - 1), static_cast<int>(i));
+		}
+		Keep(pool.Get<Ints, 7>());
+		__state.SetItems(_S_operations);
+	});
+
+	__runner.Add("SoADataPool::Get<int>", params, [soa_datapool](State& __state) {
+		auto& pool = soa_datapool->Get(__state);
+		int sum = 0;
+		for(std::size_t i = 0; i < _S_operations; i++) {
+			sum += pool.Get<Ints>(i & (_S_pool_size - 1));
+		}
+		Keep(sum);
+		__state.SetItems(_S_operations);
+	});
+}
+
+} /* namespace bench */
+} /* namespace bul */
@@ -0,0 +1,174 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include "bench.h"
+
+namespace bul {
+namespace bench {
+volatile std::uintptr_t _G_sink;
+
+std::vector<Result> Runner::Run() const {
+	std::vector<Result> results;
+	for(auto const& bench_case : _M_case) {
+		std::string full_name = bench_case.Name;
+		for(auto const& param : bench_case.Parameters) {
+			full_name += "/" + param.first + "=" + param.second;
+		}
+		if(!_M_options.Filter.empty() && full_name.find(_M_options.Filter) == std::string::npos) {
+			continue;
+		}
+
+		State state;
+		std::size_t iterations = 0;
+		while(iterations < _M_options.MaxIterations && (iterations == 0 || state.GetSeconds() < _M_options.MinTime)) {
+			state.Resume();
+			bench_case.Body(state);
+			state.Pause();
+			iterations++;
+		}
+
+		results.push_back(Result { bench_case.Name, bench_case.Parameters, iterations, state.GetItems(), state.GetSeconds() });
+		std::cerr << std::left << std::setw(64) << full_name << " "
+				<< std::right << std::setw(12) << std::fixed << std::setprecision(2)
+				<< results.back().Seconds * 1e9 / (iterations * state.GetItems()) << " ns/item" << std::endl;
+	}
+	return results;
+}
+
+/// Escapes a string for JSON.
+static std::string _S_Json(std::string const& __text) {
+	std::string escaped;
+	for(char c : __text) {
+		if(c == '"' || c == '\\') {
+			escaped += '\\';
+		}
+		escaped += c;
+	}
+	return escaped;
+}
+
+void Runner::Write(std::vector<Result> const& __results) const {
+	std::ofstream file;
+	if(!_M_options.Output.empty()) {
+		file.open(_M_options.Output.c_str());
+		if(!file) {
+			throw std::runtime_error("bul::bench::Runner::Write(...) : cannot open '" + _M_options.Output + "'.");
+		}
+	}
+	std::ostream& out = _M_options.Output.empty() ? std::cout : file;
+	out << std::setprecision(6) << std::fixed;
+
+	if(_M_options.Format == "csv") {
+		out << "name,params,iterations,items,seconds,ns_per_item,items_per_second" << std::endl;
+		for(auto const& result : __results) {
+			std::string params;
+			for(auto const& param : result.Parameters) {
+				params += (params.empty() ? "" : ";") + param.first + "=" + param.second;
+			}
+			double items = static_cast<double>(result.Iterations) * result.Items;
+			out << result.Name << "," << params << "," << result.Iterations << "," << result.Items << ","
+					<< result.Seconds << "," << result.Seconds * 1e9 / items << "," << items / result.Seconds << std::endl;
+		}
+		return;
+	}
+
+	std::time_t now = std::time(nullptr);
+	char date[32];
+	std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+	out << "{" << std::endl;
+	out << "  \"context\": {" << std::endl;
+	out << "    \"date\": \"" << date << "\"," << std::endl;
+#ifdef __VERSION__
+	out << "    \"compiler\": \"" << _S_Json(__VERSION__) << "\"," << std::endl;
+#endif
+#ifdef NDEBUG
+	out << "    \"assertions\": false," << std::endl;
+#else
+	out << "    \"assertions\": true," << std::endl;
+#endif
+#ifdef BUL_PROFILING
+	out << "    \"profiling\": true," << std::endl;
+#else
+	out << "    \"profiling\": false," << std::endl;
+#endif
+	out << "    \"hardware_threads\": " << std::thread::hardware_concurrency() << std::endl;
+	out << "  }," << std::endl;
+	out << "  \"benchmarks\": [" << std::endl;
+	for(std::size_t i = 0; i < __results.size(); i++) {
+		auto const& result = __results[i];
+		double items = static_cast<double>(result.Iterations) * result.Items;
+		out << "    {\"name\": \"" << _S_Json(result.Name) << "\", \"params\": {";
+		for(std::size_t j = 0; j < result.Parameters.size(); j++) {
+			out << (j == 0 ? "" : ", ") << "\"" << _S_Json(result.Parameters[j].first) << "\": \""
+					<< _S_Json(result.Parameters[j].second) << "\"";
+		}
+		out << "}, \"iterations\": " << result.Iterations << ", \"items\": " << result.Items
+				<< ", \"seconds\": " << result.Seconds << ", \"ns_per_item\": " << result.Seconds * 1e9 / items
+				<< ", \"items_per_second\": " << items / result.Seconds << "}"
+				<< (i + 1 < __results.size() ? "," : "") << std::endl;
+	}
+	out << "  ]" << std::endl;
+	out << "}" << std::endl;
+}
+
+} /* namespace bench */
+} /* namespace bul */
+
+static void _S_Usage(const char* __program) {
+	std::cerr << "usage: " << __program << " [--filter TEXT] [--format json|csv] [--output FILE]"
+			<< " [--max-size N] [--min-time SECONDS]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+	bul::bench::Runner::Options options;
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if(i + 1 >= argc) {
+			_S_Usage(argv[0]);
+			return 1;
+		}
+		if(arg == "--filter") {
+			options.Filter = argv[++i];
+		} else if(arg == "--format") {
+			options.Format = argv[++i];
+		} else if(arg == "--output") {
+			options.Output = argv[++i];
+		} else if(arg == "--max-size") {
+			options.MaxSize = std::strtoull(argv[++i], nullptr, 10);
+		} else if(arg == "--min-time") {
+			options.MinTime = std::strtod(argv[++i], nullptr);
+		} else {
+			_S_Usage(argv[0]);
+			return 1;
+		}
+	}
+	if(options.Format != "json" && options.Format != "csv") {
+		_S_Usage(argv[0]);
+		return 1;
+	}
+
+	bul::bench::Runner runner(options);
+	bul::bench::RegisterContainer(runner);
+	bul::bench::RegisterDataPool(runner);
+	bul::bench::RegisterScene(runner);
+	bul::bench::RegisterSpatial(runner);
+
+	try {
+		runner.Write(runner.Run());
+	} catch(std::exception const& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,420 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "../bulwark.h"
+#include "bench.h"
+
+namespace bul {
+namespace bench {
+namespace {
+/// A component doing a little arithmetic on the shared data pool.
+class Counter : public dynamics::Actor::Component {
+public:
+	Counter(Configuration* __conf) : Component(__conf) { }
+
+protected:
+	virtual void Act() override {
+		std::size_t slot = GetPriority() & 63;
+		SetSharedData<int>(slot, GetSharedData<int>(slot) + 1);
+		SetSharedData<float>(slot, GetSharedData<float>(slot) * 0.5f + 1.0f);
+	}
+
+	virtual void Act_Anyway() override { }
+};
+
+class Agent : public dynamics::Actor {
+public:
+	Agent(Configuration* __conf) : Actor(__conf) { }
+
+protected:
+	virtual void PreAct() override { }
+	virtual void PostAct() override { }
+};
+
+/// An agent acting once every 1 to 100 steps, depending on its id.
+class Sleeper : public Agent {
+public:
+	Sleeper(Configuration* __conf) : Agent(__conf) { }
+
+protected:
+	virtual void PreAct() override {
+		SleepUntil(GetSceneMgr()->GetCurrentStep() + GetId() % 100 + 1);
+	}
+};
+
+/// An agent reading the messages of the previous step and sending one to another actor.
+class Messenger : public Agent {
+public:
+	Messenger(Configuration* __conf) : Agent(__conf) { }
+
+protected:
+	virtual void PreAct() override {
+		int sum = 0;
+		for(int value : GetMessages<int>()) {
+			sum += value;
+		}
+		auto& actors = GetSceneMgr()->GetNodesByType(dynamics::Node_Type::Actor);
+		Send(actors[(GetId() * 7 + GetSceneMgr()->GetCurrentStep()) % actors.size()]->GetHandle(), sum + 1);
+	}
+};
+
+/// Counter as a static component.
+template<std::size_t _Priority>
+struct StaticCounter : dynamics::StaticComponent<_Priority> {
+	void Act(dynamics::Actor& __actor) {
+		std::size_t slot = _Priority & 63;
+		auto& datapool = __actor.GetDataPool();
+		datapool.Set<int>(slot, datapool.Get<int>(slot) + 1);
+		datapool.Set<float>(slot, datapool.Get<float>(slot) * 0.5f + 1.0f);
+	}
+};
+
+/// An agent made of one static counter per priority.
+template<std::size_t... _Priorities>
+class StaticAgent final : public dynamics::StaticActor<StaticCounter<_Priorities>...> {
+public:
+	StaticAgent(dynamics::Actor::Configuration* __conf) : dynamics::StaticActor<StaticCounter<_Priorities>...>(__conf) { }
+
+protected:
+	virtual void PreAct() override { }
+	virtual void PostAct() override { }
+};
+
+/// A trigger reading one actor per step.
+class Probe : public dynamics::Trigger {
+public:
+	Probe(Configuration* __conf) : Trigger(__conf) {
+		_M_sum = 0;
+	}
+
+protected:
+	virtual void Act() override {
+		auto& actors = GetSceneMgr()->GetNodesByType(dynamics::Node_Type::Actor);
+		auto actor = static_cast<dynamics::Actor*>(actors[GetSceneMgr()->GetCurrentStep() % actors.size()]);
+		_M_sum += actor->GetDataPool().Get<int>(0);
+		Keep(_M_sum);
+	}
+
+private:
+	std::size_t _M_sum;
+};
+
+class Scene : public manager::SceneMgr {
+public:
+	Scene(Configuration* __conf) : SceneMgr(__conf) { }
+
+protected:
+	virtual void PreStep() override { }
+	virtual void PostStep() override { }
+};
+
+/// Sums the first counter of every actor at the end of an episode.
+class Tally : public manager::Monitor {
+public:
+	typedef std::size_t result_type;
+
+	result_type GetResult() const {
+		return _M_sum;
+	}
+
+protected:
+	virtual void Initialize() override {
+		_M_sum = 0;
+	}
+
+	virtual void Step() override { }
+
+	virtual void Finalize() override {
+		auto& actors = GetSceneMgr()->GetNodesByType(dynamics::Node_Type::Actor);
+		for(auto actor : actors) {
+			_M_sum += static_cast<dynamics::Actor*>(actor)->GetDataPool().Get<int>(0);
+		}
+	}
+
+private:
+	std::size_t _M_sum = 0;
+};
+
+/// Shape of a scenario.
+struct Scenario {
+	std::size_t Actors;
+	std::size_t Components;
+	std::size_t Triggers;
+	std::size_t Steps;
+};
+
+/// Adds the nodes of a scenario to an empty scene.
+template<typename _Actor = Agent>
+void _Populate(Scene* __scene, Scenario const& __scenario, bool __double_buffered = false, bool __track_dirty = false) {
+	std::size_t id = 1;
+	for(std::size_t i = 0; i < __scenario.Actors; i++) {
+		typename _Actor::Configuration actor_conf;
+		actor_conf.Id = id++;
+		actor_conf.DataPoolSize = 64;
+		actor_conf.DoubleBufferedData = __double_buffered;
+		actor_conf.TrackDirtyData = __track_dirty;
+		auto actor = __scene->AddNode<_Actor>(&actor_conf);
+		for(std::size_t j = 0; j < __scenario.Components; j++) {
+			Counter::Configuration component_conf;
+			component_conf.Id = j + 1;
+			component_conf.Priority = j;
+			actor->template AddComponent<Counter>(&component_conf);
+		}
+	}
+	for(std::size_t i = 0; i < __scenario.Triggers; i++) {
+		Probe::Configuration trigger_conf;
+		trigger_conf.Id = id++;
+		__scene->AddNode<Probe>(&trigger_conf);
+	}
+}
+
+/// Builds a scene of the given shape.
+template<typename _Actor = Agent>
+Scene* _Build(Scenario const& __scenario, std::size_t __threads, bool __double_buffered = false,
+		bool __track_dirty = false) {
+	Scene::Configuration conf;
+	conf.MaxStep = __scenario.Steps;
+	conf.Threads = __threads;
+	Scene* scene = new Scene(&conf);
+	_Populate<_Actor>(scene, __scenario, __double_buffered, __track_dirty);
+	return scene;
+}
+
+/// Builds a scene of the given shape whose actors carry their counters statically.
+Scene* _Build_Static(Scenario const& __scenario, std::size_t __threads) {
+	Scenario scenario = __scenario;
+	scenario.Components = 0;
+	switch(__scenario.Components) {
+	case 1:
+		return _Build<StaticAgent<0>>(scenario, __threads);
+	case 2:
+		return _Build<StaticAgent<0, 1>>(scenario, __threads);
+	default:
+		return _Build<StaticAgent<0, 1, 2, 3>>(scenario, __threads);
+	}
+}
+
+} /* namespace */
+
+void RegisterScene(Runner& __runner) {
+	std::size_t const hardware = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() : 1;
+	static const Scenario scenarios[] = {
+		{ 1000, 4, 4, 100 },
+		{ 10000, 4, 16, 50 },
+		{ 100000, 2, 16, 10 },
+		{ 1000000, 1, 16, 5 }
+	};
+
+	for(auto const& scenario : scenarios) {
+		if(scenario.Actors > __runner.GetOptions().MaxSize) {
+			continue;
+		}
+		for(std::size_t threads = 1; threads <= hardware; threads = threads == hardware ? hardware + 1 : hardware) {
+			Params params { { "actors", std::to_string(scenario.Actors) }, { "components", std::to_string(scenario.Components) },
+					{ "triggers", std::to_string(scenario.Triggers) }, { "steps", std::to_string(scenario.Steps) },
+					{ "threads", std::to_string(threads) } };
+
+			__runner.Add("SceneMgr::Build", params, [scenario, threads](State& __state) {
+				std::unique_ptr<Scene> scene(_Build(scenario, threads));
+				__state.Pause();
+				scene.reset();
+				__state.Resume();
+				__state.SetItems(scenario.Actors * (scenario.Components + 1));
+			});
+
+			__runner.Add("SceneMgr::Run/system", params, [scenario, threads](State& __state) {
+				__state.Pause();
+				std::unique_ptr<Scene> scene(_Build(scenario, threads));
+				scene->RegisterSystem<Counter>(0, [](manager::SystemSpan<Counter> const& __span) {
+					for(std::size_t i = 0; i < __span.Size(); i++) {
+						std::size_t slot = __span[i]->GetPriority() & 63;
+						auto& datapool = __span.GetDataPool(i);
+						datapool.Set<int>(slot, datapool.Get<int>(slot) + 1);
+						datapool.Set<float>(slot, datapool.Get<float>(slot) * 0.5f + 1.0f);
+					}
+				});
+				__state.Resume();
+				scene->Run();
+				__state.Pause();
+				scene.reset();
+				__state.Resume();
+				__state.SetItems(scenario.Actors * scenario.Components * scenario.Steps);
+			});
+
+			__runner.Add("SceneMgr::Run", params, [scenario, threads](State& __state) {
+				__state.Pause();
+				std::unique_ptr<Scene> scene(_Build(scenario, threads));
+				__state.Resume();
+				scene->Run();
+				__state.Pause();
+				scene.reset();
+				__state.Resume();
+				__state.SetItems(scenario.Actors * scenario.Components * scenario.Steps);
+			});
+
+			/// Same work as SceneMgr::Run, through double-buffered DataPools.
+			__runner.Add("SceneMgr::Run/double-buffered", params, [scenario, threads](State& __state) {
+				__state.Pause();
+				std::unique_ptr<Scene> scene(_Build(scenario, threads, true));
+				__state.Resume();
+				scene->Run();
+				__state.Pause();
+				scene.reset();
+				__state.Resume();
+				__state.SetItems(scenario.Actors * scenario.Components * scenario.Steps);
+			});
+
+			/// Same work as SceneMgr::Run, with the components compiled into the actors.
+			__runner.Add("SceneMgr::Run/static", params, [scenario, threads](State& __state) {
+				__state.Pause();
+				std::unique_ptr<Scene> scene(_Build_Static(scenario, threads));
+				__state.Resume();
+				scene->Run();
+				__state.Pause();
+				scene.reset();
+				__state.Resume();
+				__state.SetItems(scenario.Actors * scenario.Components * scenario.Steps);
+			});
+
+			/// Same work as SceneMgr::Run, with every step written to a replay log.
+			__runner.Add("SceneMgr::Run/recorded", params, [scenario, threads](State& __state) {
+				__state.Pause();
+				std::unique_ptr<Scene> scene(_Build(scenario, threads));
+				manager::ReplayRecorder::Configuration recorder_conf;
+				recorder_conf.Path = std::string(P_tmpdir) + "/bulwark_bench.replay";
+				manager::ReplayRecorder recorder(&recorder_conf);
+				__state.Resume();
+				scene->Run(&recorder);
+				__state.Pause();
+				scene.reset();
+				std::remove(recorder_conf.Path.c_str());
+				__state.Resume();
+				__state.SetItems(scenario.Actors * scenario.Components * scenario.Steps);
+			});
+
+			/// Same as SceneMgr::Run/recorded, the recorder only compares the slots written in the step.
+			__runner.Add("SceneMgr::Run/recorded-dirty", params, [scenario, threads](State& __state) {
+				__state.Pause();
+				std::unique_ptr<Scene> scene(_Build(scenario, threads, false, true));
+				manager::ReplayRecorder::Configuration recorder_conf;
+				recorder_conf.Path = std::string(P_tmpdir) + "/bulwark_bench.replay";
+				manager::ReplayRecorder recorder(&recorder_conf);
+				__state.Resume();
+				scene->Run(&recorder);
+				__state.Pause();
+				scene.reset();
+				std::remove(recorder_conf.Path.c_str());
+				__state.Resume();
+				__state.SetItems(scenario.Actors * scenario.Components * scenario.Steps);
+			});
+
+			/// Same work as SceneMgr::Run, each actor also sending a message per step.
+			__runner.Add("SceneMgr::Run/messages", params, [scenario, threads](State& __state) {
+				__state.Pause();
+				std::unique_ptr<Scene> scene(_Build<Messenger>(scenario, threads));
+				__state.Resume();
+				scene->Run();
+				__state.Pause();
+				scene.reset();
+				__state.Resume();
+				__state.SetItems(scenario.Actors * scenario.Components * scenario.Steps);
+			});
+
+			/// Same number of node-steps as SceneMgr::Run, most of them asleep.
+			__runner.Add("SceneMgr::Run/sleeping", params, [scenario, threads](State& __state) {
+				__state.Pause();
+				std::unique_ptr<Scene> scene(_Build<Sleeper>(scenario, threads));
+				__state.Resume();
+				scene->Run();
+				__state.Pause();
+				scene.reset();
+				__state.Resume();
+				__state.SetItems(scenario.Actors * scenario.Components * scenario.Steps);
+			});
+		}
+	}
+
+	/// One node in 256 carries the queried flag.
+	for(std::size_t nodes : { 10000u, 100000u, 1000000u }) {
+		if(nodes > __runner.GetOptions().MaxSize) {
+			continue;
+		}
+		Params params { { "nodes", std::to_string(nodes) }, { "selectivity", "1/256" } };
+		std::shared_ptr<Scene> scene;
+		auto build = [nodes, scene]() mutable -> Scene* {
+			if(!scene) {
+				Scene::Configuration conf;
+				scene.reset(new Scene(&conf));
+				for(std::size_t i = 0; i < nodes; i++) {
+					dynamics::Object::Configuration object_conf;
+					object_conf.Id = i + 1;
+					object_conf.Flag = i % 256 == 0 ? 0x3 : 0x1;
+					scene->AddNode<dynamics::Object>(&object_conf);
+				}
+			}
+			return scene.get();
+		};
+
+		__runner.Add("SceneMgr::QueryNodesByFlags", params, [build, nodes](State& __state) mutable {
+			__state.Pause();
+			Scene* scene = build();
+			__state.Resume();
+			std::size_t count = 0;
+			scene->ForEachNodeByFlags(0x2, [&count](dynamics::Node*) {
+				count++;
+			});
+			Keep(count);
+			__state.SetItems(nodes);
+		});
+
+		__runner.Add("SceneMgr::GetNodesByType/CheckFlag", params, [build, nodes](State& __state) mutable {
+			__state.Pause();
+			Scene* scene = build();
+			__state.Resume();
+			std::size_t count = 0;
+			for(auto node : scene->GetNodesByType(dynamics::Node_Type::Object)) {
+				count += node->CheckFlag(0x2);
+			}
+			Keep(count);
+			__state.SetItems(nodes);
+		});
+	}
+
+	/// Many small episodes, one serial scene per worker.
+	static const Scenario episode = { 200, 4, 4, 200 };
+	std::size_t const episodes = 256;
+	for(std::size_t threads = 1; threads <= hardware; threads = threads == hardware ? hardware + 1 : hardware) {
+		Params params { { "actors", std::to_string(episode.Actors) }, { "components", std::to_string(episode.Components) },
+				{ "steps", std::to_string(episode.Steps) }, { "episodes", std::to_string(episodes) },
+				{ "threads", std::to_string(threads) } };
+
+		__runner.Add("BatchRunner::Run", params, [episodes, threads](State& __state) {
+			__state.Pause();
+			manager::BatchRunner<Scene, Tally>::Configuration conf;
+			conf.Threads = threads;
+			manager::BatchRunner<Scene, Tally> batch(&conf, [] {
+				Scene::Configuration scene_conf;
+				scene_conf.MaxStep = episode.Steps;
+				return std::unique_ptr<Scene>(new Scene(&scene_conf));
+			}, [] {
+				return std::unique_ptr<Tally>(new Tally());
+			});
+			__state.Resume();
+			std::size_t total = batch.Run(episodes, [](Scene& __scene, manager::BatchRunner<Scene, Tally>::Episode const&) {
+				_Populate(&__scene, episode);
+			}, [](std::size_t& __total, std::size_t const& __episode) {
+				__total += __episode;
+			});
+			Keep(total);
+			__state.SetItems(episodes);
+		});
+	}
+}
+
+} /* namespace bench */
+} /* namespace bul */
@@ -0,0 +1,173 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../bulwark.h"
+#include "bench.h"
+
+namespace bul {
+namespace bench {
+namespace {
+class Walker : public dynamics::Actor {
+public:
+	Walker(Configuration* __conf) : Actor(__conf) { }
+
+protected:
+	virtual void PreAct() override { }
+	virtual void PostAct() override { }
+};
+
+class Scene : public manager::SceneMgr {
+public:
+	Scene(Configuration* __conf) : SceneMgr(__conf) { }
+
+protected:
+	virtual void PreStep() override { }
+	virtual void PostStep() override { }
+};
+
+/// One actor per unit of area, so that a query of radius _S_radius finds about 16 actors.
+static const float _S_radius = 2.26f;
+static const std::size_t _S_nearest = 8;
+static const std::size_t _S_queries = 256;
+
+/// A scene of __actors actors spread uniformly over a square, indexed by position.
+Scene* _Build_Square(std::size_t __actors) {
+	Scene::Configuration conf;
+	conf.PositionSlots = { 0, 1 };
+	conf.CellSize = _S_radius;
+	Scene* scene = new Scene(&conf);
+	float const side = std::sqrt(static_cast<float>(__actors));
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> coordinate(0.0f, side);
+	for(std::size_t i = 0; i < __actors; i++) {
+		Walker::Configuration actor_conf;
+		actor_conf.Id = i + 1;
+		actor_conf.DataPoolSize = 2;
+		auto actor = scene->AddNode<Walker>(&actor_conf);
+		actor->GetDataPool().Set<float>(0, coordinate(random));
+		actor->GetDataPool().Set<float>(1, coordinate(random));
+	}
+	scene->UpdateSpatialIndex();
+	return scene;
+}
+
+/// Query centers, at the positions of some actors.
+std::vector<float> _Centers(Scene& __scene) {
+	auto& actors = __scene.GetNodesByType(dynamics::Node_Type::Actor);
+	std::vector<float> centers;
+	for(std::size_t q = 0; q < _S_queries; q++) {
+		auto actor = static_cast<dynamics::Actor*>(actors[q * 7919 % actors.size()]);
+		centers.push_back(actor->GetDataPool().Get<float>(0));
+		centers.push_back(actor->GetDataPool().Get<float>(1));
+	}
+	return centers;
+}
+
+} /* namespace */
+
+void RegisterSpatial(Runner& __runner) {
+	for(std::size_t actors : { 10000u, 100000u, 1000000u }) {
+		if(actors > __runner.GetOptions().MaxSize) {
+			continue;
+		}
+		Params params { { "actors", std::to_string(actors) }, { "radius", "2.26" }, { "k", std::to_string(_S_nearest) } };
+		std::shared_ptr<Lazy<Scene>> scene(new Lazy<Scene>([actors] { return _Build_Square(actors); }));
+
+		__runner.Add("SceneMgr::UpdateSpatialIndex", params, [scene, actors](State& __state) {
+			scene->Get(__state).UpdateSpatialIndex();
+			__state.SetItems(actors);
+		});
+
+		__runner.Add("SceneMgr::QueryRadius", params, [scene](State& __state) {
+			Scene& target = scene->Get(__state);
+			std::vector<float> centers = _Centers(target);
+			std::vector<common::Handle> found;
+			std::size_t count = 0;
+			for(std::size_t q = 0; q < _S_queries; q++) {
+				found.clear();
+				target.QueryRadius(&centers[q * 2], _S_radius, found);
+				count += found.size();
+			}
+			Keep(count);
+			__state.SetItems(_S_queries);
+		});
+
+		/// What the actors do without the index: scan every actor.
+		__runner.Add("SceneMgr::QueryRadius/scan", params, [scene](State& __state) {
+			Scene& target = scene->Get(__state);
+			std::vector<float> centers = _Centers(target);
+			std::vector<common::Handle> found;
+			std::size_t count = 0;
+			for(std::size_t q = 0; q < _S_queries; q++) {
+				found.clear();
+				for(auto node : target.GetNodesByType(dynamics::Node_Type::Actor)) {
+					auto const& datapool = static_cast<dynamics::Actor*>(node)->GetDataPool();
+					float const dx = datapool.Get<float>(0) - centers[q * 2];
+					float const dy = datapool.Get<float>(1) - centers[q * 2 + 1];
+					if(dx * dx + dy * dy <= _S_radius * _S_radius) {
+						found.push_back(node->GetHandle());
+					}
+				}
+				count += found.size();
+			}
+			Keep(count);
+			__state.SetItems(_S_queries);
+		});
+
+		__runner.Add("SceneMgr::QueryNearest", params, [scene](State& __state) {
+			Scene& target = scene->Get(__state);
+			std::vector<float> centers = _Centers(target);
+			std::vector<common::SpatialGrid<common::Handle>::Hit> hits;
+			float sum = 0.0f;
+			for(std::size_t q = 0; q < _S_queries; q++) {
+				target.QueryNearest(&centers[q * 2], _S_nearest, hits);
+				sum += hits.back().DistanceSquared;
+			}
+			Keep(sum);
+			__state.SetItems(_S_queries);
+		});
+
+		/// A bounded max-heap over every actor.
+		__runner.Add("SceneMgr::QueryNearest/scan", params, [scene](State& __state) {
+			typedef std::pair<float, common::Handle> hit_type;
+			Scene& target = scene->Get(__state);
+			std::vector<float> centers = _Centers(target);
+			std::vector<hit_type> hits;
+			auto const nearer = [](hit_type const& __a, hit_type const& __b) {
+				return __a.first < __b.first;
+			};
+			float sum = 0.0f;
+			for(std::size_t q = 0; q < _S_queries; q++) {
+				hits.clear();
+				for(auto node : target.GetNodesByType(dynamics::Node_Type::Actor)) {
+					auto const& datapool = static_cast<dynamics::Actor*>(node)->GetDataPool();
+					float const dx = datapool.Get<float>(0) - centers[q * 2];
+					float const dy = datapool.Get<float>(1) - centers[q * 2 + 1];
+					float const d2 = dx * dx + dy * dy;
+					if(hits.size() < _S_nearest) {
+						hits.push_back(hit_type(d2, node->GetHandle()));
+						std::push_heap(hits.begin(), hits.end(), nearer);
+					} else if(d2 < hits.front().first) {
+						std::pop_heap(hits.begin(), hits.end(), nearer);
+						hits.back() = hit_type(d2, node->GetHandle());
+						std::push_heap(hits.begin(), hits.end(), nearer);
+					}
+				}
+				sum += hits.front().first;
+			}
+			Keep(sum);
+			__state.SetItems(_S_queries);
+		});
+	}
+}
+
+} /* namespace bench */
+} /* namespace bul */
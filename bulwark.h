@@ -22,16 +22,34 @@
 #ifndef __BULWARK__
 #define __BULWARK__
 
+#include "common/allocator.h"
 #include "common/container.h"
 #include "common/datapool.h"
+#include "common/flagindex.h"
+#include "common/handle.h"
+#include "common/mappedfile.h"
+#include "common/profiler.h"
+#include "common/smallmap.h"
+#include "common/spatialgrid.h"
+#include "common/threadpool.h"
+#include "common/timingwheel.h"
 #include "common/types.h"
 
 #include "dynamics/actor.h"
 #include "dynamics/node.h"
 #include "dynamics/object.h"
+#include "dynamics/staticactor.h"
 #include "dynamics/trigger.h"
 
+#include "manager/asyncmonitor.h"
+#include "manager/batchrunner.h"
+#include "manager/checkpoint.h"
+#include "manager/commandbuffer.h"
+#include "manager/mailbox.h"
 #include "manager/monitor.h"
+#include "manager/profilingmonitor.h"
+#include "manager/replay.h"
 #include "manager/scenemgr.h"
+#include "manager/system.h"
 
 #endif /* __BULWARK__ */
@@ -0,0 +1,281 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_COMMON_ALLOCATOR_H
+#define _BUL_COMMON_ALLOCATOR_H
+
+#include <type_traits>
+#include <stdexcept>
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace bul {
+namespace common {
+/// Counters reported by allocators.
+struct AllocatorStats {
+	std::size_t Allocations = 0;
+	std::size_t Deallocations = 0;
+	std::size_t Slabs = 0;
+	std::size_t BytesReserved = 0;
+	std::size_t BytesInUse = 0;
+
+	AllocatorStats& operator+=(AllocatorStats const& __other) {
+		Allocations += __other.Allocations;
+		Deallocations += __other.Deallocations;
+		Slabs += __other.Slabs;
+		BytesReserved += __other.BytesReserved;
+		BytesInUse += __other.BytesInUse;
+		return *this;
+	}
+};
+
+/// A minimal spin lock, allocations are short enough that spinning beats sleeping.
+class _Spin_Lock final {
+public:
+	_Spin_Lock() {
+		_M_flag.clear();
+	}
+
+	void lock() {
+		while(_M_flag.test_and_set(std::memory_order_acquire)) { }
+	}
+
+	void unlock() {
+		_M_flag.clear(std::memory_order_release);
+	}
+
+private:
+	std::atomic_flag _M_flag;
+};
+
+/// A pool of equally sized blocks carved out of large slabs, each block is preceded by a pointer to its pool.
+/// Allocate() and Deallocate() are serialized by __lock when one is given.
+class SlabPool final {
+	/// Header in front of each block, padded so that the block stays maximally aligned.
+	union alignas(alignof(std::max_align_t)) _Header {
+		SlabPool* pool;
+		_Header* next;
+	};
+
+public:
+	SlabPool(std::size_t __size, std::size_t __slab_bytes, _Spin_Lock* __lock = nullptr) :
+			_M_size(__size), _M_stride(_S_Stride(__size)),
+			_M_per_slab(__slab_bytes / _S_Stride(__size) > 0 ? __slab_bytes / _S_Stride(__size) : 1), _M_lock(__lock) {
+		_M_free = nullptr;
+		_M_cursor = _M_limit = nullptr;
+	}
+	~SlabPool() {
+		Release();
+	}
+
+	SlabPool(SlabPool const&) = delete;
+	SlabPool& operator=(SlabPool const&) = delete;
+
+	/// Returns uninitialized storage for one object.
+	void* Allocate() {
+		_Lock_Guard guard(_M_lock);
+		_Header* header;
+		if(_M_free != nullptr) {
+			header = _M_free;
+			_M_free = _M_free->next;
+		} else {
+			if(_M_cursor == _M_limit) {
+				_M_Grow();
+			}
+			header = reinterpret_cast<_Header*>(_M_cursor);
+			_M_cursor += _M_stride;
+		}
+		header->pool = this;
+		_M_stats.Allocations++;
+		_M_stats.BytesInUse += _M_size;
+		return header + 1;
+	}
+
+	/// Returns storage obtained from Allocate() to the pool it came from.
+	static void Deallocate(void* __ptr) {
+		_Header* header = static_cast<_Header*>(__ptr) - 1;
+		SlabPool* pool = header->pool;
+		_Lock_Guard guard(pool->_M_lock);
+		header->next = pool->_M_free;
+		pool->_M_free = header;
+		pool->_M_stats.Deallocations++;
+		pool->_M_stats.BytesInUse -= pool->_M_size;
+	}
+
+	/// Frees every slab at once, outstanding blocks become invalid.
+	void Release() {
+		_M_slab.clear();
+		_M_free = nullptr;
+		_M_cursor = _M_limit = nullptr;
+		_M_stats.Slabs = 0;
+		_M_stats.BytesReserved = 0;
+		_M_stats.BytesInUse = 0;
+	}
+
+	AllocatorStats const& Stats() const {
+		return _M_stats;
+	}
+
+protected:
+	/// Locks the optional lock for a scope.
+	struct _Lock_Guard {
+		_Lock_Guard(_Spin_Lock* __lock) : _M_lock(__lock) {
+			if(_M_lock) {
+				_M_lock->lock();
+			}
+		}
+		~_Lock_Guard() {
+			if(_M_lock) {
+				_M_lock->unlock();
+			}
+		}
+
+		_Spin_Lock* const _M_lock;
+	};
+
+	static std::size_t _S_Stride(std::size_t __size) {
+		std::size_t const align = sizeof(_Header);
+		return sizeof(_Header) + (__size + align - 1) / align * align;
+	}
+
+	void _M_Grow() {
+		std::size_t const bytes = _M_stride * _M_per_slab;
+		_M_slab.push_back(std::unique_ptr<_Header[]>(new _Header[bytes / sizeof(_Header)]));
+		_M_cursor = reinterpret_cast<char*>(_M_slab.back().get());
+		_M_limit = _M_cursor + bytes;
+		_M_stats.Slabs++;
+		_M_stats.BytesReserved += bytes;
+	}
+
+private:
+	std::size_t const _M_size;
+	std::size_t const _M_stride;
+	std::size_t const _M_per_slab;
+	_Spin_Lock* const _M_lock;
+
+	std::vector<std::unique_ptr<_Header[]>> _M_slab;
+	_Header* _M_free;
+	char* _M_cursor;
+	char* _M_limit;
+
+	AllocatorStats _M_stats;
+};
+
+/// Assigns a small dense index to each type on first use.
+struct _Type_Index {
+	template<typename _Tp>
+	static std::size_t Get() {
+		static std::size_t const index = _S_Next()++;
+		return index;
+	}
+
+	static std::atomic<std::size_t>& _S_Next() {
+		static std::atomic<std::size_t> next(0);
+		return next;
+	}
+};
+
+/// Keeps one SlabPool per concrete type so that objects of the same type are placed next to each other.
+/// New() and Delete() may be called from several threads at once, Release() may not.
+class SlabAllocator final {
+public:
+	SlabAllocator(std::size_t __slab_bytes = 64 * 1024) : _M_slab_bytes(__slab_bytes) { }
+	~SlabAllocator() { }
+
+	SlabAllocator(SlabAllocator const&) = delete;
+	SlabAllocator& operator=(SlabAllocator const&) = delete;
+
+	/// Constructs an object of type _Tp in its pool.
+	template<typename _Tp, typename... _Args>
+	_Tp* New(_Args&&... __args) {
+		void* ptr = _M_Pool<_Tp>().Allocate();
+		try {
+			return ::new(ptr) _Tp(std::forward<_Args>(__args)...);
+		} catch(...) {
+			SlabPool::Deallocate(ptr);
+			throw;
+		}
+	}
+
+	/// Destroys an object created by New() and gives its block back. _Tp may be a polymorphic base.
+	template<typename _Tp>
+	static void Delete(_Tp* __ptr) {
+		void* block = _S_Block(__ptr);
+		__ptr->~_Tp();
+		SlabPool::Deallocate(block);
+	}
+
+	/// Destroys an object without returning its block, used before Release().
+	template<typename _Tp>
+	static void Destroy(_Tp* __ptr) {
+		__ptr->~_Tp();
+	}
+
+	/// Frees the slabs of every pool at once.
+	void Release() {
+		for(auto& pool : _M_pool) {
+			if(pool) {
+				pool->Release();
+			}
+		}
+	}
+
+	/// Counters of one type or of all types.
+	template<typename _Tp>
+	AllocatorStats Stats() const {
+		std::size_t index = _Type_Index::Get<_Tp>();
+		return index < _M_pool.size() && _M_pool[index] ? _M_pool[index]->Stats() : AllocatorStats();
+	}
+
+	AllocatorStats Stats() const {
+		AllocatorStats stats;
+		for(auto& pool : _M_pool) {
+			if(pool) {
+				stats += pool->Stats();
+			}
+		}
+		return stats;
+	}
+
+protected:
+	template<typename _Tp>
+	SlabPool& _M_Pool() {
+		std::size_t index = _Type_Index::Get<_Tp>();
+		std::lock_guard<_Spin_Lock> guard(_M_lock);
+		if(index >= _M_pool.size()) {
+			_M_pool.resize(index + 1);
+		}
+		if(!_M_pool[index]) {
+			_M_pool[index].reset(new SlabPool(sizeof(_Tp), _M_slab_bytes, &_M_lock));
+		}
+		return *_M_pool[index];
+	}
+
+	/// Address of the most derived object, which is where the block starts.
+	template<typename _Tp>
+	static typename std::enable_if<std::is_polymorphic<_Tp>::value, void*>::type _S_Block(_Tp* __ptr) {
+		return dynamic_cast<void*>(__ptr);
+	}
+
+	template<typename _Tp>
+	static typename std::enable_if<!std::is_polymorphic<_Tp>::value, void*>::type _S_Block(_Tp* __ptr) {
+		return __ptr;
+	}
+
+private:
+	std::size_t const _M_slab_bytes;
+	std::vector<std::unique_ptr<SlabPool>> _M_pool;
+	_Spin_Lock _M_lock;
+};
+
+} /* namespace common */
+} /* namespace bul */
+
+#endif /* _BUL_COMMON_ALLOCATOR_H */
@@ -5,11 +5,20 @@
 #ifndef _BUL_COMMON_CONTAINER_H
 #define _BUL_COMMON_CONTAINER_H
 
+#include <cstdint>
+
 #include <type_traits>
 #include <stdexcept>
 
+#include <algorithm>
+#include <functional>
+#include <iterator>
 #include <list>
 #include <tuple>
+#include <utility>
+#include <vector>
+
+#include "smallmap.h"
 
 namespace bul {
 namespace common {
@@ -21,21 +30,492 @@ struct Key;
 template<typename... _Tags>
 struct Tag;
 
+/// A tag bucket backed by a linked list, elements never move and keep insertion order.
+template<typename _Tp>
+class ListBucket {
+	typedef std::list<_Tp> _storage_type;
+
+public:
+	typedef _Tp value_type;
+	typedef typename _storage_type::const_iterator iterator;
+	typedef typename _storage_type::const_iterator const_iterator;
+	typedef typename _storage_type::iterator locator;
+
+	/// Appends an element and stores where it lives into __slot.
+	void Push(value_type const& __value, locator* __slot) {
+		_M_storage.push_back(__value);
+		*__slot = --_M_storage.end();
+	}
+
+	/// Removes the element recorded in __slot.
+	void Erase(locator* __slot) {
+		_M_storage.erase(*__slot);
+	}
+
+	/// Removes the elements recorded in [__first, __last).
+	void EraseBatch(locator* const* __first, locator* const* __last) {
+		for(; __first != __last; ++__first) {
+			Erase(*__first);
+		}
+	}
+
+	value_type const& Back() const {
+		return _M_storage.back();
+	}
+
+	const_iterator begin() const {
+		return _M_storage.begin();
+	}
+
+	const_iterator end() const {
+		return _M_storage.end();
+	}
+
+	std::size_t size() const {
+		return _M_storage.size();
+	}
+
+	bool empty() const {
+		return _M_storage.empty();
+	}
+
+private:
+	_storage_type _M_storage;
+};
+
+/// A tag bucket backed by a contiguous array, erases in O(1) by moving the last element into the hole.
+template<typename _Tp>
+class VectorBucket {
+public:
+	typedef _Tp value_type;
+	typedef typename std::vector<_Tp>::const_iterator iterator;
+	typedef typename std::vector<_Tp>::const_iterator const_iterator;
+	typedef std::size_t locator;
+
+	/// Appends an element and stores its index into __slot.
+	void Push(value_type const& __value, locator* __slot) {
+		*__slot = _M_value.size();
+		_M_value.push_back(__value);
+		_M_slot.push_back(__slot);
+	}
+
+	/// Removes the element recorded in __slot, the last element takes its place.
+	void Erase(locator* __slot) {
+		std::size_t index = *__slot;
+		std::size_t last = _M_value.size() - 1;
+		if(index != last) {
+			_M_value[index] = _M_value[last];
+			_M_slot[index] = _M_slot[last];
+			*_M_slot[index] = index;
+		}
+		_M_value.pop_back();
+		_M_slot.pop_back();
+	}
+
+	/// Removes the elements recorded in [__first, __last).
+	void EraseBatch(locator* const* __first, locator* const* __last) {
+		for(; __first != __last; ++__first) {
+			Erase(*__first);
+		}
+	}
+
+	value_type const& Back() const {
+		return _M_value.back();
+	}
+
+	value_type const& operator[](std::size_t __index) const {
+		return _M_value[__index];
+	}
+
+	const_iterator begin() const {
+		return _M_value.begin();
+	}
+
+	const_iterator end() const {
+		return _M_value.end();
+	}
+
+	std::size_t size() const {
+		return _M_value.size();
+	}
+
+	bool empty() const {
+		return _M_value.empty();
+	}
+
+	value_type const* data() const {
+		return _M_value.data();
+	}
+
+protected:
+	std::vector<value_type> _M_value;
+	std::vector<locator*> _M_slot;
+};
+
+/// A contiguous tag bucket which keeps insertion order, erasing shifts the following elements down.
+/// A batch shifts them once, see EraseBatch(...).
+template<typename _Tp>
+class OrderedVectorBucket : public VectorBucket<_Tp> {
+	typedef VectorBucket<_Tp> _Base;
+
+public:
+	typedef typename _Base::locator locator;
+
+	/// Removes the element recorded in __slot and closes the gap.
+	void Erase(locator* __slot) {
+		std::size_t index = *__slot;
+		this->_M_value.erase(this->_M_value.begin() + index);
+		this->_M_slot.erase(this->_M_slot.begin() + index);
+		for(std::size_t i = index; i < this->_M_slot.size(); i++) {
+			*this->_M_slot[i] = i;
+		}
+	}
+
+	/// Removes the elements recorded in [__first, __last) and closes the gaps in one pass.
+	void EraseBatch(locator* const* __first, locator* const* __last) {
+		if(__first == __last) {
+			return;
+		}
+		std::size_t lowest = this->_M_value.size();
+		for(; __first != __last; ++__first) {
+			lowest = std::min(lowest, **__first);
+			this->_M_slot[**__first] = nullptr;
+		}
+		std::size_t write = lowest;
+		for(std::size_t read = lowest; read < this->_M_slot.size(); read++) {
+			if(this->_M_slot[read]) {
+				this->_M_value[write] = this->_M_value[read];
+				this->_M_slot[write] = this->_M_slot[read];
+				*this->_M_slot[write] = write;
+				write++;
+			}
+		}
+		this->_M_value.resize(write);
+		this->_M_slot.resize(write);
+	}
+};
+
+/// A contiguous tag bucket keeping its first _N elements inline, with the order semantics of OrderedVectorBucket.
+template<typename _Tp, std::size_t _N>
+class SmallVectorBucket {
+public:
+	typedef _Tp value_type;
+	typedef _Tp const* iterator;
+	typedef _Tp const* const_iterator;
+	typedef std::size_t locator;
+
+	SmallVectorBucket() { }
+
+	SmallVectorBucket(SmallVectorBucket const&) = delete;
+	SmallVectorBucket& operator=(SmallVectorBucket const&) = delete;
+
+	/// Appends an element and stores its index into __slot.
+	void Push(value_type const& __value, locator* __slot) {
+		*__slot = _M_value.size();
+		_M_value.push_back(__value);
+		_M_slot.push_back(__slot);
+	}
+
+	/// Removes the element recorded in __slot and closes the gap.
+	void Erase(locator* __slot) {
+		std::size_t index = *__slot;
+		_M_value.erase(index);
+		_M_slot.erase(index);
+		for(std::size_t i = index; i < _M_slot.size(); i++) {
+			*_M_slot[i] = i;
+		}
+	}
+
+	/// Removes the elements recorded in [__first, __last) and closes the gaps in one pass.
+	void EraseBatch(locator* const* __first, locator* const* __last) {
+		if(__first == __last) {
+			return;
+		}
+		std::size_t lowest = _M_value.size();
+		for(; __first != __last; ++__first) {
+			lowest = std::min(lowest, **__first);
+			_M_slot[**__first] = nullptr;
+		}
+		std::size_t write = lowest;
+		for(std::size_t read = lowest; read < _M_slot.size(); read++) {
+			if(_M_slot[read]) {
+				_M_value[write] = _M_value[read];
+				_M_slot[write] = _M_slot[read];
+				*_M_slot[write] = write;
+				write++;
+			}
+		}
+		while(_M_value.size() > write) {
+			_M_value.pop_back();
+			_M_slot.pop_back();
+		}
+	}
+
+	value_type const& Back() const {
+		return _M_value.back();
+	}
+
+	value_type const& operator[](std::size_t __index) const {
+		return _M_value[__index];
+	}
+
+	const_iterator begin() const {
+		return _M_value.begin();
+	}
+
+	const_iterator end() const {
+		return _M_value.end();
+	}
+
+	std::size_t size() const {
+		return _M_value.size();
+	}
+
+	bool empty() const {
+		return _M_value.empty();
+	}
+
+	value_type const* data() const {
+		return _M_value.data();
+	}
+
+private:
+	_Small_Vector<value_type, _N> _M_value;
+	_Small_Vector<locator*, _N> _M_slot;
+};
+
+/// Small storage for Container: Container<..., Small<4>::Map, Small<4, 2>::Bucket> keeps up to 4 entries
+/// per map and 2 elements per bucket inline, so a container of a few elements does not allocate.
+template<std::size_t _N, std::size_t _Bucket_N = _N>
+struct Small {
+	template<typename _Key, typename _Value>
+	using Map = SmallMap<_Key, _Value, _N>;
+
+	template<typename _Tp>
+	using Bucket = SmallVectorBucket<_Tp, _Bucket_N>;
+};
+
+/// A contiguous array split into an active prefix and an inactive suffix, the active elements in the order
+/// of their keys (of insertion by default). Elements are added, erased and moved between the two parts in
+/// O(1): an element leaving the ordered active elements stays in place as a hole, an element joining them
+/// is appended after them. Commit() closes the holes and merges the newcomers in, in one pass over the
+/// active part and a sort of the newcomers; the active part is data()[0, ActiveSize()) after it.
+/// Each element keeps its position in a locator owned by the caller.
+template<typename _Tp, typename _Key = std::uint64_t>
+class Partition {
+	/// Marks of the positions in the ordered active elements.
+	enum _Hole : unsigned char {
+		_S_live,
+		_S_inactive,
+		_S_erased
+	};
+
+	struct _Entry {
+		_Tp value;
+		std::size_t* slot;
+		_Key key;
+	};
+
+public:
+	typedef _Tp value_type;
+	typedef _Key key_type;
+	typedef std::size_t locator;
+
+	Partition() : _M_active(0), _M_ordered(0), _M_holes(0), _M_next_key() { }
+
+	/// Appends an element keyed after every element pushed so far, and stores its index into __slot.
+	void Push(value_type const& __value, bool __active, locator* __slot) {
+		Push(__value, __active, __slot, _M_next_key++);
+	}
+
+	/// Appends an element with a key of its own, and stores its index into __slot.
+	void Push(value_type const& __value, bool __active, locator* __slot, key_type const& __key) {
+		*__slot = _M_value.size();
+		_M_value.push_back(__value);
+		_M_slot.push_back(__slot);
+		_M_key.push_back(__key);
+		_M_hole.push_back(_S_live);
+		if(__active) {
+			_M_Swap(*__slot, _M_active);
+			_M_active++;
+		}
+	}
+
+	/// Removes the element recorded in __slot, the order of the inactive ones is not kept.
+	void Erase(locator* __slot) {
+		std::size_t index = *__slot;
+		if(index < _M_ordered) {
+			if(_M_hole[index] == _S_live) {
+				_M_holes++;
+			}
+			_M_hole[index] = _S_erased;
+			_M_slot[index] = nullptr;
+			return;
+		}
+		SetActive(__slot, false);
+		_M_Swap(*__slot, _M_value.size() - 1);
+		_M_value.pop_back();
+		_M_slot.pop_back();
+		_M_key.pop_back();
+		_M_hole.pop_back();
+	}
+
+	/// Moves the element recorded in __slot to the active or inactive part.
+	void SetActive(locator* __slot, bool __active) {
+		std::size_t index = *__slot;
+		if(index < _M_ordered) {
+			if(__active && _M_hole[index] == _S_inactive) {
+				_M_hole[index] = _S_live;
+				_M_holes--;
+			} else if(!__active && _M_hole[index] == _S_live) {
+				_M_hole[index] = _S_inactive;
+				_M_holes++;
+			}
+		} else if(__active && index >= _M_active) {
+			_M_Swap(index, _M_active);
+			_M_active++;
+		} else if(!__active && index < _M_active) {
+			_M_active--;
+			_M_Swap(index, _M_active);
+		}
+	}
+
+	bool IsActive(locator const* __slot) const {
+		return *__slot < _M_active && _M_hole[*__slot] == _S_live;
+	}
+
+	/// Puts the active part back in key order without holes, does nothing if nothing moved.
+	void Commit() {
+		if(_M_holes == 0 && _M_ordered == _M_active) {
+			return;
+		}
+		/// The ordered elements still active, merged with the newcomers sorted by key.
+		_M_merge.clear();
+		_M_moved.clear();
+		for(std::size_t i = 0; i < _M_ordered; i++) {
+			if(_M_hole[i] == _S_live) {
+				_M_merge.push_back(_Entry { _M_value[i], _M_slot[i], _M_key[i] });
+			} else if(_M_hole[i] == _S_inactive) {
+				_M_moved.push_back(_Entry { _M_value[i], _M_slot[i], _M_key[i] });
+			}
+		}
+		std::size_t const ordered = _M_merge.size();
+		for(std::size_t i = _M_ordered; i < _M_active; i++) {
+			_M_merge.push_back(_Entry { _M_value[i], _M_slot[i], _M_key[i] });
+		}
+		auto const by_key = [](_Entry const& __a, _Entry const& __b) {
+			return __a.key < __b.key;
+		};
+		std::sort(_M_merge.begin() + ordered, _M_merge.end(), by_key);
+		std::inplace_merge(_M_merge.begin(), _M_merge.begin() + ordered, _M_merge.end(), by_key);
+
+		/// Active elements first, then those which left, then the erased positions are filled from the end.
+		std::size_t write = 0;
+		for(auto const& entry : _M_merge) {
+			_M_Put(write++, entry);
+		}
+		std::size_t const active = write;
+		for(auto const& entry : _M_moved) {
+			_M_Put(write++, entry);
+		}
+		std::size_t size = _M_value.size();
+		while(write < _M_active && size > _M_active) {
+			size--;
+			_M_Put(write++, _Entry { _M_value[size], _M_slot[size], _M_key[size] });
+		}
+		if(write < _M_active) {
+			size = write;
+		}
+		_M_value.resize(size);
+		_M_slot.resize(size);
+		_M_key.resize(size);
+		_M_hole.resize(size);
+
+		_M_active = _M_ordered = active;
+		_M_holes = 0;
+	}
+
+	/// Number of active elements, they are data()[0, ActiveSize()) in key order after Commit().
+	std::size_t ActiveSize() const {
+		return _M_active;
+	}
+
+	/// Number of elements, data()[0, size()) holds them all after Commit().
+	std::size_t size() const {
+		return _M_value.size();
+	}
+
+	value_type const* data() const {
+		return _M_value.data();
+	}
+
+	void reserve(std::size_t __size) {
+		_M_value.reserve(__size);
+		_M_slot.reserve(__size);
+		_M_key.reserve(__size);
+		_M_hole.reserve(__size);
+	}
+
+	void clear() {
+		_M_value.clear();
+		_M_slot.clear();
+		_M_key.clear();
+		_M_hole.clear();
+		_M_active = _M_ordered = _M_holes = 0;
+	}
+
+protected:
+	void _M_Swap(std::size_t __a, std::size_t __b) {
+		if(__a != __b) {
+			std::swap(_M_value[__a], _M_value[__b]);
+			std::swap(_M_slot[__a], _M_slot[__b]);
+			std::swap(_M_key[__a], _M_key[__b]);
+			std::swap(_M_hole[__a], _M_hole[__b]);
+			*_M_slot[__a] = __a;
+			*_M_slot[__b] = __b;
+		}
+	}
+
+	void _M_Put(std::size_t __index, _Entry const& __entry) {
+		_M_value[__index] = __entry.value;
+		_M_slot[__index] = __entry.slot;
+		_M_key[__index] = __entry.key;
+		_M_hole[__index] = _S_live;
+		*__entry.slot = __index;
+	}
+
+private:
+	std::vector<value_type> _M_value;
+	std::vector<locator*> _M_slot;
+	std::vector<key_type> _M_key;
+	std::vector<unsigned char> _M_hole;
+	/// Elements [0, _M_ordered) are in key order, _M_holes of them inactive or erased; those in
+	/// [_M_ordered, _M_active) joined the active part since the last Commit().
+	std::size_t _M_active;
+	std::size_t _M_ordered;
+	std::size_t _M_holes;
+	key_type _M_next_key;
+	std::vector<_Entry> _M_merge;
+	std::vector<_Entry> _M_moved;
+};
+
 /// Base of Container, defines basic types.
-template<typename _Tp, typename _KeySet, typename _TagSet, template<typename...> class _Map_Container>
+template<typename _Tp, typename _KeySet, typename _TagSet, template<typename...> class _Map_Container,
+		template<typename> class _Bucket>
 struct _Container_Base;
 
-template<typename _Tp, typename... _Keys, typename... _Tags, template<typename...> class _Map_Container>
-struct _Container_Base<_Tp*, Key<_Keys...>, Tag<_Tags...>, _Map_Container> {
+template<typename _Tp, typename... _Keys, typename... _Tags, template<typename...> class _Map_Container,
+		template<typename> class _Bucket>
+struct _Container_Base<_Tp*, Key<_Keys...>, Tag<_Tags...>, _Map_Container, _Bucket> {
 	typedef _Tp* _value_type;
-	typedef std::list<_value_type> _value_list_type;
+	typedef _Bucket<_value_type> _value_list_type;
 
 	typedef std::tuple<_Map_Container<_Keys, _value_type>...> _key_type;
 	typedef std::tuple<_Map_Container<_Tags, _value_list_type>...> _tag_type;
 
 	typedef std::tuple<typename _Map_Container<_Keys, _value_type>::iterator...> _key_locator_type;
 	typedef std::tuple<typename _Map_Container<_Tags, _value_list_type>::iterator...> _tag_major_locator_type;
-	typedef std::tuple<typename std::conditional<true, typename _value_list_type::iterator
+	typedef std::tuple<typename std::conditional<true, typename _value_list_type::locator
 			, _Tags>::type...> _tag_minor_locator_type;
 	struct _locator {
 		_key_locator_type _key;
@@ -61,33 +541,93 @@ struct _Erase_Key_Helper<0, _Locator, _Storage> {
 	void operator()(_Storage & __key_storage, _Locator const& __locator) { }
 };
 
-/// Help erase elements by tag.
+/// Help erase elements by tag, the tag at index __skip is left alone (its bucket is being dropped as a whole).
 template<std::size_t _Index, typename _Locator, typename _Storage>
 struct _Erase_Tag_Helper {
-	void operator()(_Storage & __tag_storage, _Locator const& __locator) {
-			(*std::get<_Index - 1>(__locator._tag_major)).second.erase(std::get<_Index - 1>(__locator._tag_minor));
-			if((*std::get<_Index - 1>(__locator._tag_major)).second.size() == 0) {
-				std::get<_Index - 1>(__tag_storage).erase(std::get<_Index - 1>(__locator._tag_major));
+	void operator()(_Storage & __tag_storage, _Locator & __locator, std::size_t __skip) {
+			if(_Index - 1 != __skip) {
+				(*std::get<_Index - 1>(__locator._tag_major)).second.Erase(&std::get<_Index - 1>(__locator._tag_minor));
+				if((*std::get<_Index - 1>(__locator._tag_major)).second.size() == 0) {
+					std::get<_Index - 1>(__tag_storage).erase(std::get<_Index - 1>(__locator._tag_major));
+				}
 			}
 
 			_Erase_Tag_Helper<_Index - 1, _Locator, _Storage> helper;
-			helper(__tag_storage, __locator);
+			helper(__tag_storage, __locator, __skip);
 		}
 };
 
 template<typename _Locator, typename _Storage>
 struct _Erase_Tag_Helper<0, _Locator, _Storage> {
-	void operator()(_Storage & __tag_storage, _Locator const& __locator) { }
+	void operator()(_Storage & __tag_storage, _Locator & __locator, std::size_t __skip) { }
+};
+
+/// Help erase a batch of elements by tag: the elements leaving a bucket are erased from it in one call,
+/// so that a bucket keeping its order closes its gaps once.
+template<std::size_t _Index, typename _Locator, typename _Storage>
+struct _Erase_Tag_Batch_Helper {
+	typedef typename std::tuple_element<_Index - 1, decltype(_Locator::_tag_major)>::type _major_type;
+	typedef typename std::tuple_element<_Index - 1, decltype(_Locator::_tag_minor)>::type _minor_type;
+
+	void operator()(_Storage & __tag_storage, std::vector<_Locator*> const& __locators) {
+		std::vector<std::pair<_major_type, _minor_type*>> entries;
+		entries.reserve(__locators.size());
+		for(auto locator : __locators) {
+			entries.push_back(std::make_pair(std::get<_Index - 1>(locator->_tag_major),
+					&std::get<_Index - 1>(locator->_tag_minor)));
+		}
+		std::sort(entries.begin(), entries.end(), [](std::pair<_major_type, _minor_type*> const& __a,
+				std::pair<_major_type, _minor_type*> const& __b) {
+			return std::less<void const*>()(&(*__a.first).second, &(*__b.first).second);
+		});
+
+		std::vector<_minor_type*> slots;
+		for(std::size_t i = 0; i < entries.size();) {
+			_major_type bucket = entries[i].first;
+			slots.clear();
+			for(; i < entries.size() && &(*entries[i].first).second == &(*bucket).second; i++) {
+				slots.push_back(entries[i].second);
+			}
+			(*bucket).second.EraseBatch(slots.data(), slots.data() + slots.size());
+			if((*bucket).second.size() == 0) {
+				std::get<_Index - 1>(__tag_storage).erase(bucket);
+			}
+		}
+
+		_Erase_Tag_Batch_Helper<_Index - 1, _Locator, _Storage> helper;
+		helper(__tag_storage, __locators);
+	}
+};
+
+template<typename _Locator, typename _Storage>
+struct _Erase_Tag_Batch_Helper<0, _Locator, _Storage> {
+	void operator()(_Storage & __tag_storage, std::vector<_Locator*> const& __locators) { }
+};
+
+/// Compile-time list of indices, used to unpack tuples.
+template<std::size_t... _Indices>
+struct _Index_Sequence { };
+
+template<std::size_t _Count, std::size_t... _Indices>
+struct _Make_Index_Sequence : _Make_Index_Sequence<_Count - 1, _Count - 1, _Indices...> { };
+
+template<std::size_t... _Indices>
+struct _Make_Index_Sequence<0, _Indices...> {
+	typedef _Index_Sequence<_Indices...> type;
 };
 
 /// A container which offers quick read-only access to elements by either key or tag.
-template<typename _Tp, typename _KeySet, typename _TagSet, template<typename...> class _Map_Container>
+/// _Bucket decides how the elements sharing a tag are stored (ListBucket, VectorBucket, OrderedVectorBucket
+/// or Small<...>::Bucket); _Map_Container may be Small<...>::Map for containers which hold a few elements.
+template<typename _Tp, typename _KeySet, typename _TagSet, template<typename...> class _Map_Container,
+		template<typename> class _Bucket = ListBucket>
 class Container;
 
-template<typename _Tp, typename... _Keys, typename... _Tags, template<typename...> class _Map_Container>
-class Container<_Tp*, Key<_Keys...>, Tag<_Tags...>, _Map_Container> final :
-		protected _Container_Base<_Tp*, Key<_Keys...>, Tag<_Tags...>, _Map_Container> {
-	typedef _Container_Base<_Tp*, Key<_Keys...>, Tag<_Tags...>, _Map_Container> _Base;
+template<typename _Tp, typename... _Keys, typename... _Tags, template<typename...> class _Map_Container,
+		template<typename> class _Bucket>
+class Container<_Tp*, Key<_Keys...>, Tag<_Tags...>, _Map_Container, _Bucket> final :
+		protected _Container_Base<_Tp*, Key<_Keys...>, Tag<_Tags...>, _Map_Container, _Bucket> {
+	typedef _Container_Base<_Tp*, Key<_Keys...>, Tag<_Tags...>, _Map_Container, _Bucket> _Base;
 
 public:
 	typedef typename _Base::_value_type value_type;
@@ -103,24 +643,250 @@ public:
 	Container() { }
 	~Container() { }
 
+	/// Elements carrying every tag given to Tag<I>(...), found without copying them: the smallest of the
+	/// buckets drives the iteration and the other tags are checked through each element's locator.
+	/// At least one tag must be given. The container must not change while a query is iterated.
+	class _Query {
+		typedef std::tuple<typename _Map_Container<_Tags, value_list_type>::const_iterator...> _major_type;
+
+	public:
+		/// Forward iterator over the matching elements.
+		class const_iterator {
+		public:
+			typedef std::forward_iterator_tag iterator_category;
+			typedef typename Container::value_type value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef value_type const* pointer;
+			typedef value_type const& reference;
+
+			const_iterator(_Query const* __query, typename value_list_type::const_iterator __iter,
+					typename value_list_type::const_iterator __end) : _M_query(__query), _M_iter(__iter), _M_end(__end) {
+				_M_Skip();
+			}
+
+			reference operator*() const {
+				return *_M_iter;
+			}
+
+			pointer operator->() const {
+				return &*_M_iter;
+			}
+
+			const_iterator& operator++() {
+				++_M_iter;
+				_M_Skip();
+				return *this;
+			}
+
+			const_iterator operator++(int) {
+				const_iterator ret = *this;
+				++*this;
+				return ret;
+			}
+
+			bool operator==(const_iterator const& __other) const {
+				return _M_iter == __other._M_iter;
+			}
+
+			bool operator!=(const_iterator const& __other) const {
+				return _M_iter != __other._M_iter;
+			}
+
+		private:
+			void _M_Skip() {
+				while(_M_iter != _M_end && !_M_query->_M_Match(*_M_iter)) {
+					++_M_iter;
+				}
+			}
+
+			_Query const* _M_query;
+			typename value_list_type::const_iterator _M_iter;
+			typename value_list_type::const_iterator _M_end;
+		};
+
+		_Query(Container const* __container) : _M_container(__container), _M_given_count(0), _M_driver(nullptr),
+				_M_driver_index(sizeof...(_Tags)), _M_empty(false) {
+			for(auto& given : _M_given) {
+				given = false;
+			}
+		}
+
+		/// Returns the query narrowed to the elements whose tag at _Index is __tag. Queries are returned by
+		/// value so that a chain can be iterated directly by a range-for loop.
+		template<std::size_t _Index>
+		_Query Tag(typename std::tuple_element<_Index, tag_type>::type::key_type const& __tag) const {
+			_Query ret(*this);
+			auto const& tag_storage = std::get<_Index>(_M_container->_M_tag_storage);
+			auto bucket = tag_storage.find(__tag);
+			if(bucket == tag_storage.end() || (_M_given[_Index] && std::get<_Index>(_M_major) != bucket)) {
+				ret._M_empty = true;
+				return ret;
+			}
+			ret._M_given_count += _M_given[_Index] ? 0 : 1;
+			ret._M_given[_Index] = true;
+			std::get<_Index>(ret._M_major) = bucket;
+			if(!_M_driver || (*bucket).second.size() < _M_driver->size()) {
+				ret._M_driver = &(*bucket).second;
+				ret._M_driver_index = _Index;
+			}
+			return ret;
+		}
+
+		const_iterator begin() const {
+			auto const& bucket = _M_Driver();
+			return const_iterator(this, bucket.begin(), bucket.end());
+		}
+
+		const_iterator end() const {
+			auto const& bucket = _M_Driver();
+			return const_iterator(this, bucket.end(), bucket.end());
+		}
+
+		/// Number of matching elements, found by iterating.
+		std::size_t Count() const {
+			return static_cast<std::size_t>(std::distance(begin(), end()));
+		}
+
+	private:
+		value_list_type const& _M_Driver() const {
+			static const value_list_type empty{};
+			if(_M_empty) {
+				return empty;
+			}
+			if(!_M_driver) {
+				throw std::logic_error("bul::common::Container<...>::_Query::begin() : No tag given.");
+			}
+			return *_M_driver;
+		}
+
+		/// The driving tag matches already, the other given tags are compared by bucket.
+		bool _M_Match(value_type const& __value) const {
+			if(_M_given_count < 2) {
+				return true;
+			}
+			auto iter = _M_container->_M_locator_storage.find(__value);
+			return _M_Match_Tags<0>((*iter).second, std::integral_constant<bool, (sizeof...(_Tags) > 0)>());
+		}
+
+		template<std::size_t _Index>
+		bool _M_Match_Tags(locator const& __locator, std::true_type) const {
+			if(_M_given[_Index] && _Index != _M_driver_index &&
+					typename std::tuple_element<_Index, _major_type>::type(std::get<_Index>(__locator._tag_major)) !=
+							std::get<_Index>(_M_major)) {
+				return false;
+			}
+			return _M_Match_Tags<_Index + 1>(__locator, std::integral_constant<bool, (_Index + 1 < sizeof...(_Tags))>());
+		}
+
+		template<std::size_t _Index>
+		bool _M_Match_Tags(locator const& __locator, std::false_type) const {
+			return true;
+		}
+
+		Container const* _M_container;
+		_major_type _M_major;
+		bool _M_given[sizeof...(_Tags) > 0 ? sizeof...(_Tags) : 1];
+		std::size_t _M_given_count;
+		value_list_type const* _M_driver;
+		std::size_t _M_driver_index;
+		bool _M_empty;
+	};
+
+	typedef _Query query_type;
+
+	/// Starts a query, narrow it down with Tag<I>(...) then iterate it.
+	query_type Query() const {
+		return query_type(this);
+	}
+
+	/// Defines the type of a batch entry: the keys then the tags of one element.
+	typedef std::tuple<_Keys..., _Tags...> entry_type;
+
 	/// Inserts an element.
 	void Insert(value_type const& __value, _Keys const&... __keys, _Tags const&... __tags) {
-		if(CountValue(__value)) {
+		auto ret = _M_locator_storage.insert(std::pair<value_type, locator>(__value, locator()));
+		if(!ret.second) {
 			throw std::logic_error("bul::common::Container<...>::Insert(...) : Value already exists.");
 		}
-		locator& locator = _M_locator_storage[__value];
+		locator& locator = (*ret.first).second;
 
-		_M_Insert_Keys<0, _Keys...>(locator, __value, __keys...);
+		try {
+			_M_Insert_Keys<0, _Keys...>(locator, __value, __keys...);
+		} catch(...) {
+			_M_locator_storage.erase(ret.first);
+			throw;
+		}
 		_M_Insert_Tags<0, _Tags...>(locator, __value, __tags...);
 	}
 
+	/// Inserts the elements of a forward range, __entry(value) returns their entry_type.
+	/// Hash maps are reserved once up front. If an element cannot be inserted, the ones before it stay inserted.
+	template<typename _Iter, typename _Entry>
+	void InsertBatch(_Iter __first, _Iter __last, _Entry const& __entry) {
+		Reserve(static_cast<std::size_t>(std::distance(__first, __last)));
+		typename _Make_Index_Sequence<sizeof...(_Keys) + sizeof...(_Tags)>::type indices;
+		for(; __first != __last; ++__first) {
+			_M_Insert_Entry(*__first, __entry(*__first), indices);
+		}
+	}
+
+	/// Erases the elements of a range, each locator is looked up once and each bucket is visited once.
+	/// Duplicates are erased once.
+	/// Throws before erasing anything if an element does not exist.
+	template<typename _Iter>
+	void EraseBatch(_Iter __first, _Iter __last) {
+		std::vector<value_type> batch(__first, __last);
+		std::sort(batch.begin(), batch.end());
+		batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
+
+		std::vector<typename locator_type::iterator> batch_locator;
+		batch_locator.reserve(batch.size());
+		for(auto const& value : batch) {
+			auto iter = _M_locator_storage.find(value);
+			if(iter == _M_locator_storage.end()) {
+				throw std::out_of_range("bul::common::Container<...>::EraseBatch(...) : Value does not exist.");
+			}
+			batch_locator.push_back(iter);
+		}
+		std::vector<locator*> locators;
+		locators.reserve(batch_locator.size());
+		for(auto iter : batch_locator) {
+			locators.push_back(&(*iter).second);
+		}
+		_Erase_Tag_Batch_Helper<sizeof...(_Tags), locator, tag_type> erase_tag_helper;
+		erase_tag_helper(_M_tag_storage, locators);
+		for(auto iter : batch_locator) {
+			_Erase_Key_Helper<sizeof...(_Keys), locator, key_type> erase_key_helper;
+			erase_key_helper(_M_key_storage, (*iter).second);
+			_M_locator_storage.erase(iter);
+		}
+	}
+
+	/// Erases every element carrying a tag and drops its bucket in one go, returns the number of elements erased.
+	template<std::size_t _Index>
+	std::size_t ClearTag(typename std::tuple_element<_Index, tag_type>::type::key_type const& __tag) {
+		auto& tag_storage = std::get<_Index>(_M_tag_storage);
+		auto bucket = tag_storage.find(__tag);
+		if(bucket == tag_storage.end()) {
+			return 0;
+		}
+		std::size_t count = (*bucket).second.size();
+		for(auto const& value : (*bucket).second) {
+			_M_Erase(_M_locator_storage.find(value), _Index);
+		}
+		tag_storage.erase(bucket);
+		return count;
+	}
+
 	/// Erases elements by key or tag or value.
 	template<std::size_t _Index>
 	void EraseByKey(typename std::tuple_element<_Index, key_type>::type::key_type const& __key) {
-		if(!CountKey<_Index>(__key)) {
+		auto& key_storage = std::get<_Index>(_M_key_storage);
+		auto iter = key_storage.find(__key);
+		if(iter == key_storage.end()) {
 			throw std::out_of_range("bul::common::Container<...>::EraseByKey(...) : Key does not exist.");
 		}
-		_M_EraseByValue(GetByKey<_Index>(__key));
+		_M_Erase(_M_locator_storage.find((*iter).second), sizeof...(_Tags));
 	}
 
 	template<std::size_t _Index>
@@ -128,20 +894,15 @@ public:
 		if(!CountTag<_Index>(__tag)) {
 			throw std::out_of_range("bul::common::Container<...>::EraseByTag(...) : Tag does not exist.");
 		}
-		auto const& list = GetByTag<_Index>(__tag);
-		auto iter_end = list.end();
-		for(auto iter = list.begin(); iter != iter_end;) {
-			auto tmp = iter;
-			iter++;
-			_M_EraseByValue(*tmp);
-		}
+		ClearTag<_Index>(__tag);
 	}
 
 	void EraseByValue(value_type const& __value) {
-		if(!CountValue(__value)) {
+		auto iter = _M_locator_storage.find(__value);
+		if(iter == _M_locator_storage.end()) {
 			throw std::out_of_range("bul::common::Container<...>::EraseByValue(...) : Value does not exist.");
 		}
-		_M_EraseByValue(__value);
+		_M_Erase(iter, sizeof...(_Tags));
 	}
 
 	/// Provides read-only access to elements by key or tag.
@@ -201,21 +962,56 @@ public:
 		return _M_locator_storage.count(__value);
 	}
 
+	/// Returns the number of elements.
+	std::size_t Size() const {
+		return _M_locator_storage.size();
+	}
+
+	/// Makes room for __count more elements in the maps which can reserve (hash maps), ordered maps ignore it.
+	void Reserve(std::size_t __count) {
+		_S_Reserve(_M_locator_storage, Size() + __count, 0);
+		_M_Reserve_Keys<0>(Size() + __count, std::integral_constant<bool, (sizeof...(_Keys) > 0)>());
+	}
+
 protected:
+	/// Reserves if the map has reserve(...).
+	template<typename _Map>
+	static auto _S_Reserve(_Map & __map, std::size_t __size, int) -> decltype(__map.reserve(__size), void()) {
+		__map.reserve(__size);
+	}
+
+	template<typename _Map>
+	static void _S_Reserve(_Map & __map, std::size_t __size, long) { }
+
+	template<std::size_t _Index>
+	void _M_Reserve_Keys(std::size_t __size, std::true_type) {
+		_S_Reserve(std::get<_Index>(_M_key_storage), __size, 0);
+		_M_Reserve_Keys<_Index + 1>(__size, std::integral_constant<bool, (_Index + 1 < sizeof...(_Keys))>());
+	}
+
+	template<std::size_t _Index>
+	void _M_Reserve_Keys(std::size_t __size, std::false_type) { }
+
 	/// Inersts the keys part of elements.
 	template<std::size_t _Index>
 	void _M_Insert_Keys(locator & __locator, value_type const& __value) { }
 
+	/// A key which already exists rolls back the keys inserted before it.
 	template<std::size_t _Index, typename _Head, typename... _Tail>
 	void _M_Insert_Keys(locator & __locator, value_type const& __value,
 			_Head const& __head, _Tail const&... __tail) {
-		if(std::get<_Index>(_M_key_storage).count(__head)) {
+		auto ret = std::get<_Index>(_M_key_storage).insert(std::pair<_Head, value_type>(__head, __value));
+		if(!ret.second) {
 			throw std::out_of_range("bul::common::Container<...>::Insert(...) : Key already exists.");
 		}
-		auto ret = std::get<_Index>(_M_key_storage).insert(std::pair<_Head, value_type>(__head, __value));
 		std::get<_Index>(__locator._key) = ret.first;
 
-		_M_Insert_Keys<_Index + 1, _Tail...>(__locator, __value, __tail...);
+		try {
+			_M_Insert_Keys<_Index + 1, _Tail...>(__locator, __value, __tail...);
+		} catch(...) {
+			std::get<_Index>(_M_key_storage).erase(ret.first);
+			throw;
+		}
 	}
 
 	/// Inserts the tags part of elements.
@@ -225,21 +1021,27 @@ protected:
 	template<std::size_t _Index, typename _Head, typename... _Tail>
 	void _M_Insert_Tags(locator & __locator, value_type const& __value,
 			_Head const& __head, _Tail const&... __tail) {
-		std::get<_Index>(_M_tag_storage)[__head].push_back(__value);
-		auto major_ret = std::get<_Index>(_M_tag_storage).find(__head);
-		std::get<_Index>(__locator._tag_major) = major_ret;
-		std::get<_Index>(__locator._tag_minor) = --std::get<_Index>(_M_tag_storage)[__head].end();
+		auto ret = std::get<_Index>(_M_tag_storage).emplace(std::piecewise_construct, std::forward_as_tuple(__head),
+				std::forward_as_tuple());
+		ret.first->second.Push(__value, &std::get<_Index>(__locator._tag_minor));
+		std::get<_Index>(__locator._tag_major) = ret.first;
 
 		_M_Insert_Tags<_Index + 1, _Tail...>(__locator, __value, __tail...);
 	}
 
-	/// Erases elements by value.
-	void _M_EraseByValue(value_type const& __value) {
+	/// Inserts one element of a batch.
+	template<std::size_t... _Indices>
+	void _M_Insert_Entry(value_type const& __value, entry_type const& __entry, _Index_Sequence<_Indices...>) {
+		Insert(__value, std::get<_Indices>(__entry)...);
+	}
+
+	/// Erases the element __iter locates, leaving the tag at index __skip alone.
+	void _M_Erase(typename locator_type::iterator __iter, std::size_t __skip) {
 		_Erase_Key_Helper<sizeof...(_Keys), locator, key_type> erase_key_helper;
-		erase_key_helper(_M_key_storage, _M_locator_storage[__value]);
+		erase_key_helper(_M_key_storage, (*__iter).second);
 		_Erase_Tag_Helper<sizeof...(_Tags), locator, tag_type> erase_tag_helper;
-		erase_tag_helper(_M_tag_storage, _M_locator_storage[__value]);
-		_M_locator_storage.erase(__value);
+		erase_tag_helper(_M_tag_storage, (*__iter).second, __skip);
+		_M_locator_storage.erase(__iter);
 	}
 
 private:
@@ -5,9 +5,16 @@
 #ifndef _BUL_COMMON_DATAPOOL_H
 #define _BUL_COMMON_DATAPOOL_H
 
+#include <cstdint>
+#include <cstring>
+
 #include <type_traits>
 #include <stdexcept>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <tuple>
 #include <vector>
 
 namespace bul {
@@ -37,6 +44,8 @@ struct _DataPool_Base<_T1, _T2, _T3, false> {
 };
 
 /// A data pool which offers fixed time access to elements in any order.
+/// A pool bound to an epoch counter is double-buffered, see SetEpoch(...).
+/// A pool may record which slots were written, see TrackDirty(...).
 template<typename _T1, typename _T2, typename _T3, bool _U>
 class DataPool final : protected _DataPool_Base<_T1, _T2, _T3, _U> {
 	typedef typename _DataPool_Base<_T1, _T2, _T3, _U>::_node_type node_type;
@@ -45,10 +54,61 @@ class DataPool final : protected _DataPool_Base<_T1, _T2, _T3, _U> {
 	typedef _T2 data_type_2;
 	typedef _T3 data_type_3;
 
+	/// Stamp of a pool which was not written since it was (re)bound.
+	static const std::uint64_t _S_never = ~0ull >> 1;
+
 public:
-	DataPool() { }
+	/// Called when a clean pool becomes dirty.
+	typedef void (*dirty_callback_type)(void*);
+
+	DataPool() : _M_direct(nullptr), _M_size(0), _M_epoch(nullptr), _M_state(_S_never << 1),
+			_M_tracking(false), _M_dirty_any(false), _M_dirty_callback(nullptr), _M_dirty_context(nullptr) { }
 	~DataPool() { }
 
+	/// Copies hold the committed values, are not double-buffered and do not track writes.
+	DataPool(DataPool const& __other) : _M_direct(nullptr), _M_size(0), _M_epoch(nullptr), _M_state(_S_never << 1),
+			_M_tracking(false), _M_dirty_any(false), _M_dirty_callback(nullptr), _M_dirty_context(nullptr) {
+		_M_Copy(__other);
+	}
+
+	/// The target keeps its dirty tracking and callback, and is made dirty if it tracks writes.
+	DataPool& operator=(DataPool const& __other) {
+		if(this != &__other) {
+			_M_epoch = nullptr;
+			_M_state.store(_S_never << 1, std::memory_order_relaxed);
+			_M_Copy(__other);
+			if(_M_tracking) {
+				_M_dirty.assign(_S_Dirty_Words(_M_size), 0);
+				_M_Mark_Pool();
+			}
+		}
+		return *this;
+	}
+
+	/// Binds the pool to an epoch counter, nullptr unbinds it; the committed values are kept.
+	/// While *__epoch is odd (a step is running) Get(...) reads the values committed when it became odd and
+	/// Set(...) writes to a back buffer, so readers on other threads never see a write of the same step.
+	/// When it moves on to even, the writes are committed; this costs nothing per pool: the first write of
+	/// a step copies the committed buffer into the other one and stamps the pool with the epoch, and a pool
+	/// stamped with an older epoch reads the buffer it wrote last. While *__epoch is even, writes go in place.
+	/// Only one thread may write a pool during a step.
+	void SetEpoch(std::uint64_t const* __epoch) {
+		if(__epoch == _M_epoch) {
+			return;
+		}
+		std::vector<node_type> pool(__epoch ? _M_size * 2 : _M_size);
+		node_type const* committed = _M_Read_Data();
+		std::copy(committed, committed + _M_size, pool.begin());
+		_M_pool.swap(pool);
+		_M_epoch = __epoch;
+		_M_state.store(_S_never << 1, std::memory_order_relaxed);
+		_M_Update_Direct();
+	}
+
+	bool IsDoubleBuffered() const {
+		return _M_epoch != nullptr;
+	}
+
 	/// Provides read-only access to the data contained in the pool.
 	template<typename _Tp>
 	_Tp const& Get(std::size_t __index) const {
@@ -56,9 +116,9 @@ public:
 				std::is_same<_Tp, data_type_2>::value ||
 				std::is_same<_Tp, data_type_3>::value, "undefined data type for DataPool::Get(...).");
 		if(__index >= Size()) {
-			throw std::out_of_range("bul::common::DataPool<...>::Get(...)");
+			_S_Out_Of_Range("bul::common::DataPool<...>::Get(...)");
 		}
-		return Get_Helper(__index, static_cast<_Tp*>(nullptr));
+		return Get_Helper(_M_Read_Data(), __index, static_cast<_Tp*>(nullptr));
 	}
 
 	/// Provides write access to the data contained in the pool.
@@ -68,27 +128,97 @@ public:
 				std::is_same<_Tp, data_type_2>::value ||
 				std::is_same<_Tp, data_type_3>::value, "undefined data type for DataPool::Set(...).");
 		if(__index >= Size()) {
-			throw std::out_of_range("bul::common::DataPool<...>::Set(...)");
+			_S_Out_Of_Range("bul::common::DataPool<...>::Set(...)");
+		}
+		Set_Helper(_M_Write_Data(), __index, __value);
+		if(__builtin_expect(_M_tracking, 0)) {
+			_M_Mark_Dirty(__index);
+		}
+	}
+
+	/// Starts or stops recording which slots Set(...) writes; starting and stopping both leave the pool clean.
+	/// Writes through Data() are not recorded.
+	void TrackDirty(bool __track) {
+		_M_tracking = __track;
+		_M_dirty_any = false;
+		if(__track) {
+			_M_dirty.assign(_S_Dirty_Words(_M_size), 0);
+		} else {
+			std::vector<std::uint64_t>().swap(_M_dirty);
+		}
+	}
+
+	bool IsTrackingDirty() const {
+		return _M_tracking;
+	}
+
+	/// Whether a slot was written, or the pool resized, since the last ClearDirty().
+	bool IsDirty() const {
+		return _M_dirty_any;
+	}
+
+	/// Calls __func(index) for every slot written since the last ClearDirty(), in increasing order. Visits
+	/// 64 slots per word of the bitset, so a clean stretch of the pool costs little.
+	template<typename _Func>
+	void ForEachDirty(_Func const& __func) const {
+		if(!_M_dirty_any) {
+			return;
+		}
+		for(std::size_t w = 0; w < _M_dirty.size(); w++) {
+			std::uint64_t bits = _M_dirty[w];
+			while(bits != 0) {
+				__func(w * 64 + static_cast<std::size_t>(__builtin_ctzll(bits)));
+				bits &= bits - 1;
+			}
+		}
+	}
+
+	/// Marks every slot clean.
+	void ClearDirty() {
+		if(_M_dirty_any) {
+			std::fill(_M_dirty.begin(), _M_dirty.end(), 0);
+			_M_dirty_any = false;
 		}
-		Set_Helper(__index, __value);
+	}
+
+	/// Sets the function called with __context whenever the pool goes from clean to dirty, on the thread
+	/// which wrote it; nullptr removes it.
+	void SetDirtyCallback(dirty_callback_type __callback, void* __context) {
+		_M_dirty_callback = __callback;
+		_M_dirty_context = __context;
 	}
 
 	/// Returns the number of elements in the pool.
 	std::size_t Size() const {
-		return _M_pool.size();
+		return _M_size;
 	}
 
-	/// Resizes the pool to the specified number of elements.
+	/// Resizes the pool to the specified number of elements. A pool tracking writes becomes dirty, the new
+	/// slots are not marked.
 	void Resize(std::size_t __size) {
 		if (__size > _M_pool.max_size()) {
 			throw std::length_error("bul::common::DataPool<...>::Resize(...)");
 		}
-		_M_pool.resize(__size);
+		if(_M_tracking) {
+			_M_Resize_Dirty(__size);
+		}
+		if(!_M_epoch) {
+			_M_pool.resize(__size);
+			_M_size = __size;
+			_M_Update_Direct();
+			return;
+		}
+		std::vector<node_type> pool(__size * 2);
+		node_type const* committed = _M_Read_Data();
+		std::copy(committed, committed + std::min(__size, _M_size), pool.begin());
+		_M_pool.swap(pool);
+		_M_size = __size;
+		_M_state.store(_S_never << 1, std::memory_order_relaxed);
 	}
 
 	/// Returns the total number of elements that the pool can hold before needing to allocate more memory.
 	std::size_t Capacity() const {
-		return _M_pool.capacity();
+		return _M_epoch ? _M_pool.capacity() / 2 : _M_pool.capacity();
 	}
 
 	/// Attempt to preallocate enough memory for specified number of elements.
@@ -96,37 +226,377 @@ public:
 		if (__size > _M_pool.max_size()) {
 			throw std::length_error("bul::common::DataPool<...>::Reserve(...)");
 		}
-		_M_pool.reserve(__size);
+		_M_pool.reserve(_M_epoch ? __size * 2 : __size);
+		_M_Update_Direct();
+	}
+
+	/// Raw view of the committed elements (Size() * ElementSize() bytes), used for serialization.
+	void const* Data() const {
+		return _M_Read_Data();
+	}
+
+	void* Data() {
+		return const_cast<node_type*>(_M_Read_Data());
+	}
+
+	/// Returns the number of bytes of one element.
+	static constexpr std::size_t ElementSize() {
+		return sizeof(node_type);
 	}
 
 protected:
 	/// Overloaded helper functions for DataPool::Get(...).
-	data_type_1 const& Get_Helper(std::size_t __index,
-			const data_type_1* const __func_specifier) const {
-		return _M_pool[__index].v_1;
+	static data_type_1 const& Get_Helper(node_type const* __data, std::size_t __index,
+			const data_type_1* const __func_specifier) {
+		return __data[__index].v_1;
 	}
-	data_type_2 const& Get_Helper(std::size_t __index,
-			const data_type_2* const __func_specifier) const {
-		return _M_pool[__index].v_2;
+	static data_type_2 const& Get_Helper(node_type const* __data, std::size_t __index,
+			const data_type_2* const __func_specifier) {
+		return __data[__index].v_2;
 	}
-	data_type_3 const& Get_Helper(std::size_t __index,
-			const data_type_3* const __func_specifier) const {
-		return _M_pool[__index].v_3;
+	static data_type_3 const& Get_Helper(node_type const* __data, std::size_t __index,
+			const data_type_3* const __func_specifier) {
+		return __data[__index].v_3;
 	}
 
 	/// Overloaded helper functions for DataPool::Set(...).
-	void Set_Helper(std::size_t __index, data_type_1 const& __value) {
-		_M_pool[__index].v_1 = __value;
+	static void Set_Helper(node_type* __data, std::size_t __index, data_type_1 const& __value) {
+		__data[__index].v_1 = __value;
+	}
+	static void Set_Helper(node_type* __data, std::size_t __index, data_type_2 const& __value) {
+		__data[__index].v_2 = __value;
+	}
+	static void Set_Helper(node_type* __data, std::size_t __index, data_type_3 const& __value) {
+		__data[__index].v_3 = __value;
+	}
+
+	/// Kept out of Get(...) and Set(...) so that they stay small enough to be inlined.
+	static void _S_Out_Of_Range(char const* __what) {
+		throw std::out_of_range(__what);
+	}
+
+	/// The committed buffer: the one written last, unless it was written in the current step.
+	node_type const* _M_Read_Data() const {
+		if(__builtin_expect(_M_direct != nullptr, 1)) {
+			return _M_direct;
+		}
+		return _M_Read_Buffered();
 	}
-	void Set_Helper(std::size_t __index, data_type_2 const& __value) {
-		_M_pool[__index].v_2 = __value;
+
+	node_type const* _M_Read_Buffered() const {
+		if(!_M_epoch) {
+			return _M_pool.data();
+		}
+		std::uint64_t state = _M_state.load(std::memory_order_acquire);
+		std::size_t buffer = (state >> 1) == *_M_epoch ? 1 - (state & 1) : (state & 1);
+		return _M_pool.data() + buffer * _M_size;
 	}
-	void Set_Helper(std::size_t __index, data_type_3 const& __value) {
-		_M_pool[__index].v_3 = __value;
+
+	/// The buffer taking the writes, prepared by the first write of a step.
+	node_type* _M_Write_Data() {
+		if(__builtin_expect(_M_direct != nullptr, 1)) {
+			return _M_direct;
+		}
+		return _M_Write_Buffered();
+	}
+
+	node_type* _M_Write_Buffered() {
+		if(!_M_epoch) {
+			return _M_pool.data();
+		}
+		std::uint64_t const epoch = *_M_epoch;
+		std::uint64_t state = _M_state.load(std::memory_order_relaxed);
+		std::size_t buffer = state & 1;
+		if((epoch & 1) != 0 && (state >> 1) != epoch) {
+			std::size_t back = 1 - buffer;
+			std::copy(_M_pool.data() + buffer * _M_size, _M_pool.data() + (buffer + 1) * _M_size,
+					_M_pool.data() + back * _M_size);
+			_M_state.store(epoch << 1 | back, std::memory_order_release);
+			buffer = back;
+		}
+		return _M_pool.data() + buffer * _M_size;
+	}
+
+	void _M_Copy(DataPool const& __other) {
+		node_type const* committed = __other._M_Read_Data();
+		_M_pool.assign(committed, committed + __other._M_size);
+		_M_size = __other._M_size;
+		_M_Update_Direct();
+	}
+
+	/// Single-buffered pools are accessed without looking at the epoch.
+	void _M_Update_Direct() {
+		_M_direct = _M_epoch ? nullptr : _M_pool.data();
+	}
+
+	void _M_Mark_Dirty(std::size_t __index) {
+		_M_dirty[__index >> 6] |= std::uint64_t(1) << (__index & 63);
+		_M_Mark_Pool();
+	}
+
+	void _M_Mark_Pool() {
+		if(!_M_dirty_any) {
+			_M_dirty_any = true;
+			if(_M_dirty_callback) {
+				_M_dirty_callback(_M_dirty_context);
+			}
+		}
+	}
+
+	/// Drops the bits of the slots cut off, so that ForEachDirty(...) stays within the pool.
+	void _M_Resize_Dirty(std::size_t __size) {
+		_M_dirty.resize(_S_Dirty_Words(__size), 0);
+		if(__size < _M_size && (__size & 63) != 0) {
+			_M_dirty.back() &= (std::uint64_t(1) << (__size & 63)) - 1;
+		}
+		_M_Mark_Pool();
+	}
+
+	static std::size_t _S_Dirty_Words(std::size_t __size) {
+		return (__size + 63) / 64;
 	}
 
 private:
+	node_type* _M_direct;
 	std::vector<node_type> _M_pool;
+	std::size_t _M_size;
+
+	/// The epoch counter, and the stamp (epoch << 1) and buffer of the last write of a step.
+	std::uint64_t const* _M_epoch;
+	std::atomic<std::uint64_t> _M_state;
+
+	/// One bit per slot written since the last ClearDirty(), and whether any was, or the pool resized.
+	bool _M_tracking;
+	bool _M_dirty_any;
+	std::vector<std::uint64_t> _M_dirty;
+	dirty_callback_type _M_dirty_callback;
+	void* _M_dirty_context;
+};
+
+template<typename _T1, typename _T2, typename _T3, bool _U>
+const std::uint64_t DataPool<_T1, _T2, _T3, _U>::_S_never;
+
+/// A named slot holding _Count consecutive values of type _Tp, e.g. struct Position : Slot<float, 3> { };
+template<typename _Tp, std::size_t _Count = 1>
+struct Slot {
+	typedef _Tp value_type;
+	static constexpr std::size_t count = _Count;
+};
+
+/// A compile-time list of slots.
+template<typename... _Slots>
+struct Schema;
+
+/// A list of types.
+template<typename... _Types>
+struct _Type_List;
+
+/// Whether _Tp is one of _Types.
+template<typename _Tp, typename... _Types>
+struct _Contains : std::false_type { };
+
+template<typename _Tp, typename _Head, typename... _Tail>
+struct _Contains<_Tp, _Head, _Tail...> : std::integral_constant<bool,
+		std::is_same<_Tp, _Head>::value || _Contains<_Tp, _Tail...>::value> { };
+
+/// Sum of the arguments.
+constexpr std::size_t _Sum() {
+	return 0;
+}
+
+template<typename... _Tail>
+constexpr std::size_t _Sum(std::size_t __head, _Tail... __tail) {
+	return __head + _Sum(__tail...);
+}
+
+/// Whether every argument holds.
+constexpr bool _All() {
+	return true;
+}
+
+template<typename... _Tail>
+constexpr bool _All(bool __head, _Tail... __tail) {
+	return __head && _All(__tail...);
+}
+
+/// Appends _Tp to a type list unless it is already there.
+template<typename _List, typename _Tp>
+struct _Append_Unique;
+
+template<typename _Tp, typename... _Types>
+struct _Append_Unique<_Type_List<_Types...>, _Tp> {
+	typedef typename std::conditional<_Contains<_Tp, _Types...>::value,
+			_Type_List<_Types...>, _Type_List<_Types..., _Tp>>::type type;
+};
+
+/// Distinct value types of a schema, in order of first appearance.
+template<typename _List, typename... _Slots>
+struct _Schema_Types {
+	typedef _List type;
+};
+
+template<typename _List, typename _Head, typename... _Tail>
+struct _Schema_Types<_List, _Head, _Tail...> {
+	typedef typename _Schema_Types<typename _Append_Unique<_List, typename _Head::value_type>::type, _Tail...>::type type;
+};
+
+/// Total number of values of type _Tp in the slots.
+template<typename _Tp, typename... _Slots>
+struct _Schema_Count : std::integral_constant<std::size_t, 0> { };
+
+template<typename _Tp, typename _Head, typename... _Tail>
+struct _Schema_Count<_Tp, _Head, _Tail...> : std::integral_constant<std::size_t,
+		(std::is_same<typename _Head::value_type, _Tp>::value ? _Head::count : 0) + _Schema_Count<_Tp, _Tail...>::value> { };
+
+/// Offset of _Slot in the array of its value type.
+template<typename _Slot, typename... _Slots>
+struct _Schema_Offset;
+
+template<typename _Slot, typename... _Tail>
+struct _Schema_Offset<_Slot, _Slot, _Tail...> : std::integral_constant<std::size_t, 0> { };
+
+template<typename _Slot, typename _Head, typename... _Tail>
+struct _Schema_Offset<_Slot, _Head, _Tail...> : std::integral_constant<std::size_t,
+		(std::is_same<typename _Head::value_type, typename _Slot::value_type>::value ? _Head::count : 0)
+				+ _Schema_Offset<_Slot, _Tail...>::value> { };
+
+/// Index of _Tp in a type list.
+template<typename _Tp, typename _List>
+struct _Type_Index_Of;
+
+template<typename _Tp, typename... _Tail>
+struct _Type_Index_Of<_Tp, _Type_List<_Tp, _Tail...>> : std::integral_constant<std::size_t, 0> { };
+
+template<typename _Tp, typename _Head, typename... _Tail>
+struct _Type_Index_Of<_Tp, _Type_List<_Head, _Tail...>> : std::integral_constant<std::size_t,
+		1 + _Type_Index_Of<_Tp, _Type_List<_Tail...>>::value> { };
+
+/// Base of SoADataPool, lays out one fixed-size array per distinct value type.
+template<typename _Schema, typename _Types>
+struct _SoADataPool_Base;
+
+template<typename... _Slots, typename... _Types>
+struct _SoADataPool_Base<Schema<_Slots...>, _Type_List<_Types...>> {
+	typedef _Type_List<_Types...> _types;
+	typedef std::tuple<std::array<_Types, _Schema_Count<_Types, _Slots...>::value>...> _storage_type;
+
+	static constexpr bool _S_Trivial() {
+		return _All(std::is_trivially_copyable<_Types>::value...);
+	}
+
+	static constexpr std::size_t _S_Bytes() {
+		return _Sum(sizeof(_Types) * _Schema_Count<_Types, _Slots...>::value...);
+	}
+
+	/// Copies the arrays to __bytes one after the other, in the order of _Types.
+	static void _S_Save(_storage_type const& __storage, char* __bytes) {
+		int unroll[] = { 0, (std::memcpy(__bytes, std::get<_Type_Index_Of<_Types, _types>::value>(__storage).data(),
+				sizeof(_Types) * _Schema_Count<_Types, _Slots...>::value),
+				__bytes += sizeof(_Types) * _Schema_Count<_Types, _Slots...>::value, 0)... };
+		(void)unroll;
+	}
+
+	static void _S_Load(_storage_type& __storage, const char* __bytes) {
+		int unroll[] = { 0, (std::memcpy(std::get<_Type_Index_Of<_Types, _types>::value>(__storage).data(), __bytes,
+				sizeof(_Types) * _Schema_Count<_Types, _Slots...>::value),
+				__bytes += sizeof(_Types) * _Schema_Count<_Types, _Slots...>::value, 0)... };
+		(void)unroll;
+	}
+};
+
+/// A structure-of-arrays data pool whose slots are fixed by a schema; accessors are resolved at compile time.
+template<typename _Schema>
+class SoADataPool;
+
+template<typename... _Slots>
+class SoADataPool<Schema<_Slots...>> final :
+		protected _SoADataPool_Base<Schema<_Slots...>, typename _Schema_Types<_Type_List<>, _Slots...>::type> {
+	typedef _SoADataPool_Base<Schema<_Slots...>, typename _Schema_Types<_Type_List<>, _Slots...>::type> _Base;
+	typedef typename _Base::_types types;
+	typedef typename _Base::_storage_type storage_type;
+
+	template<typename _Slot>
+	using _array_type = typename std::tuple_element<_Type_Index_Of<typename _Slot::value_type, types>::value, storage_type>::type;
+
+public:
+	SoADataPool() : _M_storage() { }
+	~SoADataPool() { }
+
+	/// Position of a slot in the array of its value type.
+	template<typename _Slot>
+	static constexpr std::size_t Offset() {
+		return _Schema_Offset<_Slot, _Slots...>::value;
+	}
+
+	/// Number of values of type _Tp in the pool.
+	template<typename _Tp>
+	static constexpr std::size_t Count() {
+		return _Schema_Count<_Tp, _Slots...>::value;
+	}
+
+	/// Provides read-only access to the _Index-th value of a slot.
+	template<typename _Slot, std::size_t _Index = 0>
+	typename _Slot::value_type const& Get() const noexcept {
+		static_assert(_Contains<_Slot, _Slots...>::value, "undefined slot for SoADataPool::Get(...).");
+		static_assert(_Index < _Slot::count, "slot index out of range for SoADataPool::Get(...).");
+		return std::get<_Type_Index_Of<typename _Slot::value_type, types>::value>(_M_storage)[Offset<_Slot>() + _Index];
+	}
+
+	/// Unchecked access to the __index-th value of a slot, the caller keeps __index below _Slot::count.
+	template<typename _Slot>
+	typename _Slot::value_type const& Get(std::size_t __index) const noexcept {
+		static_assert(_Contains<_Slot, _Slots...>::value, "undefined slot for SoADataPool::Get(...).");
+		return std::get<_Type_Index_Of<typename _Slot::value_type, types>::value>(_M_storage)[Offset<_Slot>() + __index];
+	}
+
+	/// Provides write access to the _Index-th value of a slot.
+	template<typename _Slot, std::size_t _Index = 0>
+	void Set(typename _Slot::value_type const& __value) noexcept {
+		static_assert(_Contains<_Slot, _Slots...>::value, "undefined slot for SoADataPool::Set(...).");
+		static_assert(_Index < _Slot::count, "slot index out of range for SoADataPool::Set(...).");
+		std::get<_Type_Index_Of<typename _Slot::value_type, types>::value>(_M_storage)[Offset<_Slot>() + _Index] = __value;
+	}
+
+	/// Unchecked write to the __index-th value of a slot.
+	template<typename _Slot>
+	void Set(std::size_t __index, typename _Slot::value_type const& __value) noexcept {
+		static_assert(_Contains<_Slot, _Slots...>::value, "undefined slot for SoADataPool::Set(...).");
+		std::get<_Type_Index_Of<typename _Slot::value_type, types>::value>(_M_storage)[Offset<_Slot>() + __index] = __value;
+	}
+
+	/// Dense array holding every value of type _Tp.
+	template<typename _Tp>
+	_Tp* Data() noexcept {
+		return std::get<_Type_Index_Of<_Tp, types>::value>(_M_storage).data();
+	}
+
+	template<typename _Tp>
+	_Tp const* Data() const noexcept {
+		return std::get<_Type_Index_Of<_Tp, types>::value>(_M_storage).data();
+	}
+
+	/// Whether the values can be copied as raw bytes, and how many bytes they take.
+	static constexpr bool IsTriviallyCopyable() {
+		return _Base::_S_Trivial();
+	}
+
+	static constexpr std::size_t Bytes() {
+		return _Base::_S_Bytes();
+	}
+
+	/// Copies every value to Bytes() bytes at __bytes, or back from them. Needs IsTriviallyCopyable().
+	void Save(char* __bytes) const noexcept {
+		static_assert(IsTriviallyCopyable(), "SoADataPool::Save(...) needs trivially copyable values.");
+		_Base::_S_Save(_M_storage, __bytes);
+	}
+
+	void Load(const char* __bytes) noexcept {
+		static_assert(IsTriviallyCopyable(), "SoADataPool::Load(...) needs trivially copyable values.");
+		_Base::_S_Load(_M_storage, __bytes);
+	}
+
+private:
+	storage_type _M_storage;
 };
 
 } /* namespace common */
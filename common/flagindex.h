@@ -0,0 +1,198 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_COMMON_FLAGINDEX_H
+#define _BUL_COMMON_FLAGINDEX_H
+
+#include <cstdint>
+
+#include <vector>
+
+namespace bul {
+namespace common {
+/// A bitmap with a summary level: bit w of the summary tells whether word w has any bit set, so
+/// walking a sparse bitmap skips 4096 clear bits per summary word.
+class _Two_Level_Bitmap {
+public:
+	void Set(std::size_t __bit) {
+		std::size_t word = __bit >> 6;
+		if(word >= _M_word.size()) {
+			_M_word.resize(word + 1, 0);
+			_M_summary.resize((word >> 6) + 1, 0);
+		}
+		_M_word[word] |= 1ull << (__bit & 63);
+		_M_summary[word >> 6] |= 1ull << (word & 63);
+	}
+
+	void Reset(std::size_t __bit) {
+		std::size_t word = __bit >> 6;
+		if(word >= _M_word.size()) {
+			return;
+		}
+		_M_word[word] &= ~(1ull << (__bit & 63));
+		if(_M_word[word] == 0) {
+			_M_summary[word >> 6] &= ~(1ull << (word & 63));
+		}
+	}
+
+	bool Test(std::size_t __bit) const {
+		std::size_t word = __bit >> 6;
+		return word < _M_word.size() && (_M_word[word] >> (__bit & 63) & 1) != 0;
+	}
+
+	void Clear() {
+		_M_word.clear();
+		_M_summary.clear();
+	}
+
+	std::uint64_t const* Words() const {
+		return _M_word.data();
+	}
+
+	std::uint64_t const* Summary() const {
+		return _M_summary.data();
+	}
+
+	std::size_t WordCount() const {
+		return _M_word.size();
+	}
+
+	std::size_t SummaryCount() const {
+		return _M_summary.size();
+	}
+
+private:
+	std::vector<std::uint64_t> _M_word;
+	std::vector<std::uint64_t> _M_summary;
+};
+
+/// Indexes 32-bit flag sets by slot: one two-level bitmap per flag bit, plus a dense flag column which
+/// holds the flags of each slot and can be scanned directly. Slots are small integers chosen by the caller.
+class FlagIndex final {
+public:
+	static const unsigned int Bits = 32;
+
+	/// Starts indexing __slot with __flags.
+	void Insert(std::uint32_t __slot, std::uint32_t __flags) {
+		if(__slot >= _M_column.size()) {
+			_M_column.resize(__slot + 1, 0);
+		}
+		_M_live.Set(__slot);
+		_M_column[__slot] = 0;
+		Set(__slot, __flags);
+	}
+
+	/// Stops indexing __slot.
+	void Erase(std::uint32_t __slot) {
+		if(!_M_live.Test(__slot)) {
+			return;
+		}
+		Set(__slot, 0);
+		_M_live.Reset(__slot);
+	}
+
+	/// Updates the flags of an indexed slot, only the bitmaps of the bits which changed are touched.
+	void Set(std::uint32_t __slot, std::uint32_t __flags) {
+		if(!_M_live.Test(__slot)) {
+			return;
+		}
+		std::uint32_t changed = _M_column[__slot] ^ __flags;
+		_M_column[__slot] = __flags;
+		while(changed != 0) {
+			unsigned int bit = _S_Lowest(changed);
+			changed &= changed - 1;
+			if(__flags >> bit & 1) {
+				_M_bitmap[bit].Set(__slot);
+			} else {
+				_M_bitmap[bit].Reset(__slot);
+			}
+		}
+	}
+
+	std::uint32_t Get(std::uint32_t __slot) const {
+		return __slot < _M_column.size() ? _M_column[__slot] : 0;
+	}
+
+	bool Contains(std::uint32_t __slot) const {
+		return _M_live.Test(__slot);
+	}
+
+	/// Calls __func(slot) for every indexed slot having all the bits of __mask (every slot if __mask is 0),
+	/// in increasing slot order. The cost follows the number of candidate words, not the number of slots.
+	template<typename _Func>
+	void ForEach(std::uint32_t __mask, _Func const& __func) const {
+		_Two_Level_Bitmap const* bitmap[Bits];
+		std::size_t count = 0;
+		std::size_t summaries = _M_live.SummaryCount();
+		for(std::uint32_t mask = __mask; mask != 0; mask &= mask - 1) {
+			bitmap[count] = &_M_bitmap[_S_Lowest(mask)];
+			summaries = bitmap[count]->SummaryCount() < summaries ? bitmap[count]->SummaryCount() : summaries;
+			count++;
+		}
+		if(count == 0) {
+			bitmap[count++] = &_M_live;
+		}
+
+		for(std::size_t s = 0; s < summaries; s++) {
+			std::uint64_t candidate = bitmap[0]->Summary()[s];
+			for(std::size_t b = 1; b < count && candidate != 0; b++) {
+				candidate &= bitmap[b]->Summary()[s];
+			}
+			for(; candidate != 0; candidate &= candidate - 1) {
+				std::size_t w = (s << 6) + _S_Lowest64(candidate);
+				std::uint64_t word = bitmap[0]->Words()[w];
+				for(std::size_t b = 1; b < count; b++) {
+					word &= bitmap[b]->Words()[w];
+				}
+				for(; word != 0; word &= word - 1) {
+					__func(static_cast<std::uint32_t>((w << 6) + _S_Lowest64(word)));
+				}
+			}
+		}
+	}
+
+	/// Number of indexed slots having all the bits of __mask.
+	std::size_t Count(std::uint32_t __mask) const {
+		std::size_t count = 0;
+		ForEach(__mask, [&count](std::uint32_t) {
+			count++;
+		});
+		return count;
+	}
+
+	/// The flag column, Column()[slot] for slot < ColumnSize(); erased slots read 0.
+	std::uint32_t const* Column() const {
+		return _M_column.data();
+	}
+
+	std::size_t ColumnSize() const {
+		return _M_column.size();
+	}
+
+	void Clear() {
+		_M_live.Clear();
+		for(auto& bitmap : _M_bitmap) {
+			bitmap.Clear();
+		}
+		_M_column.clear();
+	}
+
+private:
+	static unsigned int _S_Lowest(std::uint32_t __x) {
+		return static_cast<unsigned int>(__builtin_ctz(__x));
+	}
+
+	static unsigned int _S_Lowest64(std::uint64_t __x) {
+		return static_cast<unsigned int>(__builtin_ctzll(__x));
+	}
+
+	_Two_Level_Bitmap _M_live;
+	_Two_Level_Bitmap _M_bitmap[Bits];
+	std::vector<std::uint32_t> _M_column;
+};
+
+} /* namespace common */
+} /* namespace bul */
+
+#endif /* _BUL_COMMON_FLAGINDEX_H */
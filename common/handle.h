@@ -0,0 +1,161 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_COMMON_HANDLE_H
+#define _BUL_COMMON_HANDLE_H
+
+#include <stdexcept>
+#include <cstdint>
+
+#include <functional>
+#include <vector>
+
+namespace bul {
+namespace common {
+/// Refers to an element of a HandleTable, the generation tells a live element from one which was erased.
+struct Handle {
+	std::uint32_t Index = 0;
+	/// 0 is never issued, so a default constructed handle refers to nothing.
+	std::uint32_t Generation = 0;
+
+	Handle() { }
+	Handle(std::uint32_t __index, std::uint32_t __generation) : Index(__index), Generation(__generation) { }
+
+	bool IsNull() const {
+		return Generation == 0;
+	}
+
+	bool operator==(Handle const& __other) const {
+		return Index == __other.Index && Generation == __other.Generation;
+	}
+
+	bool operator!=(Handle const& __other) const {
+		return !(*this == __other);
+	}
+
+	bool operator<(Handle const& __other) const {
+		return Index != __other.Index ? Index < __other.Index : Generation < __other.Generation;
+	}
+};
+
+/// A sparse set of pointers addressed by handles: lookups are two array reads, erasing is O(1) and
+/// bumps the generation of the slot so that old handles stop resolving. The live pointers are kept dense.
+template<typename _Tp>
+class HandleTable final {
+	/// Sparse entry, __dense is the position in the dense arrays or the next free slot.
+	struct _Slot {
+		std::uint32_t generation;
+		std::uint32_t dense;
+	};
+
+	static const std::uint32_t _S_none = UINT32_MAX;
+
+public:
+	HandleTable() : _M_free(_S_none) { }
+
+	/// Stores a pointer and returns its handle.
+	Handle Insert(_Tp* __value) {
+		std::uint32_t index;
+		if(_M_free != _S_none) {
+			index = _M_free;
+			_M_free = _M_sparse[index].dense;
+		} else {
+			if(_M_sparse.size() >= _S_none) {
+				throw std::length_error("bul::common::HandleTable<...>::Insert(...) : too many handles.");
+			}
+			index = static_cast<std::uint32_t>(_M_sparse.size());
+			_M_sparse.push_back(_Slot { 1, 0 });
+		}
+		_M_sparse[index].dense = static_cast<std::uint32_t>(_M_value.size());
+		_M_value.push_back(__value);
+		_M_owner.push_back(index);
+		return Handle(index, _M_sparse[index].generation);
+	}
+
+	/// Removes the pointer of a handle, returns false if the handle is stale.
+	bool Erase(Handle const& __handle) {
+		if(!Contains(__handle)) {
+			return false;
+		}
+		_Slot& slot = _M_sparse[__handle.Index];
+		std::uint32_t dense = slot.dense;
+		std::uint32_t last = static_cast<std::uint32_t>(_M_value.size() - 1);
+		if(dense != last) {
+			_M_value[dense] = _M_value[last];
+			_M_owner[dense] = _M_owner[last];
+			_M_sparse[_M_owner[dense]].dense = dense;
+		}
+		_M_value.pop_back();
+		_M_owner.pop_back();
+
+		slot.generation = slot.generation + 1 == 0 ? 1 : slot.generation + 1;
+		slot.dense = _M_free;
+		_M_free = __handle.Index;
+		return true;
+	}
+
+	/// Returns the pointer of a handle, or nullptr if the handle is stale.
+	_Tp* Get(Handle const& __handle) const {
+		return Contains(__handle) ? _M_value[_M_sparse[__handle.Index].dense] : nullptr;
+	}
+
+	/// Returns the pointer in slot __index, which must be live (the index of a handle which resolves).
+	_Tp* At(std::uint32_t __index) const {
+		return _M_value[_M_sparse[__index].dense];
+	}
+
+	bool Contains(Handle const& __handle) const {
+		return __handle.Index < _M_sparse.size() && _M_sparse[__handle.Index].generation == __handle.Generation &&
+				__handle.Generation != 0;
+	}
+
+	/// Makes room for __count more pointers.
+	void Reserve(std::size_t __count) {
+		_M_value.reserve(_M_value.size() + __count);
+		_M_owner.reserve(_M_owner.size() + __count);
+	}
+
+	/// Removes everything, handles issued so far stop resolving.
+	void Clear() {
+		while(!_M_owner.empty()) {
+			std::uint32_t index = _M_owner.back();
+			Erase(Handle(index, _M_sparse[index].generation));
+		}
+	}
+
+	/// The live pointers, in no particular order.
+	_Tp* const* Data() const {
+		return _M_value.data();
+	}
+
+	std::size_t Size() const {
+		return _M_value.size();
+	}
+
+private:
+	std::vector<_Slot> _M_sparse;
+	std::vector<_Tp*> _M_value;
+	std::vector<std::uint32_t> _M_owner;
+	std::uint32_t _M_free;
+};
+
+template<typename _Tp>
+const std::uint32_t HandleTable<_Tp>::_S_none;
+
+} /* namespace common */
+} /* namespace bul */
+
+namespace std {
+/// Specialization for std::hash<Handle>.
+template<>
+struct hash<bul::common::Handle> {
+	size_t operator()(bul::common::Handle const& __handle) const noexcept {
+		return static_cast<size_t>((static_cast<std::uint64_t>(__handle.Generation) << 32 | __handle.Index) *
+				0x9e3779b97f4a7c15ull);
+	}
+};
+
+} /* namespace std */
+
+#endif /* _BUL_COMMON_HANDLE_H */
@@ -0,0 +1,73 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_COMMON_MAPPEDFILE_H
+#define _BUL_COMMON_MAPPEDFILE_H
+
+#include <stdexcept>
+#include <cstddef>
+
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bul {
+namespace common {
+/// A read-only memory mapping of a whole file.
+class MappedFile final {
+public:
+	MappedFile(std::string const& __path) {
+		_M_data = nullptr;
+		_M_size = 0;
+
+		int fd = ::open(__path.c_str(), O_RDONLY);
+		if(fd < 0) {
+			throw std::runtime_error("bul::common::MappedFile::MappedFile(...) : cannot open '" + __path + "'.");
+		}
+		struct stat st;
+		if(::fstat(fd, &st) != 0) {
+			::close(fd);
+			throw std::runtime_error("bul::common::MappedFile::MappedFile(...) : cannot stat '" + __path + "'.");
+		}
+		_M_size = static_cast<std::size_t>(st.st_size);
+		if(_M_size > 0) {
+			void* data = ::mmap(nullptr, _M_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(data == MAP_FAILED) {
+				::close(fd);
+				throw std::runtime_error("bul::common::MappedFile::MappedFile(...) : cannot map '" + __path + "'.");
+			}
+			_M_data = static_cast<const char*>(data);
+		}
+		::close(fd);
+	}
+	~MappedFile() {
+		if(_M_data != nullptr) {
+			::munmap(const_cast<char*>(_M_data), _M_size);
+		}
+	}
+
+	MappedFile(MappedFile const&) = delete;
+	MappedFile& operator=(MappedFile const&) = delete;
+
+	/// Getters.
+	const char* Data() const {
+		return _M_data;
+	}
+
+	std::size_t Size() const {
+		return _M_size;
+	}
+
+private:
+	const char* _M_data;
+	std::size_t _M_size;
+};
+
+} /* namespace common */
+} /* namespace bul */
+
+#endif /* _BUL_COMMON_MAPPEDFILE_H */
@@ -0,0 +1,317 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_COMMON_PROFILER_H
+#define _BUL_COMMON_PROFILER_H
+
+#include <typeindex>
+#include <typeinfo>
+#include <cstdint>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bul {
+namespace common {
+/// Phases of a simulation step.
+enum class Profile_Phase {
+	PreStep,
+	Actors,
+	Triggers,
+	PostStep,
+	Monitors
+};
+
+static const std::size_t _S_profile_phase_count = 5;
+
+/// A histogram of durations in power-of-two nanosecond buckets.
+struct Histogram {
+	static const std::size_t Buckets = 48;
+
+	std::uint64_t Count = 0;
+	std::uint64_t Total = 0;
+	std::uint64_t Max = 0;
+	std::uint64_t Bucket[Buckets] = { };
+
+	void Add(std::uint64_t __ns) {
+		Count++;
+		Total += __ns;
+		Max = __ns > Max ? __ns : Max;
+		std::size_t bucket = 0;
+		while(bucket + 1 < Buckets && (std::uint64_t(1) << (bucket + 1)) <= __ns) {
+			bucket++;
+		}
+		Bucket[bucket]++;
+	}
+
+	void Merge(Histogram const& __other) {
+		Count += __other.Count;
+		Total += __other.Total;
+		Max = __other.Max > Max ? __other.Max : Max;
+		for(std::size_t i = 0; i < Buckets; i++) {
+			Bucket[i] += __other.Bucket[i];
+		}
+	}
+
+	/// Upper bound (in ns) of the bucket holding the __q quantile, __q in [0, 1].
+	std::uint64_t Quantile(double __q) const {
+		std::uint64_t rank = static_cast<std::uint64_t>(__q * Count);
+		std::uint64_t seen = 0;
+		for(std::size_t i = 0; i < Buckets; i++) {
+			seen += Bucket[i];
+			if(seen > rank) {
+				return std::uint64_t(1) << (i + 1);
+			}
+		}
+		return Max;
+	}
+};
+
+/// A named histogram in a profiling report.
+struct ProfileEntry {
+	std::string Name;
+	Histogram Time;
+};
+
+/// A node in a profiling report, by what it is rather than where it lives: a node allocated where a removed one
+/// was must not take over its record.
+struct _Profile_Node_Key {
+	_Profile_Node_Key(const char* __kind, std::size_t __id, std::type_info const& __type) :
+			Kind(__kind), Id(__id), Type(__type) { }
+
+	bool operator==(_Profile_Node_Key const& __other) const {
+		return Id == __other.Id && Type == __other.Type && Kind == __other.Kind;
+	}
+
+	std::string Kind;
+	std::size_t Id;
+	std::type_index Type;
+};
+
+struct _Profile_Node_Hash {
+	std::size_t operator()(_Profile_Node_Key const& __key) const {
+		std::size_t seed = std::hash<std::string>()(__key.Kind);
+		seed ^= std::hash<std::size_t>()(__key.Id) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+		seed ^= __key.Type.hash_code() + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+		return seed;
+	}
+};
+
+/// Per-thread records, merged when a report is made.
+struct _Profile_Buffer {
+	Histogram Phase[_S_profile_phase_count];
+	std::unordered_map<_Profile_Node_Key, Histogram, _Profile_Node_Hash> Node;
+	std::unordered_map<std::type_index, Histogram> ComponentType;
+	std::unordered_map<std::size_t, Histogram> Priority;
+
+	void Clear() {
+		for(auto& phase : Phase) {
+			phase = Histogram();
+		}
+		Node.clear();
+		ComponentType.clear();
+		Priority.clear();
+	}
+};
+
+/// Collects step timings from every thread. Reports and resets must not overlap a running step.
+class Profiler final {
+public:
+	typedef std::chrono::steady_clock clock_type;
+
+	/// The process-wide profiler.
+	static Profiler& Instance() {
+		static Profiler profiler;
+		return profiler;
+	}
+
+	static std::uint64_t Now() {
+		return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				clock_type::now().time_since_epoch()).count());
+	}
+
+	/// Record the duration of a phase.
+	void RecordPhase(Profile_Phase __phase, std::uint64_t __ns) {
+		_M_Buffer().Phase[static_cast<std::size_t>(__phase)].Add(__ns);
+	}
+
+	/// Record the duration of one call of a node (actor, trigger, monitor...). Calls are grouped by kind, Id and
+	/// type, so a node removed and added again with the same Id goes on with the same record. Monitors have no
+	/// Id (0), their calls are grouped by type.
+	void RecordNode(const char* __kind, std::size_t __id, std::type_info const& __type, std::uint64_t __ns) {
+		_M_Buffer().Node[_Profile_Node_Key(__kind, __id, __type)].Add(__ns);
+	}
+
+	/// Record the duration of one call of a component.
+	void RecordComponent(std::type_info const& __type, std::size_t __priority, std::uint64_t __ns) {
+		auto& buffer = _M_Buffer();
+		buffer.ComponentType[std::type_index(__type)].Add(__ns);
+		buffer.Priority[__priority].Add(__ns);
+	}
+
+	/// Forget everything recorded so far.
+	void Reset() {
+		std::lock_guard<std::mutex> lock(_M_mutex);
+		for(auto& buffer : _M_buffer) {
+			buffer->Clear();
+		}
+	}
+
+	/// Merged phase histogram.
+	Histogram Phase(Profile_Phase __phase) const {
+		std::lock_guard<std::mutex> lock(_M_mutex);
+		Histogram histogram;
+		for(auto& buffer : _M_buffer) {
+			histogram.Merge(buffer->Phase[static_cast<std::size_t>(__phase)]);
+		}
+		return histogram;
+	}
+
+	/// The __n nodes / component types / priorities which took the most time in total.
+	std::vector<ProfileEntry> TopNodes(std::size_t __n) const {
+		std::lock_guard<std::mutex> lock(_M_mutex);
+		std::unordered_map<_Profile_Node_Key, ProfileEntry, _Profile_Node_Hash> merged;
+		for(auto& buffer : _M_buffer) {
+			for(auto& node : buffer->Node) {
+				auto& entry = merged[node.first];
+				if(entry.Name.empty()) {
+					entry.Name = node.first.Kind + " #" + std::to_string(node.first.Id) + " (" + node.first.Type.name() + ")";
+				}
+				entry.Time.Merge(node.second);
+			}
+		}
+		return _S_Top(merged, __n);
+	}
+
+	std::vector<ProfileEntry> TopComponentTypes(std::size_t __n) const {
+		std::lock_guard<std::mutex> lock(_M_mutex);
+		std::unordered_map<std::type_index, ProfileEntry> merged;
+		for(auto& buffer : _M_buffer) {
+			for(auto& type : buffer->ComponentType) {
+				auto& entry = merged[type.first];
+				entry.Name = type.first.name();
+				entry.Time.Merge(type.second);
+			}
+		}
+		return _S_Top(merged, __n);
+	}
+
+	std::vector<ProfileEntry> TopPriorities(std::size_t __n) const {
+		std::lock_guard<std::mutex> lock(_M_mutex);
+		std::unordered_map<std::size_t, ProfileEntry> merged;
+		for(auto& buffer : _M_buffer) {
+			for(auto& priority : buffer->Priority) {
+				auto& entry = merged[priority.first];
+				entry.Name = "priority " + std::to_string(priority.first);
+				entry.Time.Merge(priority.second);
+			}
+		}
+		return _S_Top(merged, __n);
+	}
+
+protected:
+	Profiler() { }
+
+	/// The calling thread's buffer, registered on first use.
+	_Profile_Buffer& _M_Buffer() {
+		static thread_local _Profile_Buffer* buffer = nullptr;
+		if(buffer == nullptr) {
+			std::lock_guard<std::mutex> lock(_M_mutex);
+			_M_buffer.push_back(std::unique_ptr<_Profile_Buffer>(new _Profile_Buffer()));
+			buffer = _M_buffer.back().get();
+		}
+		return *buffer;
+	}
+
+	template<typename _Map>
+	static std::vector<ProfileEntry> _S_Top(_Map const& __merged, std::size_t __n) {
+		std::vector<ProfileEntry> top;
+		top.reserve(__merged.size());
+		for(auto& entry : __merged) {
+			top.push_back(entry.second);
+		}
+		std::sort(top.begin(), top.end(), [](ProfileEntry const& __a, ProfileEntry const& __b) {
+			return __a.Time.Total > __b.Time.Total;
+		});
+		if(top.size() > __n) {
+			top.resize(__n);
+		}
+		return top;
+	}
+
+private:
+	mutable std::mutex _M_mutex;
+	std::vector<std::unique_ptr<_Profile_Buffer>> _M_buffer;
+};
+
+/// Times a scope as one phase of a step.
+class _Profile_Phase_Scope {
+public:
+	_Profile_Phase_Scope(Profile_Phase __phase) : _M_phase(__phase), _M_start(Profiler::Now()) { }
+	~_Profile_Phase_Scope() {
+		Profiler::Instance().RecordPhase(_M_phase, Profiler::Now() - _M_start);
+	}
+
+private:
+	Profile_Phase const _M_phase;
+	std::uint64_t const _M_start;
+};
+
+/// Times a scope as one call of a node.
+class _Profile_Node_Scope {
+public:
+	_Profile_Node_Scope(const char* __kind, std::size_t __id, std::type_info const& __type) :
+			_M_kind(__kind), _M_id(__id), _M_type(__type), _M_start(Profiler::Now()) { }
+	~_Profile_Node_Scope() {
+		Profiler::Instance().RecordNode(_M_kind, _M_id, _M_type, Profiler::Now() - _M_start);
+	}
+
+private:
+	const char* const _M_kind;
+	std::size_t const _M_id;
+	std::type_info const& _M_type;
+	std::uint64_t const _M_start;
+};
+
+/// Times a scope as one call of a component.
+class _Profile_Component_Scope {
+public:
+	_Profile_Component_Scope(std::type_info const& __type, std::size_t __priority) :
+			_M_type(__type), _M_priority(__priority), _M_start(Profiler::Now()) { }
+	~_Profile_Component_Scope() {
+		Profiler::Instance().RecordComponent(_M_type, _M_priority, Profiler::Now() - _M_start);
+	}
+
+private:
+	std::type_info const& _M_type;
+	std::size_t const _M_priority;
+	std::uint64_t const _M_start;
+};
+
+} /* namespace common */
+} /* namespace bul */
+
+/// Instrumentation hooks, they compile to nothing unless BUL_PROFILING is defined.
+#ifdef BUL_PROFILING
+#define _BUL_PROFILE_CAT2(a, b) a##b
+#define _BUL_PROFILE_CAT(a, b) _BUL_PROFILE_CAT2(a, b)
+#define BUL_PROFILE_PHASE(__phase) \
+		::bul::common::_Profile_Phase_Scope _BUL_PROFILE_CAT(_bul_profile_, __LINE__)(__phase)
+#define BUL_PROFILE_NODE(__kind, __id, __type) \
+		::bul::common::_Profile_Node_Scope _BUL_PROFILE_CAT(_bul_profile_, __LINE__)(__kind, __id, __type)
+#define BUL_PROFILE_COMPONENT(__type, __priority) \
+		::bul::common::_Profile_Component_Scope _BUL_PROFILE_CAT(_bul_profile_, __LINE__)(__type, __priority)
+#else
+#define BUL_PROFILE_PHASE(__phase) ((void)0)
+#define BUL_PROFILE_NODE(__kind, __id, __type) ((void)0)
+#define BUL_PROFILE_COMPONENT(__type, __priority) ((void)0)
+#endif
+
+#endif /* _BUL_COMMON_PROFILER_H */
@@ -0,0 +1,416 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_COMMON_SMALLMAP_H
+#define _BUL_COMMON_SMALLMAP_H
+
+#include <cstdint>
+#include <cstring>
+
+#include <type_traits>
+#include <stdexcept>
+
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace bul {
+namespace common {
+/// A vector of trivially copyable values keeping its first _N elements inline, it allocates only beyond them.
+template<typename _Tp, std::size_t _N>
+class _Small_Vector {
+	static_assert(_N > 0, "bul::common::_Small_Vector<...> : Inline capacity must not be 0.");
+	static_assert(std::is_trivially_copyable<_Tp>::value,
+			"bul::common::_Small_Vector<...> : Type '_Tp' must be trivially copyable.");
+
+public:
+	_Small_Vector() : _M_data(_M_inline), _M_size(0), _M_capacity(_N) { }
+
+	~_Small_Vector() {
+		if(_M_data != _M_inline) {
+			delete[] _M_data;
+		}
+	}
+
+	_Small_Vector(_Small_Vector const&) = delete;
+	_Small_Vector& operator=(_Small_Vector const&) = delete;
+
+	void reserve(std::size_t __capacity) {
+		if(__capacity <= _M_capacity) {
+			return;
+		}
+		std::size_t capacity = _M_capacity * 2 > __capacity ? _M_capacity * 2 : __capacity;
+		_Tp* data = new _Tp[capacity];
+		std::memcpy(data, _M_data, _M_size * sizeof(_Tp));
+		if(_M_data != _M_inline) {
+			delete[] _M_data;
+		}
+		_M_data = data;
+		_M_capacity = static_cast<std::uint32_t>(capacity);
+	}
+
+	void push_back(_Tp const& __value) {
+		reserve(_M_size + 1);
+		_M_data[_M_size++] = __value;
+	}
+
+	void pop_back() {
+		_M_size--;
+	}
+
+	/// Inserts __value before __index, the following elements move up.
+	void insert(std::size_t __index, _Tp const& __value) {
+		reserve(_M_size + 1);
+		std::memmove(_M_data + __index + 1, _M_data + __index, (_M_size - __index) * sizeof(_Tp));
+		_M_data[__index] = __value;
+		_M_size++;
+	}
+
+	/// Erases the element at __index, the following elements move down.
+	void erase(std::size_t __index) {
+		std::memmove(_M_data + __index, _M_data + __index + 1, (_M_size - __index - 1) * sizeof(_Tp));
+		_M_size--;
+	}
+
+	void clear() {
+		_M_size = 0;
+	}
+
+	_Tp& operator[](std::size_t __index) {
+		return _M_data[__index];
+	}
+
+	_Tp const& operator[](std::size_t __index) const {
+		return _M_data[__index];
+	}
+
+	_Tp const& back() const {
+		return _M_data[_M_size - 1];
+	}
+
+	_Tp const* begin() const {
+		return _M_data;
+	}
+
+	_Tp const* end() const {
+		return _M_data + _M_size;
+	}
+
+	_Tp const* data() const {
+		return _M_data;
+	}
+
+	std::size_t size() const {
+		return _M_size;
+	}
+
+	bool empty() const {
+		return _M_size == 0;
+	}
+
+private:
+	_Tp* _M_data;
+	std::uint32_t _M_size;
+	std::uint32_t _M_capacity;
+	_Tp _M_inline[_N];
+};
+
+/// An ordered map keeping its first _N entries inline, for maps which are many and mostly tiny.
+/// Entries live in slots and never move, so iterators (and references) stay valid until their own entry
+/// is erased, as with std::map. A sorted array of slots gives the key order: lookups scan it linearly
+/// while the map fits inline and search it by halves beyond, insertions and erasures shift it.
+/// Slots past _N are allocated in blocks which are kept until the map is destroyed.
+template<typename _Key, typename _Value, std::size_t _N, typename _Compare = std::less<_Key>>
+class SmallMap final {
+	static_assert(_N > 0, "bul::common::SmallMap<...> : Inline capacity must not be 0.");
+
+public:
+	typedef _Key key_type;
+	typedef _Value mapped_type;
+	typedef std::pair<const _Key, _Value> value_type;
+	typedef std::size_t size_type;
+
+private:
+	typedef typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type _Slot;
+
+	static const std::uint32_t _S_none = 0xffffffffu;
+	static const std::size_t _S_block = _N < 8 ? 8 : _N;
+
+	template<bool _Const>
+	class _Iterator {
+		typedef typename std::conditional<_Const, SmallMap const*, SmallMap*>::type _map_pointer;
+
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef typename SmallMap::value_type value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef typename std::conditional<_Const, value_type const*, value_type*>::type pointer;
+		typedef typename std::conditional<_Const, value_type const&, value_type&>::type reference;
+
+		_Iterator() : _M_map(nullptr), _M_slot(_S_none) { }
+
+		/// A mutable iterator converts to a constant one.
+		template<bool _Other, typename = typename std::enable_if<_Const && !_Other>::type>
+		_Iterator(_Iterator<_Other> const& __other) : _M_map(__other._M_map), _M_slot(__other._M_slot) { }
+
+		reference operator*() const {
+			return *_M_map->_M_At(_M_slot);
+		}
+
+		pointer operator->() const {
+			return _M_map->_M_At(_M_slot);
+		}
+
+		_Iterator& operator++() {
+			std::size_t next = _M_map->_M_rank[_M_slot] + 1;
+			_M_slot = next < _M_map->_M_order.size() ? _M_map->_M_order[next] : _S_none;
+			return *this;
+		}
+
+		_Iterator operator++(int) {
+			_Iterator ret = *this;
+			++*this;
+			return ret;
+		}
+
+		template<bool _Other>
+		bool operator==(_Iterator<_Other> const& __other) const {
+			return _M_slot == __other._M_slot;
+		}
+
+		template<bool _Other>
+		bool operator!=(_Iterator<_Other> const& __other) const {
+			return _M_slot != __other._M_slot;
+		}
+
+	private:
+		template<bool>
+		friend class _Iterator;
+		friend class SmallMap;
+
+		_Iterator(_map_pointer __map, std::uint32_t __slot) : _M_map(__map), _M_slot(__slot) { }
+
+		_map_pointer _M_map;
+		std::uint32_t _M_slot;
+	};
+
+public:
+	typedef _Iterator<false> iterator;
+	typedef _Iterator<true> const_iterator;
+
+	SmallMap() : _M_capacity(_N) {
+		for(std::size_t i = 0; i < _N; i++) {
+			_M_rank.push_back(_S_none);
+		}
+	}
+
+	~SmallMap() {
+		clear();
+	}
+
+	SmallMap(SmallMap const&) = delete;
+	SmallMap& operator=(SmallMap const&) = delete;
+
+	iterator begin() {
+		return iterator(this, _M_order.empty() ? _S_none : _M_order[0]);
+	}
+
+	iterator end() {
+		return iterator(this, _S_none);
+	}
+
+	const_iterator begin() const {
+		return const_iterator(this, _M_order.empty() ? _S_none : _M_order[0]);
+	}
+
+	const_iterator end() const {
+		return const_iterator(this, _S_none);
+	}
+
+	size_type size() const {
+		return _M_order.size();
+	}
+
+	bool empty() const {
+		return _M_order.empty();
+	}
+
+	iterator find(key_type const& __key) {
+		return iterator(this, _M_Find(__key));
+	}
+
+	const_iterator find(key_type const& __key) const {
+		return const_iterator(this, _M_Find(__key));
+	}
+
+	size_type count(key_type const& __key) const {
+		return _M_Find(__key) != _S_none ? 1 : 0;
+	}
+
+	mapped_type& at(key_type const& __key) {
+		std::uint32_t slot = _M_Find(__key);
+		if(slot == _S_none) {
+			throw std::out_of_range("bul::common::SmallMap<...>::at(...) : Key does not exist.");
+		}
+		return _M_At(slot)->second;
+	}
+
+	mapped_type const& at(key_type const& __key) const {
+		std::uint32_t slot = _M_Find(__key);
+		if(slot == _S_none) {
+			throw std::out_of_range("bul::common::SmallMap<...>::at(...) : Key does not exist.");
+		}
+		return _M_At(slot)->second;
+	}
+
+	/// Default-constructs the value in place if the key is new.
+	mapped_type& operator[](key_type const& __key) {
+		return _M_Emplace(__key, std::piecewise_construct, std::forward_as_tuple(__key),
+				std::forward_as_tuple()).first->second;
+	}
+
+	std::pair<iterator, bool> insert(value_type const& __value) {
+		return _M_Emplace(__value.first, __value);
+	}
+
+	/// Piecewise construction, with the key alone in the first tuple; nothing is constructed if the key exists.
+	template<typename _Key_Arg, typename... _Args>
+	std::pair<iterator, bool> emplace(std::piecewise_construct_t, std::tuple<_Key_Arg> __key,
+			std::tuple<_Args...> __args) {
+		return _M_Emplace(std::get<0>(__key), std::piecewise_construct, std::move(__key), std::move(__args));
+	}
+
+	void erase(const_iterator __iter) {
+		std::uint32_t slot = __iter._M_slot;
+		std::size_t rank = _M_rank[slot];
+		_M_At(slot)->~value_type();
+		_M_rank[slot] = _S_none;
+		_M_order.erase(rank);
+		_M_Rerank(rank);
+	}
+
+	size_type erase(key_type const& __key) {
+		std::uint32_t slot = _M_Find(__key);
+		if(slot == _S_none) {
+			return 0;
+		}
+		erase(const_iterator(this, slot));
+		return 1;
+	}
+
+	void clear() {
+		for(std::size_t i = 0; i < _M_order.size(); i++) {
+			_M_At(_M_order[i])->~value_type();
+			_M_rank[_M_order[i]] = _S_none;
+		}
+		_M_order.clear();
+	}
+
+private:
+	value_type* _M_At(std::uint32_t __slot) {
+		_Slot* slot = __slot < _N ? &_M_inline[__slot] : &_M_block[(__slot - _N) / _S_block][(__slot - _N) % _S_block];
+		return reinterpret_cast<value_type*>(slot);
+	}
+
+	value_type const* _M_At(std::uint32_t __slot) const {
+		return const_cast<SmallMap*>(this)->_M_At(__slot);
+	}
+
+	key_type const& _M_Key(std::size_t __rank) const {
+		return _M_At(_M_order[__rank])->first;
+	}
+
+	/// Rank of the first entry whose key is not less than __key.
+	std::size_t _M_Lower_Bound(key_type const& __key) const {
+		std::size_t first = 0;
+		std::size_t count = _M_order.size();
+		if(count <= _N) {
+			while(first < count && _M_compare(_M_Key(first), __key)) {
+				first++;
+			}
+			return first;
+		}
+		while(count > 0) {
+			std::size_t half = count / 2;
+			if(_M_compare(_M_Key(first + half), __key)) {
+				first += half + 1;
+				count -= half + 1;
+			} else {
+				count = half;
+			}
+		}
+		return first;
+	}
+
+	std::uint32_t _M_Find(key_type const& __key) const {
+		std::size_t rank = _M_Lower_Bound(__key);
+		if(rank < _M_order.size() && !_M_compare(__key, _M_Key(rank))) {
+			return _M_order[rank];
+		}
+		return _S_none;
+	}
+
+	/// Constructs an entry from __args unless __key exists already.
+	template<typename... _Args>
+	std::pair<iterator, bool> _M_Emplace(key_type const& __key, _Args&&... __args) {
+		std::size_t rank = _M_Lower_Bound(__key);
+		if(rank < _M_order.size() && !_M_compare(__key, _M_Key(rank))) {
+			return std::make_pair(iterator(this, _M_order[rank]), false);
+		}
+		_M_order.reserve(_M_order.size() + 1);
+		std::uint32_t slot = _M_Free_Slot();
+		::new (static_cast<void*>(_M_At(slot))) value_type(std::forward<_Args>(__args)...);
+		_M_order.insert(rank, slot);
+		_M_Rerank(rank);
+		return std::make_pair(iterator(this, slot), true);
+	}
+
+	/// A slot holding no entry, a new block is added if every slot is taken.
+	std::uint32_t _M_Free_Slot() {
+		if(_M_order.size() == _M_capacity) {
+			_M_block.emplace_back(new _Slot[_S_block]);
+			for(std::size_t i = 0; i < _S_block; i++) {
+				_M_rank.push_back(_S_none);
+			}
+			_M_capacity += _S_block;
+			return static_cast<std::uint32_t>(_M_capacity - _S_block);
+		}
+		std::uint32_t slot = 0;
+		while(_M_rank[slot] != _S_none) {
+			slot++;
+		}
+		return slot;
+	}
+
+	/// Records the ranks of the entries from __rank on, after the order shifted.
+	void _M_Rerank(std::size_t __rank) {
+		for(std::size_t i = __rank; i < _M_order.size(); i++) {
+			_M_rank[_M_order[i]] = static_cast<std::uint32_t>(i);
+		}
+	}
+
+	_Compare _M_compare;
+
+	_Slot _M_inline[_N];
+	std::vector<std::unique_ptr<_Slot[]>> _M_block;
+	std::size_t _M_capacity;
+
+	/// Slots in key order, and the rank of each slot in that order (_S_none if the slot is free).
+	_Small_Vector<std::uint32_t, _N> _M_order;
+	_Small_Vector<std::uint32_t, _N> _M_rank;
+};
+
+template<typename _Key, typename _Value, std::size_t _N, typename _Compare>
+const std::uint32_t SmallMap<_Key, _Value, _N, _Compare>::_S_none;
+
+template<typename _Key, typename _Value, std::size_t _N, typename _Compare>
+const std::size_t SmallMap<_Key, _Value, _N, _Compare>::_S_block;
+
+} /* namespace common */
+} /* namespace bul */
+
+#endif /* _BUL_COMMON_SMALLMAP_H */
@@ -0,0 +1,302 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_COMMON_SPATIALGRID_H
+#define _BUL_COMMON_SPATIALGRID_H
+
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+
+#include <algorithm>
+#include <vector>
+
+namespace bul {
+namespace common {
+/// A uniform grid over 2D or 3D points carrying a value each, rebuilt in bulk: Push(...) the points, then
+/// Build() sorts them by cell with a counting sort, so that the points of a row of cells are contiguous.
+/// The grid spans the bounding box of the points; when it would have many more cells than points, the
+/// cell size is doubled until it does not. Queries are const and may run concurrently.
+template<typename _Tp>
+class SpatialGrid final {
+public:
+	static const std::size_t MaxDimensions = 3;
+
+	/// A query result.
+	struct Hit {
+		_Tp Value;
+		float DistanceSquared;
+	};
+
+	SpatialGrid(std::size_t __dimensions = 2, float __cell_size = 1.0f) {
+		Configure(__dimensions, __cell_size);
+		Clear();
+	}
+
+	/// Set the number of coordinates per point and the preferred cell size, about the usual query radius.
+	void Configure(std::size_t __dimensions, float __cell_size) {
+		if(__dimensions < 2 || __dimensions > MaxDimensions) {
+			throw std::invalid_argument("bul::common::SpatialGrid<...>::Configure(...) : 2 or 3 dimensions only.");
+		}
+		if(!(__cell_size > 0.0f) || !std::isfinite(__cell_size)) {
+			throw std::invalid_argument("bul::common::SpatialGrid<...>::Configure(...) : Illegal cell size.");
+		}
+		_M_dimensions = __dimensions;
+		_M_preferred_cell_size = __cell_size;
+	}
+
+	/// Remove every point, staged or built. Memory is kept for the next build.
+	void Clear() {
+		_M_stage_value.clear();
+		_M_stage_position.clear();
+		_M_value.clear();
+		_M_position.clear();
+		_M_start.assign(1, 0);
+		for(std::size_t d = 0; d < MaxDimensions; d++) {
+			_M_min[d] = 0.0f;
+			_M_cells[d] = 1;
+		}
+		_M_cell_size = _M_preferred_cell_size;
+	}
+
+	/// Stage a point for the next Build(), __position holds one coordinate per dimension. Points with a
+	/// coordinate which is not finite are ignored.
+	void Push(_Tp const& __value, float const* __position) {
+		float position[MaxDimensions] = { 0.0f, 0.0f, 0.0f };
+		for(std::size_t d = 0; d < _M_dimensions; d++) {
+			if(!std::isfinite(__position[d])) {
+				return;
+			}
+			position[d] = __position[d];
+		}
+		_M_stage_value.push_back(__value);
+		_M_stage_position.insert(_M_stage_position.end(), position, position + MaxDimensions);
+	}
+
+	/// Replace the indexed points with the staged ones, in O(points).
+	void Build() {
+		std::size_t const size = _M_stage_value.size();
+		float max[MaxDimensions];
+		for(std::size_t d = 0; d < MaxDimensions; d++) {
+			_M_min[d] = size > 0 ? _M_stage_position[d] : 0.0f;
+			max[d] = _M_min[d];
+		}
+		for(std::size_t i = 1; i < size; i++) {
+			for(std::size_t d = 0; d < _M_dimensions; d++) {
+				float const x = _M_stage_position[i * MaxDimensions + d];
+				_M_min[d] = x < _M_min[d] ? x : _M_min[d];
+				max[d] = x > max[d] ? x : max[d];
+			}
+		}
+
+		/// At most about two cells per point, so that sparse scenes do not allocate huge grids.
+		double const limit = 2.0 * static_cast<double>(size) + 16.0;
+		_M_cell_size = _M_preferred_cell_size;
+		for(;;) {
+			double total = 1.0;
+			for(std::size_t d = 0; d < MaxDimensions; d++) {
+				double const cells = std::floor((static_cast<double>(max[d]) - _M_min[d]) / _M_cell_size) + 1.0;
+				_M_cells[d] = static_cast<std::size_t>(cells < limit ? cells : limit);
+				total *= cells;
+			}
+			if(total <= limit) {
+				break;
+			}
+			_M_cell_size *= 2.0f;
+		}
+
+		std::size_t const cells = _M_cells[0] * _M_cells[1] * _M_cells[2];
+		_M_start.assign(cells + 1, 0);
+		_M_cell.resize(size);
+		for(std::size_t i = 0; i < size; i++) {
+			_M_cell[i] = static_cast<std::uint32_t>(_M_Cell_Of(&_M_stage_position[i * MaxDimensions]));
+			_M_start[_M_cell[i] + 1]++;
+		}
+		for(std::size_t c = 0; c < cells; c++) {
+			_M_start[c + 1] += _M_start[c];
+		}
+
+		_M_value.resize(size);
+		_M_position.resize(size * MaxDimensions);
+		_M_cursor.assign(_M_start.begin(), _M_start.end() - 1);
+		for(std::size_t i = 0; i < size; i++) {
+			std::size_t const slot = _M_cursor[_M_cell[i]]++;
+			_M_value[slot] = _M_stage_value[i];
+			std::copy(&_M_stage_position[i * MaxDimensions], &_M_stage_position[i * MaxDimensions] + MaxDimensions,
+					&_M_position[slot * MaxDimensions]);
+		}
+		_M_stage_value.clear();
+		_M_stage_position.clear();
+	}
+
+	/// Number of indexed points.
+	std::size_t Size() const {
+		return _M_value.size();
+	}
+
+	/// The cell size of the last Build(), at least the configured one.
+	float GetCellSize() const {
+		return _M_cell_size;
+	}
+
+	std::size_t GetDimensions() const {
+		return _M_dimensions;
+	}
+
+	/// Calls __func(value, distance squared) for every point within __radius of __center, cell by cell.
+	template<typename _Func>
+	void ForEachInRadius(float const* __center, float __radius, _Func const& __func) const {
+		if(_M_value.empty() || !(__radius >= 0.0f)) {
+			return;
+		}
+		float center[MaxDimensions] = { 0.0f, 0.0f, 0.0f };
+		std::size_t lo[MaxDimensions];
+		std::size_t hi[MaxDimensions];
+		for(std::size_t d = 0; d < MaxDimensions; d++) {
+			center[d] = d < _M_dimensions ? __center[d] : 0.0f;
+			double const first = std::floor((static_cast<double>(center[d]) - __radius - _M_min[d]) / _M_cell_size);
+			double const last = std::floor((static_cast<double>(center[d]) + __radius - _M_min[d]) / _M_cell_size);
+			if(last < 0.0 || first >= static_cast<double>(_M_cells[d])) {
+				return;
+			}
+			lo[d] = first < 0.0 ? 0 : static_cast<std::size_t>(first);
+			hi[d] = last >= static_cast<double>(_M_cells[d]) ? _M_cells[d] - 1 : static_cast<std::size_t>(last);
+		}
+
+		float const radius_squared = __radius * __radius;
+		for(std::size_t z = lo[2]; z <= hi[2]; z++) {
+			for(std::size_t y = lo[1]; y <= hi[1]; y++) {
+				std::size_t const row = (z * _M_cells[1] + y) * _M_cells[0];
+				_M_Scan(center, _M_start[row + lo[0]], _M_start[row + hi[0] + 1], [&](std::size_t __i, float __d2) {
+					if(__d2 <= radius_squared) {
+						__func(_M_value[__i], __d2);
+					}
+				});
+			}
+		}
+	}
+
+	/// Appends the values of the points within __radius of __center to __out.
+	void QueryRadius(float const* __center, float __radius, std::vector<_Tp>& __out) const {
+		ForEachInRadius(__center, __radius, [&__out](_Tp const& __value, float) {
+			__out.push_back(__value);
+		});
+	}
+
+	/// Replaces the content of __out with the __k points nearest to __center, nearest first. Rings of cells
+	/// are visited outwards from the cell of __center until no unvisited point can be nearer.
+	void QueryNearest(float const* __center, std::size_t __k, std::vector<Hit>& __out) const {
+		__out.clear();
+		if(_M_value.empty() || __k == 0) {
+			return;
+		}
+		float center[MaxDimensions] = { 0.0f, 0.0f, 0.0f };
+		long cell[MaxDimensions];
+		long rings = 0;
+		for(std::size_t d = 0; d < MaxDimensions; d++) {
+			center[d] = d < _M_dimensions ? __center[d] : 0.0f;
+			cell[d] = _M_Clamp(center[d], d);
+			long const cells = static_cast<long>(_M_cells[d]);
+			rings = std::max(rings, std::max(cell[d], cells - 1 - cell[d]));
+		}
+
+		auto const nearer = [](Hit const& __a, Hit const& __b) {
+			return __a.DistanceSquared < __b.DistanceSquared;
+		};
+		auto const keep = [&](std::size_t __i, float __d2) {
+			if(__out.size() < __k) {
+				__out.push_back(Hit { _M_value[__i], __d2 });
+				std::push_heap(__out.begin(), __out.end(), nearer);
+			} else if(__d2 < __out.front().DistanceSquared) {
+				std::pop_heap(__out.begin(), __out.end(), nearer);
+				__out.back() = Hit { _M_value[__i], __d2 };
+				std::push_heap(__out.begin(), __out.end(), nearer);
+			}
+		};
+
+		for(long ring = 0; ring <= rings; ring++) {
+			long lo[MaxDimensions];
+			long hi[MaxDimensions];
+			for(std::size_t d = 0; d < MaxDimensions; d++) {
+				lo[d] = std::max(cell[d] - ring, 0l);
+				hi[d] = std::min(cell[d] + ring, static_cast<long>(_M_cells[d]) - 1);
+			}
+			for(long z = lo[2]; z <= hi[2]; z++) {
+				for(long y = lo[1]; y <= hi[1]; y++) {
+					std::size_t const row = (static_cast<std::size_t>(z) * _M_cells[1] + y) * _M_cells[0];
+					if(std::labs(z - cell[2]) == ring || std::labs(y - cell[1]) == ring) {
+						_M_Scan(center, _M_start[row + lo[0]], _M_start[row + hi[0] + 1], keep);
+						continue;
+					}
+					if(cell[0] - ring >= 0) {
+						_M_Scan(center, _M_start[row + cell[0] - ring], _M_start[row + cell[0] - ring + 1], keep);
+					}
+					if(cell[0] + ring < static_cast<long>(_M_cells[0])) {
+						_M_Scan(center, _M_start[row + cell[0] + ring], _M_start[row + cell[0] + ring + 1], keep);
+					}
+				}
+			}
+			/// Cells beyond this ring are at least ring cells away.
+			float const reach = ring * _M_cell_size;
+			if(__out.size() == __k && __out.front().DistanceSquared <= reach * reach) {
+				break;
+			}
+		}
+		std::sort_heap(__out.begin(), __out.end(), nearer);
+	}
+
+private:
+	/// The cell of a coordinate along __d, clamped to the grid.
+	long _M_Clamp(float __x, std::size_t __d) const {
+		double const cell = std::floor((static_cast<double>(__x) - _M_min[__d]) / _M_cell_size);
+		if(cell < 0.0) {
+			return 0;
+		}
+		return cell >= static_cast<double>(_M_cells[__d]) ? static_cast<long>(_M_cells[__d]) - 1 : static_cast<long>(cell);
+	}
+
+	std::size_t _M_Cell_Of(float const* __position) const {
+		return (static_cast<std::size_t>(_M_Clamp(__position[2], 2)) * _M_cells[1] +
+				static_cast<std::size_t>(_M_Clamp(__position[1], 1))) * _M_cells[0] +
+				static_cast<std::size_t>(_M_Clamp(__position[0], 0));
+	}
+
+	/// Calls __func(index, distance squared) for the points in [__begin, __end).
+	template<typename _Func>
+	void _M_Scan(float const* __center, std::size_t __begin, std::size_t __end, _Func const& __func) const {
+		float const* position = _M_position.data() + __begin * MaxDimensions;
+		for(std::size_t i = __begin; i < __end; i++, position += MaxDimensions) {
+			float const dx = position[0] - __center[0];
+			float const dy = position[1] - __center[1];
+			float const dz = position[2] - __center[2];
+			__func(i, dx * dx + dy * dy + dz * dz);
+		}
+	}
+
+	std::size_t _M_dimensions;
+	float _M_preferred_cell_size;
+	float _M_cell_size;
+	float _M_min[MaxDimensions];
+	std::size_t _M_cells[MaxDimensions];
+
+	/// Points staged for the next build.
+	std::vector<_Tp> _M_stage_value;
+	std::vector<float> _M_stage_position;
+	std::vector<std::uint32_t> _M_cell;
+	std::vector<std::size_t> _M_cursor;
+
+	/// Indexed points sorted by cell, the points of cell c are [_M_start[c], _M_start[c + 1]).
+	std::vector<_Tp> _M_value;
+	std::vector<float> _M_position;
+	std::vector<std::size_t> _M_start;
+};
+
+template<typename _Tp>
+const std::size_t SpatialGrid<_Tp>::MaxDimensions;
+
+} /* namespace common */
+} /* namespace bul */
+
+#endif /* _BUL_COMMON_SPATIALGRID_H */
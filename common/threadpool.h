@@ -0,0 +1,279 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_COMMON_THREADPOOL_H
+#define _BUL_COMMON_THREADPOOL_H
+
+#include <stdexcept>
+#include <exception>
+#include <atomic>
+#include <cstdint>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <vector>
+
+namespace bul {
+namespace common {
+/// Range of chunks owned by a worker, packed as (begin << 32 | end) so that it can be claimed with a single CAS.
+struct _Worker_Range {
+	std::atomic<std::uint64_t> range;
+	char _padding[64 - sizeof(std::atomic<std::uint64_t>)];
+
+	static std::uint64_t Pack(std::uint32_t __begin, std::uint32_t __end) {
+		return (static_cast<std::uint64_t>(__begin) << 32) | __end;
+	}
+
+	static std::uint32_t Begin(std::uint64_t __range) {
+		return static_cast<std::uint32_t>(__range >> 32);
+	}
+
+	static std::uint32_t End(std::uint64_t __range) {
+		return static_cast<std::uint32_t>(__range);
+	}
+};
+
+/// A fork-join pool with work stealing, the calling thread always takes part as worker 0.
+class ThreadPool final {
+	typedef void (*_task_type)(void*, std::size_t, std::size_t);
+
+public:
+	ThreadPool(std::size_t __threads) : _M_size(__threads == 0 ? 1 : __threads),
+			_M_range(new _Worker_Range[__threads == 0 ? 1 : __threads]) {
+		_M_generation = 0;
+		_M_remaining = 0;
+		_M_stop = false;
+		_M_task = nullptr;
+		_M_context = nullptr;
+		_M_begin = _M_end = _M_chunk = 0;
+		for(std::size_t i = 0; i < _M_size; i++) {
+			_M_range[i].range.store(0);
+		}
+		for(std::size_t i = 1; i < _M_size; i++) {
+			_M_thread.push_back(std::thread(&ThreadPool::_M_Loop, this, i));
+		}
+	}
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(_M_mutex);
+			_M_stop = true;
+		}
+		_M_wake.notify_all();
+		for(auto& thread : _M_thread) {
+			thread.join();
+		}
+	}
+
+	ThreadPool(ThreadPool const&) = delete;
+	ThreadPool& operator=(ThreadPool const&) = delete;
+
+	/// Returns the number of workers, including the calling thread.
+	std::size_t Size() const {
+		return _M_size;
+	}
+
+	/// Returns the index of the worker running the current thread (0 outside of the pool).
+	static std::size_t CurrentWorker() {
+		return _S_Worker_Id().index;
+	}
+
+	/// Returns the index of the current thread in this pool: the background threads of the pool have their
+	/// own, any other thread is worker 0, as the caller of ParallelFor(...) is. Unlike CurrentWorker(), a
+	/// thread of another pool (e.g. one stepping a whole scene) never gets an index of that pool here.
+	std::size_t Worker() const {
+		_Worker_Id const& id = _S_Worker_Id();
+		return id.pool == this ? id.index : 0;
+	}
+
+	/// Calls __func(i) for each i in [__begin, __end), split into chunks of __chunk indices. Returns after all calls are done.
+	template<typename _Func>
+	void ParallelFor(std::size_t __begin, std::size_t __end, std::size_t __chunk, _Func const& __func) {
+		if(__begin >= __end) {
+			return;
+		}
+		if(__chunk == 0) {
+			__chunk = 1;
+		}
+		std::size_t const chunks = (__end - __begin + __chunk - 1) / __chunk;
+		if(chunks > UINT32_MAX) {
+			throw std::length_error("bul::common::ThreadPool::ParallelFor(...) : too many chunks.");
+		}
+		_Caller_Scope scope(this);
+		if(_M_size == 1 || chunks == 1) {
+			for(std::size_t i = __begin; i < __end; i++) {
+				__func(i);
+			}
+			return;
+		}
+
+		_M_task = &ThreadPool::_S_Invoke<_Func>;
+		_M_context = const_cast<void*>(static_cast<const void*>(&__func));
+		_M_begin = __begin;
+		_M_end = __end;
+		_M_chunk = __chunk;
+		_M_error = nullptr;
+
+		/// Deal the chunks out evenly, idle workers steal the rest.
+		for(std::size_t i = 0; i < _M_size; i++) {
+			std::uint32_t lo = static_cast<std::uint32_t>(chunks * i / _M_size);
+			std::uint32_t hi = static_cast<std::uint32_t>(chunks * (i + 1) / _M_size);
+			_M_range[i].range.store(_Worker_Range::Pack(lo, hi), std::memory_order_relaxed);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_M_mutex);
+			_M_remaining = _M_size - 1;
+			_M_generation++;
+		}
+		_M_wake.notify_all();
+
+		_M_Work(0);
+
+		std::unique_lock<std::mutex> lock(_M_mutex);
+		_M_done.wait(lock, [this] { return _M_remaining == 0; });
+		_M_task = nullptr;
+		_M_context = nullptr;
+
+		if(_M_error) {
+			std::exception_ptr error = _M_error;
+			_M_error = nullptr;
+			std::rethrow_exception(error);
+		}
+	}
+
+protected:
+	/// The pool running the current thread, and the index of the thread in it.
+	struct _Worker_Id {
+		ThreadPool const* pool;
+		std::size_t index;
+	};
+
+	/// Makes the calling thread worker 0 for the duration of a loop, it may be a worker of another pool.
+	struct _Caller_Scope {
+		_Worker_Id const saved;
+
+		_Caller_Scope(ThreadPool const* __pool) : saved(_S_Worker_Id()) {
+			_S_Worker_Id() = _Worker_Id { __pool, 0 };
+		}
+
+		~_Caller_Scope() {
+			_S_Worker_Id() = saved;
+		}
+	};
+
+	/// Thread-local worker id.
+	static _Worker_Id& _S_Worker_Id() {
+		static thread_local _Worker_Id id = { nullptr, 0 };
+		return id;
+	}
+
+	template<typename _Func>
+	static void _S_Invoke(void* __context, std::size_t __begin, std::size_t __end) {
+		_Func const& func = *static_cast<_Func const*>(__context);
+		for(std::size_t i = __begin; i < __end; i++) {
+			func(i);
+		}
+	}
+
+	/// Claims one chunk from the front of the worker's own range.
+	bool _M_Pop(std::size_t __worker, std::uint32_t & __chunk) {
+		auto& slot = _M_range[__worker].range;
+		std::uint64_t range = slot.load(std::memory_order_acquire);
+		while(_Worker_Range::Begin(range) < _Worker_Range::End(range)) {
+			std::uint64_t next = _Worker_Range::Pack(_Worker_Range::Begin(range) + 1, _Worker_Range::End(range));
+			if(slot.compare_exchange_weak(range, next, std::memory_order_acq_rel)) {
+				__chunk = _Worker_Range::Begin(range);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/// Steals the back half of a victim's range, keeps one chunk and publishes the rest as its own range.
+	bool _M_Steal(std::size_t __worker, std::uint32_t & __chunk) {
+		for(std::size_t k = 1; k < _M_size; k++) {
+			auto& slot = _M_range[(__worker + k) % _M_size].range;
+			std::uint64_t range = slot.load(std::memory_order_acquire);
+			while(_Worker_Range::Begin(range) < _Worker_Range::End(range)) {
+				std::uint32_t lo = _Worker_Range::Begin(range);
+				std::uint32_t hi = _Worker_Range::End(range);
+				std::uint32_t mid = lo + (hi - lo) / 2;
+				if(slot.compare_exchange_weak(range, _Worker_Range::Pack(lo, mid), std::memory_order_acq_rel)) {
+					__chunk = mid;
+					_M_range[__worker].range.store(_Worker_Range::Pack(mid + 1, hi), std::memory_order_release);
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	/// Runs chunks until there is nothing left to run or steal.
+	void _M_Work(std::size_t __worker) {
+		std::uint32_t chunk;
+		while(_M_Pop(__worker, chunk) || _M_Steal(__worker, chunk)) {
+			std::size_t begin = _M_begin + chunk * _M_chunk;
+			std::size_t end = begin + _M_chunk < _M_end ? begin + _M_chunk : _M_end;
+			try {
+				_M_task(_M_context, begin, end);
+			} catch(...) {
+				std::lock_guard<std::mutex> lock(_M_error_mutex);
+				if(!_M_error) {
+					_M_error = std::current_exception();
+				}
+			}
+		}
+	}
+
+	/// Main loop of background workers.
+	void _M_Loop(std::size_t __worker) {
+		_S_Worker_Id() = _Worker_Id { this, __worker };
+		std::size_t generation = 0;
+		while(true) {
+			{
+				std::unique_lock<std::mutex> lock(_M_mutex);
+				_M_wake.wait(lock, [this, generation] { return _M_stop || _M_generation != generation; });
+				if(_M_stop) {
+					return;
+				}
+				generation = _M_generation;
+			}
+
+			_M_Work(__worker);
+
+			std::lock_guard<std::mutex> lock(_M_mutex);
+			if(--_M_remaining == 0) {
+				_M_done.notify_one();
+			}
+		}
+	}
+
+private:
+	std::size_t const _M_size;
+	std::unique_ptr<_Worker_Range[]> _M_range;
+	std::vector<std::thread> _M_thread;
+
+	std::mutex _M_mutex;
+	std::condition_variable _M_wake;
+	std::condition_variable _M_done;
+	std::size_t _M_generation;
+	std::size_t _M_remaining;
+	bool _M_stop;
+
+	_task_type _M_task;
+	void* _M_context;
+	std::size_t _M_begin;
+	std::size_t _M_end;
+	std::size_t _M_chunk;
+
+	std::mutex _M_error_mutex;
+	std::exception_ptr _M_error;
+};
+
+} /* namespace common */
+} /* namespace bul */
+
+#endif /* _BUL_COMMON_THREADPOOL_H */
@@ -0,0 +1,150 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_COMMON_TIMINGWHEEL_H
+#define _BUL_COMMON_TIMINGWHEEL_H
+
+#include <cstdint>
+
+#include <vector>
+
+namespace bul {
+namespace common {
+/// A hierarchical timing wheel over integral ticks. Level l has 64 slots of 64^l ticks each, an entry sits
+/// in the lowest level where its due tick and the current tick share the slot above; it moves one level
+/// down whenever the wheel enters its slot, so scheduling is O(1) and each entry is moved at most
+/// _S_levels times. Entries beyond the last level wait in an overflow list.
+template<typename _Tp>
+class TimingWheel final {
+	struct _Entry {
+		std::uint64_t due;
+		_Tp value;
+	};
+
+	static const unsigned int _S_bits = 6;
+	static const std::uint64_t _S_slots = 1ull << _S_bits;
+	static const unsigned int _S_levels = 4;
+
+public:
+	TimingWheel() : _M_next(0), _M_size(0), _M_wheel(_S_levels * _S_slots) { }
+
+	/// Schedules __value for tick __due, ticks which have already passed mean the next one.
+	void Schedule(_Tp const& __value, std::uint64_t __due) {
+		_M_Place(_Entry { __due < _M_next ? _M_next : __due, __value });
+		_M_size++;
+	}
+
+	/// Processes the ticks up to and including __now, calling __func on every value which is due.
+	/// Going backwards or far ahead rebuilds the wheel around __now; values due before it fire now.
+	template<typename _Func>
+	void Advance(std::uint64_t __now, _Func const& __func) {
+		if(__now < _M_next || __now - _M_next > _S_slots) {
+			_M_Rebase(__now);
+		}
+		while(_M_next <= __now) {
+			_M_Tick(__func);
+		}
+	}
+
+	/// The first tick not processed yet.
+	std::uint64_t Next() const {
+		return _M_next;
+	}
+
+	/// Number of scheduled values.
+	std::size_t Size() const {
+		return _M_size;
+	}
+
+	/// Drops every value, the next tick processed is __next.
+	void Clear(std::uint64_t __next = 0) {
+		for(auto& slot : _M_wheel) {
+			slot.clear();
+		}
+		_M_overflow.clear();
+		_M_size = 0;
+		_M_next = __next;
+	}
+
+private:
+	void _M_Place(_Entry const& __entry) {
+		for(unsigned int level = 0; level < _S_levels; level++) {
+			unsigned int shift = _S_bits * (level + 1);
+			if((__entry.due >> shift) == (_M_next >> shift)) {
+				_M_wheel[level * _S_slots + ((__entry.due >> (_S_bits * level)) & (_S_slots - 1))].push_back(__entry);
+				return;
+			}
+		}
+		_M_overflow.push_back(__entry);
+	}
+
+	/// Moves the entries of a slot (or the overflow list) down, they are placed relative to _M_next.
+	void _M_Cascade(std::vector<_Entry>& __slot) {
+		_M_scratch.swap(__slot);
+		for(auto const& entry : _M_scratch) {
+			_M_Place(entry);
+		}
+		_M_scratch.clear();
+	}
+
+	template<typename _Func>
+	void _M_Tick(_Func const& __func) {
+		if((_M_next & ((1ull << (_S_bits * _S_levels)) - 1)) == 0) {
+			_M_Cascade(_M_overflow);
+		}
+		for(unsigned int level = _S_levels - 1; level > 0; level--) {
+			if((_M_next & ((1ull << (_S_bits * level)) - 1)) == 0) {
+				_M_Cascade(_M_wheel[level * _S_slots + ((_M_next >> (_S_bits * level)) & (_S_slots - 1))]);
+			}
+		}
+
+		/// Everything left in the slot is due now, __func may schedule more.
+		_M_due.swap(_M_wheel[_M_next & (_S_slots - 1)]);
+		_M_next++;
+		_M_size -= _M_due.size();
+		for(auto const& entry : _M_due) {
+			__func(entry.value);
+		}
+		_M_due.clear();
+	}
+
+	void _M_Rebase(std::uint64_t __now) {
+		std::vector<_Entry> entries;
+		entries.reserve(_M_size);
+		for(auto& slot : _M_wheel) {
+			entries.insert(entries.end(), slot.begin(), slot.end());
+			slot.clear();
+		}
+		entries.insert(entries.end(), _M_overflow.begin(), _M_overflow.end());
+		_M_overflow.clear();
+
+		_M_next = __now;
+		for(auto& entry : entries) {
+			entry.due = entry.due < __now ? __now : entry.due;
+			_M_Place(entry);
+		}
+	}
+
+	std::uint64_t _M_next;
+	std::size_t _M_size;
+
+	std::vector<std::vector<_Entry>> _M_wheel;
+	std::vector<_Entry> _M_overflow;
+	std::vector<_Entry> _M_scratch;
+	std::vector<_Entry> _M_due;
+};
+
+template<typename _Tp>
+const unsigned int TimingWheel<_Tp>::_S_bits;
+
+template<typename _Tp>
+const std::uint64_t TimingWheel<_Tp>::_S_slots;
+
+template<typename _Tp>
+const unsigned int TimingWheel<_Tp>::_S_levels;
+
+} /* namespace common */
+} /* namespace bul */
+
+#endif /* _BUL_COMMON_TIMINGWHEEL_H */
@@ -5,15 +5,34 @@
 #ifndef _BUL_DYNAMICS_ACTOR_H
 #define _BUL_DYNAMICS_ACTOR_H
 
+#include <cstdint>
+
+#include <atomic>
 #include <type_traits>
+#include <typeinfo>
+#include <stdexcept>
 
-#include <map>
+#include <utility>
+#include <vector>
 
 #include "node.h"
+#include "../common/allocator.h"
 #include "../common/datapool.h"
 #include "../common/container.h"
+#include "../common/handle.h"
+#include "../common/profiler.h"
+#include "../manager/commandbuffer.h"
 
 namespace bul {
+namespace manager {
+/// Forward-declaration.
+class _System_Base;
+
+template<typename _Tp>
+class System;
+
+} /* namespace manager */
+
 namespace dynamics {
 /// Base class for those who can be active or inactive.
 class _Actable {
@@ -28,19 +47,33 @@ public:
 	_Actable(_Configuration* __conf) : _M_active(__conf->Active) { }
 	virtual ~_Actable() { }
 
-	/// Getter and Setter.
+	/// Getter and Setter. The flag is atomic as an actor may switch another one while the scene steps in
+	/// parallel, the move that follows is deferred to the end of the step.
 	bool IsActive() const {
-		return _M_active;
+		return _M_active.load(std::memory_order_relaxed);
 	}
 
 	void SetActive(bool __active) {
-		_M_active = __active;
+		if(_M_active.exchange(__active, std::memory_order_relaxed) != __active) {
+			_M_Active_Changed();
+		}
 	}
 
+protected:
+	/// Called after the activity changed, so that the owner can move this between its active and inactive parts.
+	virtual void _M_Active_Changed() { }
+
 private:
-	bool _M_active;
+	std::atomic<bool> _M_active;
 };
 
+/// Forward-declaration.
+template<typename _Schema>
+class SchemaActor;
+
+template<typename... _Components>
+class StaticActor;
+
 /// An actor is composed of some components and can perform some actions.
 class Actor : public Node, public _Actable {
 public:
@@ -49,8 +82,9 @@ public:
 
 	/// Defines some types.
 	typedef common::DataPool<int, float, void*, false> datapool_type;
-	typedef common::Container<Component*, common::Key<std::size_t>,
-				common::Tag<std::size_t, unsigned int>, std::map> storage_type;
+	/// Most actors have a few components, their indices live inline in the actor.
+	typedef common::Container<Component*, common::Key<std::size_t>, common::Tag<std::size_t, unsigned int>,
+				common::Small<4>::Map, common::Small<4, 2>::Bucket> storage_type;
 
 	/// Configuration for an actor.
 	struct Configuration : public Node::Configuration, public _Actable::_Configuration {
@@ -58,6 +92,12 @@ public:
 		virtual ~Configuration() { }
 
 		std::size_t DataPoolSize = 128;
+		/// Whether the DataPool is double-buffered: reads see the values of the previous step and writes show
+		/// in the next one, so the order of the components and of the actors does not matter.
+		bool DoubleBufferedData = false;
+		/// Whether the DataPool records the slots written, so that consumers such as replay recorders only
+		/// look at what changed, see SceneMgr::ForEachDirtyActor(...).
+		bool TrackDirtyData = false;
 	};
 
 	/// An actor is composed of some components.
@@ -70,10 +110,18 @@ public:
 
 			std::size_t Priority = 0;
 			Actor* Parent = nullptr;
+
+			/// Whether Act_Anyway() is called, components which leave it empty should set this to false.
+			bool ActAnyway = true;
 		};
 
 		Component(Configuration* __conf) : Node(__conf), _Actable(__conf),
-				_M_priority(__conf->Priority), _M_actor(__conf->Parent) { }
+				_M_priority(__conf->Priority), _M_act_anyway(__conf->ActAnyway), _M_actor(__conf->Parent) {
+			_M_system = nullptr;
+			_M_system_slot = 0;
+			_M_system_anyway_slot = 0;
+			_M_schedule_slot = 0;
+		}
 		virtual ~Component() { }
 
 		/// Getters.
@@ -81,6 +129,10 @@ public:
 			return _M_priority;
 		}
 
+		bool IsActingAnyway() const {
+			return _M_act_anyway;
+		}
+
 		Actor* GetActor() {
 			return _M_actor;
 		}
@@ -93,7 +145,7 @@ public:
 		/// Called in each time step only if the component is active
 		virtual void Act() = 0;
 
-		/// Called in each time step.
+		/// Called in each time step, if Configuration::ActAnyway was set.
 		virtual void Act_Anyway() = 0;
 
 		/// Get and set shared data.
@@ -107,16 +159,58 @@ public:
 			_M_actor->GetDataPool().Set<_Tp>(__index, __value);
 		}
 
+		/// Get the schema slots of the parent, which must be a SchemaActor<_Schema>.
+		template<typename _Schema>
+		common::SoADataPool<_Schema> & GetSharedSlots() {
+			return static_cast<SchemaActor<_Schema>*>(_M_actor)->GetSlots();
+		}
+
+		template<typename _Schema>
+		common::SoADataPool<_Schema> const& GetSharedSlots() const {
+			return static_cast<const SchemaActor<_Schema>*>(_M_actor)->GetSlots();
+		}
+
+		/// Moves the component between the active and inactive parts of the actor's schedule, at the end of
+		/// the step if the scene is stepping (defined in scenemgr.h).
+		virtual void _M_Active_Changed() override;
+
+		/// Is the component stepped by a system of the scene instead of by its actor?
+		bool IsInSystem() const {
+			return _M_system != nullptr;
+		}
+
 	private:
 		friend class Actor;
+		template<typename _Tp>
+		friend class manager::System;
 
 		std::size_t const _M_priority;
+		bool const _M_act_anyway;
 
 		Actor* const _M_actor;
+
+		/// The system driving this component, and the positions in its partitions.
+		manager::_System_Base* _M_system;
+		std::size_t _M_system_slot;
+		std::size_t _M_system_anyway_slot;
+
+		/// The position in the actor's schedule, unless a system drives the component.
+		std::size_t _M_schedule_slot;
 	}; /* End of class Component. */
 
-	Actor(Configuration* __conf) : Node(__conf), _Actable(__conf) {
+	Actor(Configuration* __conf) : Node(__conf), _Actable(__conf), _M_allocator(__conf->Allocator),
+			_M_double_buffered(__conf->DoubleBufferedData) {
 		_M_datapool.Resize(__conf->DataPoolSize);
+		_M_datapool.TrackDirty(__conf->TrackDirtyData);
+		_M_dirty_round = 0;
+		_M_schedule_seq = 0;
+		_M_anyway_dirty = false;
+		_M_system_count = 0;
+		_M_anyway_count = 0;
+		_M_active_slot = 0;
+		_M_anyway_slot = 0;
+		_M_static_act = nullptr;
+		_M_static_act_anyway = nullptr;
 	}
 	virtual ~Actor() {
 		auto iter_end = _M_component.EndByKey<0>();
@@ -128,25 +222,38 @@ public:
 		}
 	}
 
-	/// Add a component.
+	/// Add a component. While the scene is stepping, it joins the actor at the end of the step.
 	template<typename _Tp>
 	_Tp* AddComponent(typename _Tp::Configuration* __conf) {
 		static_assert(std::is_base_of<Component, _Tp>::value,
 				"bul::dynamics::Actor::AddComponent(...): Type '_Tp' must be a derived type of bul::dynamics::Actor::Component.");
 
 		__conf -> SceneManager = GetSceneMgr();
+		__conf -> Allocator = _M_allocator;
 		__conf -> Parent = this;
 
-		_Tp* component = new _Tp(__conf);
-		_M_component.Insert(component, __conf->Id, __conf->Priority, __conf->Tag);
+		_Tp* component = _M_allocator ? _M_allocator->New<_Tp>(__conf) : new _Tp(__conf);
+		if(!_M_Defer(manager::Command_Type::AddComponent, component)) {
+			_M_Insert_Component(component);
+		}
 
 		return component;
 	}
 
-	/// Remove a component.
+	/// Remove a component. While the scene is stepping, this takes effect at the end of the step.
 	void RemoveComponent(Component* __component) {
-		_M_component.EraseByValue(__component);
-		delete __component;
+		if(!_M_Defer(manager::Command_Type::RemoveComponent, __component)) {
+			_M_Erase_Component(__component);
+		}
+	}
+
+	/// Get a component by handle, nullptr if the component has been removed since the handle was issued.
+	Component* GetComponentByHandle(common::Handle const& __handle) {
+		return _M_handle_table.Get(__handle);
+	}
+
+	const Component* GetComponentByHandle(common::Handle const& __handle) const {
+		return _M_handle_table.Get(__handle);
 	}
 
 	/// Get component(s) by id / priority / tag.
@@ -195,32 +302,243 @@ protected:
 	/// Actions after components act.
 	virtual void PostAct() = 0;
 
-	/// Call components if they are active.
+	/// Call components if they are active. Only active components are in the active part of the schedule, a
+	/// component deactivated during the step is skipped at once, one activated joins it in the next step.
+	/// The components of a StaticActor are called in between, by priority.
 	void _M_Act() {
-		for(auto iter = _M_component.BeginByTag<0>(); iter != _M_component.EndByTag<0>(); iter++) {
-			auto& component_list = (*iter).second;
-			for(auto iter_c = component_list.begin(); iter_c != component_list.end(); iter_c++) {
-				auto component = *iter_c;
-				if(component->IsActive()) {
-					component -> Act();
-				}
+		_M_schedule.Commit();
+		Component* const* schedule = _M_schedule.data();
+		std::size_t static_next = 0;
+		for(std::size_t i = 0; i < _M_schedule.ActiveSize(); i++) {
+			auto component = schedule[i];
+			if(_M_static_act) {
+				_M_static_act(this, component->GetPriority(), static_next);
 			}
+			if(component->IsActive()) {
+				BUL_PROFILE_COMPONENT(typeid(*component), component->GetPriority());
+				component -> Act();
+			}
+		}
+		if(_M_static_act) {
+			_M_static_act(this, static_cast<std::size_t>(-1), static_next);
 		}
 	}
 
 	/// Call components anyway.
 	void _M_Act_Anyway() {
-		for(auto iter = _M_component.BeginByKey<0>(); iter != _M_component.EndByKey<0>(); iter++) {
-			auto component = (*iter).second;
+		if(_M_static_act_anyway) {
+			_M_static_act_anyway(this);
+		}
+		if(_M_anyway_dirty) {
+			_M_Build_Schedule_Anyway();
+		}
+		for(std::size_t i = 0; i < _M_schedule_anyway.size(); i++) {
+			auto component = _M_schedule_anyway[i];
+			BUL_PROFILE_COMPONENT(typeid(*component), component->GetPriority());
 			component -> Act_Anyway();
 		}
 	}
 
+	/// Flattens the components acting anyway into a dispatch array in id order, leaving out those stepped by
+	/// a system. Rebuilt after components are added or removed.
+	void _M_Build_Schedule_Anyway() {
+		_M_schedule_anyway.clear();
+		for(auto iter = _M_component.BeginByKey<0>(); iter != _M_component.EndByKey<0>(); iter++) {
+			if(!(*iter).second->_M_system && (*iter).second->_M_act_anyway) {
+				_M_schedule_anyway.push_back((*iter).second);
+			}
+		}
+
+		_M_anyway_dirty = false;
+	}
+
+	/// Moves a component to the part of the schedule matching its activity.
+	void _M_Sync_Component(Component* __component) {
+		if(__component->_M_system) {
+			_M_Sync_System(__component);
+		} else {
+			_M_schedule.SetActive(&__component->_M_schedule_slot, __component->IsActive());
+		}
+	}
+
+	/// Takes a component out of the schedule, as a system now drives it.
+	void _M_Unschedule_Component(Component* __component) {
+		_M_schedule.Erase(&__component->_M_schedule_slot);
+		_M_anyway_dirty = true;
+	}
+
+	/// Put a constructed component in place.
+	void _M_Insert_Component(Component* __component) {
+		_M_component.Insert(__component, __component->GetId(), __component->GetPriority(), __component->GetTag());
+		__component->_M_handle = _M_handle_table.Insert(__component);
+		_M_anyway_dirty = true;
+		_M_Attach_System(__component);
+		if(!__component->_M_system) {
+			_M_schedule.Push(__component, __component->IsActive(), &__component->_M_schedule_slot,
+					std::make_pair(__component->GetPriority(), _M_schedule_seq++));
+		}
+		if(__component->_M_act_anyway && _M_anyway_count++ == 0) {
+			_M_Anyway_Changed();
+		}
+	}
+
+	/// Take a component out and destroy it.
+	void _M_Erase_Component(Component* __component) {
+		if(__component->_M_system) {
+			_M_Detach_System(__component);
+		} else {
+			_M_schedule.Erase(&__component->_M_schedule_slot);
+		}
+		_M_component.EraseByValue(__component);
+		_M_handle_table.Erase(__component->_M_handle);
+		__component->_M_handle = common::Handle();
+		_M_anyway_dirty = true;
+		if(__component->_M_act_anyway && --_M_anyway_count == 0) {
+			_M_Anyway_Changed();
+		}
+		if(_M_allocator) {
+			common::SlabAllocator::Delete(__component);
+		} else {
+			delete __component;
+		}
+	}
+
+	/// Record the change in the scene's command buffer if the scene is stepping (defined in scenemgr.h).
+	inline bool _M_Defer(manager::Command_Type __type, Component* __component);
+
+	/// Move the actor between the scene's active and inactive parts (defined in scenemgr.h).
+	virtual void _M_Active_Changed() override;
+
+	/// The actor gained its first or lost its last component acting anyway (defined in scenemgr.h).
+	inline void _M_Anyway_Changed();
+
+	/// Hand a new component to the system registered for its type, if any (defined in scenemgr.h).
+	inline void _M_Attach_System(Component* __component);
+
+	/// Take a component back from its system (defined in scenemgr.h).
+	inline void _M_Detach_System(Component* __component);
+
+	/// Tell the system of a component that the component or the actor changed (defined in scenemgr.h).
+	inline void _M_Sync_System(Component* __component);
+
+	/// Tell the systems driving components of the actor that it was switched, put to sleep or woken.
+	void _M_Sync_Systems() {
+		if(_M_system_count == 0) {
+			return;
+		}
+		for(auto iter = _M_component.BeginByKey<0>(); iter != _M_component.EndByKey<0>(); iter++) {
+			if((*iter).second->_M_system) {
+				_M_Sync_System((*iter).second);
+			}
+		}
+	}
+
+	/// Called by the DataPool when it becomes dirty, lists the actor in the scene (defined in scenemgr.h).
+	static inline void _S_Data_Dirty(void* __actor);
+
+	/// State kept outside of the DataPool, which checkpoints save after it: the slots of a SchemaActor.
+	virtual std::size_t _M_Slots_Bytes() const {
+		return 0;
+	}
+
+	virtual void _M_Save_Slots(char*) const { }
+	virtual void _M_Load_Slots(const char*) { }
+
 private:
 	friend class manager::SceneMgr;
+	template<typename... _Components>
+	friend class StaticActor;
+	template<typename _Tp>
+	friend class manager::System;
+
+	common::SlabAllocator* const _M_allocator;
+	/// The scene binds the DataPool to its epoch when the actor joins.
+	bool const _M_double_buffered;
 
 	datapool_type _M_datapool;
+	/// The scene's dirty round in which the actor was last listed as dirty.
+	std::uint64_t _M_dirty_round;
 	storage_type _M_component;
+	common::HandleTable<Component> _M_handle_table;
+
+	/// Components in priority order, then in the order they were added, the active ones first.
+	common::Partition<Component*, std::pair<std::size_t, std::uint64_t>> _M_schedule;
+	std::uint64_t _M_schedule_seq;
+	std::vector<Component*> _M_schedule_anyway;
+	bool _M_anyway_dirty;
+	/// Number of components driven by systems.
+	std::size_t _M_system_count;
+
+	/// Calls the components compiled into a StaticActor, if any: those from position __next of their priority
+	/// order up to priority __bound. A plain pointer test keeps other actors free of an extra virtual call.
+	void (*_M_static_act)(Actor*, std::size_t __bound, std::size_t& __next);
+	void (*_M_static_act_anyway)(Actor*);
+
+	/// Number of components acting anyway, and the positions in the scene's partitions.
+	std::size_t _M_anyway_count;
+	std::size_t _M_active_slot;
+	std::size_t _M_anyway_slot;
+};
+
+/// An actor whose shared data is laid out by a compile-time schema, it only pays for the slots it declares.
+template<typename _Schema>
+class SchemaActor : public Actor {
+public:
+	/// Defines some types.
+	typedef common::SoADataPool<_Schema> slots_type;
+
+	/// Configuration for a schema actor, the runtime-sized DataPool is left empty.
+	struct Configuration : public Actor::Configuration {
+		Configuration() {
+			DataPoolSize = 0;
+		}
+		virtual ~Configuration() { }
+	};
+
+	SchemaActor(Configuration* __conf) : Actor(__conf) { }
+	virtual ~SchemaActor() { }
+
+	/// Get reference to the schema slots.
+	slots_type & GetSlots() {
+		return _M_slots;
+	}
+
+	slots_type const& GetSlots() const {
+		return _M_slots;
+	}
+
+protected:
+	/// Checkpoints save the slots as raw bytes, which needs trivially copyable values.
+	virtual std::size_t _M_Slots_Bytes() const override {
+		return slots_type::Bytes();
+	}
+
+	virtual void _M_Save_Slots(char* __bytes) const override {
+		_M_Save(__bytes, std::integral_constant<bool, slots_type::IsTriviallyCopyable()>());
+	}
+
+	virtual void _M_Load_Slots(const char* __bytes) override {
+		_M_Load(__bytes, std::integral_constant<bool, slots_type::IsTriviallyCopyable()>());
+	}
+
+private:
+	void _M_Save(char* __bytes, std::true_type) const {
+		_M_slots.Save(__bytes);
+	}
+
+	void _M_Save(char*, std::false_type) const {
+		throw std::logic_error("bul::dynamics::SchemaActor<...>::_M_Save_Slots(...) : slots are not trivially copyable.");
+	}
+
+	void _M_Load(const char* __bytes, std::true_type) {
+		_M_slots.Load(__bytes);
+	}
+
+	void _M_Load(const char*, std::false_type) {
+		throw std::logic_error("bul::dynamics::SchemaActor<...>::_M_Load_Slots(...) : slots are not trivially copyable.");
+	}
+
+	slots_type _M_slots;
 };
 
 } /* namespace dynamics */
@@ -5,14 +5,30 @@
 #ifndef _BUL_DYNAMICS_NODE_H
 #define _BUL_DYNAMICS_NODE_H
 
+#include <cstddef>
+
+#include "../common/handle.h"
+
 namespace bul {
+namespace common {
+/// Forward-declaration.
+class SlabAllocator;
+
+} /* namespace common */
+
 namespace manager {
 /// Forward-declaration.
 class SceneMgr;
 
+template<typename _Tp>
+class MessageRange;
+
 } /* namespace manager */
 
 namespace dynamics {
+/// Forward-declaration.
+class Actor;
+
 /// Node types.
 enum class Node_Type {
 	Actor,
@@ -37,11 +53,12 @@ public:
 
 		Node_Type const NodeType;
 		manager::SceneMgr* SceneManager = nullptr;
+		common::SlabAllocator* Allocator = nullptr;
 	};
 
 	Node(Configuration* __conf) : _M_type(__conf->NodeType), _M_id(__conf->Id),
 			_M_tag(__conf->Tag), _M_flag(__conf->Flag), _M_user_data(__conf->UserData), 
-					_M_scenemgr(__conf->SceneManager) { }
+					_M_scenemgr(__conf->SceneManager), _M_sleeping(false), _M_wake_step(0) { }
 	virtual ~Node() { }
 
 	/// Getters.
@@ -53,6 +70,11 @@ public:
 		return _M_id;
 	}
 
+	/// Handle issued when the node joined its scene (or actor), null before that and after removal.
+	common::Handle GetHandle() const {
+		return _M_handle;
+	}
+
 	unsigned int GetTag() const {
 		return _M_tag;
 	}
@@ -63,14 +85,17 @@ public:
 
 	void SetFlag(unsigned int __flag) {
 		_M_flag = __flag;
+		_M_Flag_Changed();
 	}
 
 	void AddFlag(unsigned int __flag) {
 		_M_flag = _M_flag | __flag;
+		_M_Flag_Changed();
 	}
 
 	void RemoveFlag(unsigned int __flag) {
 		_M_flag = _M_flag & (~__flag);
+		_M_Flag_Changed();
 	}
 
 	bool CheckFlag(unsigned int __flag) const {
@@ -97,16 +122,63 @@ public:
 		return _M_scenemgr;
 	}
 
+	/// Stop dispatching the node until step __step, the scene calls it again from that step on.
+	/// Only actors and triggers are dispatched by the scene, a sleeping actor skips its components too.
+	void SleepUntil(std::size_t __step) {
+		_M_sleeping = true;
+		_M_wake_step = __step;
+		_M_Schedule_Changed();
+	}
+
+	/// Dispatch the node again from the next step (or the current one, outside of a step).
+	void Wake() {
+		if(_M_sleeping) {
+			_M_sleeping = false;
+			_M_Schedule_Changed();
+		}
+	}
+
+	bool IsSleeping() const {
+		return _M_sleeping;
+	}
+
+	/// The step given to the last SleepUntil(...).
+	std::size_t GetWakeStep() const {
+		return _M_wake_step;
+	}
+
+	/// Send a message to another node of the scene, see SceneMgr::Send(...). Defined with SceneMgr.
+	template<typename _Tp>
+	void Send(common::Handle const& __recipient, _Tp const& __message);
+
+	/// The messages of type _Tp delivered to this node for the current step. Components have no mailbox
+	/// of their own and get nothing here, they read the one of their actor. Defined with SceneMgr.
+	template<typename _Tp>
+	manager::MessageRange<_Tp> GetMessages() const;
+
 private:
+	/// Tells the scene to move the node in or out of its schedule, defined with SceneMgr.
+	inline void _M_Schedule_Changed();
+
+	/// Tells the scene to update its flag index, defined with SceneMgr.
+	inline void _M_Flag_Changed();
+
+	friend class Actor;
+	friend class manager::SceneMgr;
+
 	Node_Type const _M_type;
 
 	std::size_t const _M_id;
+	common::Handle _M_handle;
 	unsigned int const _M_tag;
 
 	unsigned int _M_flag;
 	void* _M_user_data;
 
 	manager::SceneMgr* const _M_scenemgr;
+
+	bool _M_sleeping;
+	std::size_t _M_wake_step;
 };
 
 } /* namespace dynamics */
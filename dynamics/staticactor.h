@@ -0,0 +1,177 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_DYNAMICS_STATICACTOR_H
+#define _BUL_DYNAMICS_STATICACTOR_H
+
+#include <type_traits>
+#include <typeinfo>
+
+#include <tuple>
+
+#include "actor.h"
+#include "../common/container.h"
+#include "../common/profiler.h"
+
+namespace bul {
+namespace dynamics {
+/// Base of the components of a StaticActor. They are plain objects living inside the actor: no node, no
+/// handle and no virtual call. Derived types hide Act(...) and, if _Act_Anyway, Act_Anyway(...); both
+/// receive the actor, either as Actor& or as the StaticActor type (through a template parameter).
+template<std::size_t _Priority, bool _Act_Anyway = false>
+struct StaticComponent {
+	static const std::size_t Priority = _Priority;
+	static const bool ActAnyway = _Act_Anyway;
+
+	void Act(Actor&) { }
+	void Act_Anyway(Actor&) { }
+};
+
+template<std::size_t _Priority, bool _Act_Anyway>
+const std::size_t StaticComponent<_Priority, _Act_Anyway>::Priority;
+
+template<std::size_t _Priority, bool _Act_Anyway>
+const bool StaticComponent<_Priority, _Act_Anyway>::ActAnyway;
+
+/// Inserts _Index into a sequence sorted by priority, after the indices of equal priority.
+template<typename _Tuple, typename _Sorted, std::size_t _Index>
+struct _Priority_Insert;
+
+template<typename _Tuple, std::size_t _Index>
+struct _Priority_Insert<_Tuple, common::_Index_Sequence<>, _Index> {
+	typedef common::_Index_Sequence<_Index> type;
+};
+
+template<typename _Tuple, std::size_t _Head, std::size_t... _Tail, std::size_t _Index>
+struct _Priority_Insert<_Tuple, common::_Index_Sequence<_Head, _Tail...>, _Index> {
+	template<std::size_t _Prepend, typename _Sequence>
+	struct _Push_Front;
+
+	template<std::size_t _Prepend, std::size_t... _Indices>
+	struct _Push_Front<_Prepend, common::_Index_Sequence<_Indices...>> {
+		typedef common::_Index_Sequence<_Prepend, _Indices...> type;
+	};
+
+	typedef typename std::conditional<(std::tuple_element<_Index, _Tuple>::type::Priority <
+			std::tuple_element<_Head, _Tuple>::type::Priority), common::_Index_Sequence<_Index, _Head, _Tail...>,
+			typename _Push_Front<_Head, typename _Priority_Insert<_Tuple, common::_Index_Sequence<_Tail...>,
+					_Index>::type>::type>::type type;
+};
+
+/// The indices of a tuple of components in priority order, ties keep the order of declaration.
+template<typename _Tuple, std::size_t _Count = std::tuple_size<_Tuple>::value>
+struct _Priority_Order {
+	typedef typename _Priority_Insert<_Tuple, typename _Priority_Order<_Tuple, _Count - 1>::type, _Count - 1>::type type;
+};
+
+template<typename _Tuple>
+struct _Priority_Order<_Tuple, 0> {
+	typedef common::_Index_Sequence<> type;
+};
+
+/// An actor whose components are fixed at compile time. They are stored inline in a tuple and called in
+/// priority order by code unrolled at compile time, merged with the components added at run time through
+/// AddComponent(...): a static component acts before the runtime ones of equal or greater priority. Their
+/// Act_Anyway(...) are called before those of the runtime components. The actor is a normal
+/// Node_Type::Actor for the scene; PreAct() and PostAct() are still overridden by the derived type. Static
+/// components are always active (deactivate the actor instead), are not seen by systems and are not saved
+/// by checkpoints.
+template<typename... _Components>
+class StaticActor : public Actor {
+public:
+	/// Defines some types.
+	typedef std::tuple<_Components...> static_components_type;
+
+	StaticActor(Configuration* __conf) : Actor(__conf) {
+		_M_static_act = &_S_Act;
+		if(_S_Acts_Anyway<_Components...>()) {
+			_M_static_act_anyway = &_S_Act_Anyway;
+			_M_anyway_count++;
+		}
+	}
+	virtual ~StaticActor() { }
+
+	/// Get a static component by its position in _Components.
+	template<std::size_t _Index>
+	typename std::tuple_element<_Index, static_components_type>::type & GetStaticComponent() {
+		return std::get<_Index>(_M_static_components);
+	}
+
+	template<std::size_t _Index>
+	typename std::tuple_element<_Index, static_components_type>::type const& GetStaticComponent() const {
+		return std::get<_Index>(_M_static_components);
+	}
+
+protected:
+	virtual void PreAct() override { }
+	virtual void PostAct() override { }
+
+private:
+	typedef typename _Priority_Order<static_components_type>::type _order_type;
+
+	template<typename... _Tp>
+	static constexpr bool _S_Acts_Anyway() {
+		return _S_Any(_Tp::ActAnyway...);
+	}
+
+	static constexpr bool _S_Any() {
+		return false;
+	}
+
+	template<typename... _Tail>
+	static constexpr bool _S_Any(bool __head, _Tail... __tail) {
+		return __head || _S_Any(__tail...);
+	}
+
+	static void _S_Act(Actor* __actor, std::size_t __bound, std::size_t& __next) {
+		static_cast<StaticActor*>(__actor)->_M_Act_Until(__bound, __next, _order_type(),
+				typename common::_Make_Index_Sequence<sizeof...(_Components)>::type());
+	}
+
+	static void _S_Act_Anyway(Actor* __actor) {
+		static_cast<StaticActor*>(__actor)->_M_Act_Anyway_All(
+				typename common::_Make_Index_Sequence<sizeof...(_Components)>::type());
+	}
+
+	/// Calls the components from position __next of the priority order up to priority __bound, and moves
+	/// __next past them. The braced list is evaluated left to right, so the calls follow the sequence.
+	template<std::size_t... _Indices, std::size_t... _Positions>
+	void _M_Act_Until(std::size_t __bound, std::size_t& __next, common::_Index_Sequence<_Indices...>,
+			common::_Index_Sequence<_Positions...>) {
+		int unroll[] = { 0, (_M_Act_One(std::get<_Indices>(_M_static_components), _Positions, __bound, __next), 0)... };
+		(void)unroll;
+	}
+
+	template<std::size_t... _Indices>
+	void _M_Act_Anyway_All(common::_Index_Sequence<_Indices...>) {
+		int unroll[] = { 0, (_M_Act_Anyway_One(std::get<_Indices>(_M_static_components), std::integral_constant<bool,
+				std::tuple_element<_Indices, static_components_type>::type::ActAnyway>()), 0)... };
+		(void)unroll;
+	}
+
+	template<typename _Tp>
+	void _M_Act_One(_Tp& __component, std::size_t __position, std::size_t __bound, std::size_t& __next) {
+		if(__position >= __next && _Tp::Priority <= __bound) {
+			BUL_PROFILE_COMPONENT(typeid(_Tp), _Tp::Priority);
+			__component.Act(*this);
+			__next = __position + 1;
+		}
+	}
+
+	template<typename _Tp>
+	void _M_Act_Anyway_One(_Tp& __component, std::true_type) {
+		BUL_PROFILE_COMPONENT(typeid(_Tp), _Tp::Priority);
+		__component.Act_Anyway(*this);
+	}
+
+	template<typename _Tp>
+	void _M_Act_Anyway_One(_Tp&, std::false_type) { }
+
+	static_components_type _M_static_components;
+};
+
+} /* namespace dynamics */
+} /* namespace bul */
+
+#endif /* _BUL_DYNAMICS_STATICACTOR_H */
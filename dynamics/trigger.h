@@ -27,6 +27,9 @@ protected:
 
 private:
 	friend class manager::SceneMgr;
+
+	/// Position in the scene's trigger partition.
+	std::size_t _M_awake_slot = 0;
 };
 
 } /* namespace dynamics */
@@ -0,0 +1,203 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_MANAGER_ASYNCMONITOR_H
+#define _BUL_MANAGER_ASYNCMONITOR_H
+
+#include <exception>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../dynamics/actor.h"
+#include "monitor.h"
+
+namespace bul {
+namespace manager {
+/// A read-only copy of the monitored state, published by the scene after a step. Only the runtime DataPool of
+/// each actor is copied: the schema slots of a SchemaActor are not part of a snapshot.
+struct Snapshot {
+	/// State of one actor.
+	struct ActorState {
+		std::size_t Id;
+		unsigned int Tag;
+		unsigned int Flag;
+		bool Active;
+		dynamics::Actor::datapool_type DataPool;
+	};
+
+	std::size_t Step = 0;
+	std::vector<ActorState> Actors;
+};
+
+/// A monitor which consumes snapshots on its own thread while the simulation goes on.
+class AsyncMonitor : public Monitor {
+public:
+	/// What to do when the queue is full.
+	enum class Policy {
+		Block,
+		Drop,
+		Sample
+	};
+
+	/// Configuration for an asynchronous monitor.
+	struct Configuration {
+		Configuration() { }
+		virtual ~Configuration() { }
+
+		/// Maximum number of snapshots waiting to be consumed.
+		std::size_t QueueSize = 4;
+		Policy Backpressure = Policy::Block;
+		/// With Policy::Sample, only every SampleInterval-th step is published (blocking when full).
+		std::size_t SampleInterval = 1;
+	};
+
+	AsyncMonitor(Configuration* __conf) : _M_queue_size(__conf->QueueSize == 0 ? 1 : __conf->QueueSize),
+			_M_policy(__conf->Backpressure), _M_sample_interval(__conf->SampleInterval == 0 ? 1 : __conf->SampleInterval) {
+		_M_stop = false;
+		_M_consumed = 0;
+		_M_dropped = 0;
+	}
+	/// SceneMgr::Run(...) joins the thread on every way out. A thread still running here could call
+	/// Consume(...) on the destroyed derived object, so it is not joined but treated as fatal.
+	virtual ~AsyncMonitor() {
+		if(_M_thread.joinable()) {
+			std::terminate();
+		}
+	}
+
+	/// Number of snapshots consumed / dropped so far.
+	std::size_t GetConsumed() const {
+		std::lock_guard<std::mutex> lock(_M_mutex);
+		return _M_consumed;
+	}
+
+	std::size_t GetDropped() const {
+		std::lock_guard<std::mutex> lock(_M_mutex);
+		return _M_dropped;
+	}
+
+protected:
+	/// Called on the monitor thread for each published snapshot. The scene must not be touched from here.
+	virtual void Consume(Snapshot const& __snapshot) = 0;
+
+	/// Snapshots are delivered through Consume(...) instead.
+	virtual void Step() override final { }
+
+private:
+	friend class SceneMgr;
+
+	/// Whether a snapshot of this step would be accepted.
+	bool _M_Wants(std::size_t __step) const {
+		switch(_M_policy) {
+		case Policy::Sample:
+			return __step % _M_sample_interval == 0;
+		case Policy::Drop: {
+			std::lock_guard<std::mutex> lock(_M_mutex);
+			if(_M_queue.size() >= _M_queue_size) {
+				_M_dropped++;
+				return false;
+			}
+			return true;
+		}
+		default:
+			return true;
+		}
+	}
+
+	/// Queues a snapshot, blocks while the queue is full.
+	void _M_Publish(std::shared_ptr<const Snapshot> const& __snapshot) {
+		std::unique_lock<std::mutex> lock(_M_mutex);
+		_M_not_full.wait(lock, [this] { return _M_queue.size() < _M_queue_size || _M_error; });
+		_M_Check();
+		_M_queue.push_back(__snapshot);
+		_M_not_empty.notify_one();
+	}
+
+	void _M_Start() {
+		_M_stop = false;
+		_M_thread = std::thread(&AsyncMonitor::_M_Loop, this);
+	}
+
+	/// Drains the queue and joins the thread.
+	void _M_Stop() {
+		if(!_M_thread.joinable()) {
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(_M_mutex);
+			_M_stop = true;
+		}
+		_M_not_empty.notify_one();
+		_M_thread.join();
+	}
+
+	/// Drains the queue, then reports the failure of Consume(...), if any.
+	void _M_Finish() {
+		_M_Stop();
+		std::lock_guard<std::mutex> lock(_M_mutex);
+		_M_Check();
+	}
+
+	/// Reports the failure of Consume(...), if any. Expects the lock to be held.
+	void _M_Check() {
+		if(_M_error) {
+			std::exception_ptr error = _M_error;
+			_M_error = nullptr;
+			std::rethrow_exception(error);
+		}
+	}
+
+	void _M_Loop() {
+		while(true) {
+			std::shared_ptr<const Snapshot> snapshot;
+			{
+				std::unique_lock<std::mutex> lock(_M_mutex);
+				_M_not_empty.wait(lock, [this] { return _M_stop || !_M_queue.empty(); });
+				if(_M_queue.empty()) {
+					return;
+				}
+				snapshot = _M_queue.front();
+			}
+
+			try {
+				Consume(*snapshot);
+			} catch(...) {
+				std::lock_guard<std::mutex> lock(_M_mutex);
+				_M_error = std::current_exception();
+				_M_queue.clear();
+				_M_not_full.notify_one();
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(_M_mutex);
+			_M_queue.pop_front();
+			_M_consumed++;
+			_M_not_full.notify_one();
+		}
+	}
+
+	std::size_t const _M_queue_size;
+	Policy const _M_policy;
+	std::size_t const _M_sample_interval;
+
+	mutable std::mutex _M_mutex;
+	std::condition_variable _M_not_empty;
+	std::condition_variable _M_not_full;
+	std::deque<std::shared_ptr<const Snapshot>> _M_queue;
+	std::thread _M_thread;
+	bool _M_stop;
+	std::size_t _M_consumed;
+	mutable std::size_t _M_dropped;
+	std::exception_ptr _M_error;
+};
+
+} /* namespace manager */
+} /* namespace bul */
+
+#endif /* _BUL_MANAGER_ASYNCMONITOR_H */
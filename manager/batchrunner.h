@@ -0,0 +1,151 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_MANAGER_BATCHRUNNER_H
+#define _BUL_MANAGER_BATCHRUNNER_H
+
+#include <cstdint>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "../common/threadpool.h"
+#include "monitor.h"
+#include "scenemgr.h"
+
+namespace bul {
+namespace manager {
+/// Runs many independent episodes of a scene on a thread pool. Each worker owns one scene (and so one
+/// allocator) and one monitor, which are reset and reused from episode to episode.
+/// _Monitor is a Monitor with a result_type and a result_type GetResult() const, read after each episode;
+/// the results are folded by a reducer in episode order, so the total does not depend on the scheduling.
+template<typename _Scene, typename _Monitor>
+class BatchRunner final {
+	static_assert(std::is_base_of<SceneMgr, _Scene>::value,
+			"bul::manager::BatchRunner<...> : Type '_Scene' must be a derived type of bul::manager::SceneMgr.");
+	static_assert(std::is_base_of<Monitor, _Monitor>::value,
+			"bul::manager::BatchRunner<...> : Type '_Monitor' must be a derived type of bul::manager::Monitor.");
+
+public:
+	typedef typename _Monitor::result_type result_type;
+
+	/// Configuration for a batch runner.
+	struct Configuration {
+		/// Number of episodes run at once, each scene must step serially (SceneMgr::Configuration::Threads = 1).
+		std::size_t Threads = 1;
+		/// Base of the per-episode seeds.
+		std::uint64_t Seed = 0;
+	};
+
+	/// What a setup callback knows about the episode it prepares.
+	struct Episode {
+		std::size_t Index;
+		std::size_t Worker;
+		/// Derived from Configuration::Seed and Index only.
+		std::uint64_t Seed;
+	};
+
+	typedef std::function<std::unique_ptr<_Scene>()> scene_factory_type;
+	typedef std::function<std::unique_ptr<_Monitor>()> monitor_factory_type;
+	typedef std::function<void(_Scene&, Episode const&)> setup_type;
+	typedef std::function<void(result_type&, result_type const&)> reducer_type;
+
+	/// The factories are called at most once per worker, under a lock.
+	BatchRunner(Configuration* __conf, scene_factory_type const& __scene_factory,
+			monitor_factory_type const& __monitor_factory) : _M_seed(__conf->Seed),
+					_M_scene_factory(__scene_factory), _M_monitor_factory(__monitor_factory) {
+		if(__conf->Threads > 1) {
+			_M_thread_pool.reset(new common::ThreadPool(__conf->Threads));
+		}
+		_M_worker.resize(GetThreads());
+	}
+
+	BatchRunner(BatchRunner const&) = delete;
+	BatchRunner& operator=(BatchRunner const&) = delete;
+
+	std::size_t GetThreads() const {
+		return _M_thread_pool ? _M_thread_pool->Size() : 1;
+	}
+
+	/// Runs episodes [0, __episodes): each one resets a scene, hands it to __setup, runs it with the worker's
+	/// monitor and keeps the monitor's result. Returns __total with every result folded in by __reduce.
+	/// If an episode throws, the other episodes still run, then the first exception is rethrown.
+	result_type Run(std::size_t __episodes, setup_type const& __setup, reducer_type const& __reduce,
+			result_type __total = result_type()) {
+		std::vector<result_type> results(__episodes);
+		auto episode = [this, &__setup, &results](std::size_t __index) {
+			std::size_t worker = _M_thread_pool ? _M_thread_pool->Worker() : 0;
+			_M_Run_Episode(_M_worker[worker], Episode { __index, worker, _S_Mix(_M_seed + __index) },
+					__setup, results[__index]);
+		};
+		if(_M_thread_pool) {
+			_M_thread_pool->ParallelFor(0, __episodes, 1, episode);
+		} else {
+			for(std::size_t i = 0; i < __episodes; i++) {
+				episode(i);
+			}
+		}
+
+		for(auto const& result : results) {
+			__reduce(__total, result);
+		}
+		return __total;
+	}
+
+private:
+	/// A worker's scene and monitor, padded so that neighbouring workers do not share a line.
+	struct _Worker {
+		std::unique_ptr<_Scene> scene;
+		std::unique_ptr<_Monitor> monitor;
+		char _padding[64 - 2 * sizeof(void*)];
+	};
+
+	void _M_Run_Episode(_Worker& __worker, Episode const& __episode, setup_type const& __setup,
+			result_type& __result) {
+		if(!__worker.scene || !__worker.monitor) {
+			std::lock_guard<std::mutex> lock(_M_factory_mutex);
+			__worker.scene = _M_scene_factory();
+			__worker.monitor = _M_monitor_factory();
+			if(__worker.scene && __worker.scene->GetThreads() != 1) {
+				__worker.scene.reset();
+				throw std::invalid_argument("bul::manager::BatchRunner<...>::Run(...) : scenes must step serially (Threads = 1).");
+			}
+		}
+		try {
+			__worker.scene->Reset();
+			__setup(*__worker.scene, __episode);
+			__worker.scene->Run(__worker.monitor.get());
+		} catch(...) {
+			/// A scene which stopped in the middle of a step cannot be reset, the next episode builds a new one.
+			__worker.scene.reset();
+			throw;
+		}
+		__result = __worker.monitor->GetResult();
+	}
+
+	/// SplitMix64, spreads consecutive indices over the whole seed space.
+	static std::uint64_t _S_Mix(std::uint64_t __x) {
+		__x += 0x9e3779b97f4a7c15ull;
+		__x = (__x ^ (__x >> 30)) * 0xbf58476d1ce4e5b9ull;
+		__x = (__x ^ (__x >> 27)) * 0x94d049bb133111ebull;
+		return __x ^ (__x >> 31);
+	}
+
+	std::uint64_t const _M_seed;
+	scene_factory_type const _M_scene_factory;
+	monitor_factory_type const _M_monitor_factory;
+	std::mutex _M_factory_mutex;
+
+	std::unique_ptr<common::ThreadPool> _M_thread_pool;
+	std::vector<_Worker> _M_worker;
+};
+
+} /* namespace manager */
+} /* namespace bul */
+
+#endif /* _BUL_MANAGER_BATCHRUNNER_H */
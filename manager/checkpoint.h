@@ -0,0 +1,180 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_MANAGER_CHECKPOINT_H
+#define _BUL_MANAGER_CHECKPOINT_H
+
+#include <stdexcept>
+#include <exception>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bul {
+namespace manager {
+/// Layout of a checkpoint file: a header, then every node followed by its data pool, the schema slots of a
+/// SchemaActor, and its components.
+struct CheckpointHeader {
+	char Magic[8];
+	std::uint32_t Version;
+	std::uint32_t Reserved;
+	std::uint64_t CurrentStep;
+	std::uint64_t NodeCount;
+};
+
+/// A node as stored in a checkpoint.
+struct NodeRecord {
+	std::uint64_t Id;
+	std::uint32_t Tag;
+	std::uint32_t Flag;
+	std::uint32_t Kind;
+	std::uint8_t NodeType;
+	std::uint8_t Active;
+	/// Whether the node sleeps until WakeStep.
+	std::uint8_t Sleeping;
+	std::uint8_t Reserved;
+	std::uint64_t WakeStep;
+	std::uint64_t DataPoolSize;
+	std::uint64_t DataPoolBytes;
+	/// Size of the schema slots, 0 unless the node is a SchemaActor.
+	std::uint64_t SlotsBytes;
+	std::uint64_t ComponentCount;
+};
+
+/// A component as stored in a checkpoint.
+struct ComponentRecord {
+	std::uint64_t Id;
+	std::uint64_t Priority;
+	std::uint32_t Tag;
+	std::uint32_t Flag;
+	std::uint32_t Kind;
+	std::uint8_t Active;
+	std::uint8_t Reserved[3];
+};
+
+static const char _S_checkpoint_magic[8] = { 'B', 'U', 'L', 'C', 'K', 'P', 'T', '\0' };
+static const std::uint32_t _S_checkpoint_version = 3;
+
+/// Appends raw records to a checkpoint image.
+class _Checkpoint_Buffer {
+public:
+	template<typename _Tp>
+	void Write(_Tp const& __record) {
+		Write(&__record, sizeof(_Tp));
+	}
+
+	void Write(const void* __data, std::size_t __size) {
+		const char* bytes = static_cast<const char*>(__data);
+		_M_bytes.insert(_M_bytes.end(), bytes, bytes + __size);
+	}
+
+	/// Appends __size bytes for the caller to fill in.
+	char* Extend(std::size_t __size) {
+		_M_bytes.resize(_M_bytes.size() + __size);
+		return _M_bytes.data() + _M_bytes.size() - __size;
+	}
+
+	void Reserve(std::size_t __size) {
+		_M_bytes.reserve(__size);
+	}
+
+	std::vector<char>& Bytes() {
+		return _M_bytes;
+	}
+
+private:
+	std::vector<char> _M_bytes;
+};
+
+/// Reads records back from a mapped checkpoint image.
+class _Checkpoint_Reader {
+public:
+	_Checkpoint_Reader(const char* __data, std::size_t __size) : _M_data(__data), _M_size(__size), _M_offset(0) { }
+
+	template<typename _Tp>
+	_Tp Read() {
+		_Tp record;
+		std::memcpy(&record, Skip(sizeof(_Tp)), sizeof(_Tp));
+		return record;
+	}
+
+	/// Returns the current position and moves past __size bytes.
+	const char* Skip(std::size_t __size) {
+		if(__size > _M_size - _M_offset) {
+			throw std::runtime_error("bul::manager::_Checkpoint_Reader::Skip(...) : truncated checkpoint.");
+		}
+		const char* ptr = _M_data + _M_offset;
+		_M_offset += __size;
+		return ptr;
+	}
+
+private:
+	const char* const _M_data;
+	std::size_t const _M_size;
+	std::size_t _M_offset;
+};
+
+/// Writes checkpoint images to disk on a background thread, one at a time.
+class _Checkpoint_Writer {
+public:
+	_Checkpoint_Writer() { }
+	~_Checkpoint_Writer() {
+		if(_M_thread.joinable()) {
+			_M_thread.join();
+		}
+	}
+
+	/// Starts writing __bytes to __path (through a temporary file), waits for the previous write first.
+	void Write(std::string const& __path, std::vector<char>&& __bytes) {
+		Wait();
+		_M_bytes.swap(__bytes);
+		_M_thread = std::thread(&_Checkpoint_Writer::_M_Write, this, __path);
+	}
+
+	/// Waits for the pending write and reports its failure, if any.
+	void Wait() {
+		if(_M_thread.joinable()) {
+			_M_thread.join();
+		}
+		if(_M_error) {
+			std::exception_ptr error = _M_error;
+			_M_error = nullptr;
+			std::rethrow_exception(error);
+		}
+	}
+
+protected:
+	void _M_Write(std::string __path) {
+		try {
+			std::string tmp = __path + ".tmp";
+			std::FILE* file = std::fopen(tmp.c_str(), "wb");
+			if(file == nullptr) {
+				throw std::runtime_error("bul::manager::_Checkpoint_Writer : cannot open '" + tmp + "'.");
+			}
+			std::size_t written = std::fwrite(_M_bytes.data(), 1, _M_bytes.size(), file);
+			if(std::fclose(file) != 0 || written != _M_bytes.size()) {
+				throw std::runtime_error("bul::manager::_Checkpoint_Writer : cannot write '" + tmp + "'.");
+			}
+			if(std::rename(tmp.c_str(), __path.c_str()) != 0) {
+				throw std::runtime_error("bul::manager::_Checkpoint_Writer : cannot rename '" + tmp + "'.");
+			}
+		} catch(...) {
+			_M_error = std::current_exception();
+		}
+	}
+
+private:
+	std::thread _M_thread;
+	std::vector<char> _M_bytes;
+	std::exception_ptr _M_error;
+};
+
+} /* namespace manager */
+} /* namespace bul */
+
+#endif /* _BUL_MANAGER_CHECKPOINT_H */
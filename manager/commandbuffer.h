@@ -0,0 +1,90 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_MANAGER_COMMANDBUFFER_H
+#define _BUL_MANAGER_COMMANDBUFFER_H
+
+#include <stdexcept>
+#include <cstdint>
+
+#include <vector>
+
+#include "../dynamics/node.h"
+
+namespace bul {
+namespace manager {
+/// Structural changes which can be requested while the scene is stepping.
+enum class Command_Type : std::uint8_t {
+	AddNode,
+	RemoveNode,
+	AddComponent,
+	RemoveComponent,
+	/// A node's activity changed, it moves between the scene's partitions.
+	SyncNode,
+	/// A node started or stopped sleeping.
+	ScheduleNode,
+	/// A node's flags changed.
+	SyncFlag,
+	/// A component's activity changed, it moves within its actor's schedule.
+	SyncComponent
+};
+
+/// One recorded change, the target is already constructed for additions.
+struct _Command {
+	Command_Type Type;
+	dynamics::Node* Target;
+};
+
+/// Commands recorded during a step, one queue per worker so that appending needs neither a lock nor an atomic.
+class _Command_Buffer final {
+	/// A worker's queue, padded to its own cache line.
+	struct _Queue {
+		std::vector<_Command> commands;
+		char _padding[64 - sizeof(std::vector<_Command>) % 64];
+	};
+
+public:
+	_Command_Buffer() : _M_queue(1) { }
+
+	/// Number of workers which may append concurrently.
+	void Resize(std::size_t __workers) {
+		_M_queue.resize(__workers == 0 ? 1 : __workers);
+	}
+
+	/// Appends a command to the queue of __worker.
+	void Push(std::size_t __worker, Command_Type __type, dynamics::Node* __target) {
+		if(__worker >= _M_queue.size()) {
+			throw std::logic_error("bul::manager::_Command_Buffer::Push(...) : Unknown worker.");
+		}
+		_M_queue[__worker].commands.push_back(_Command { __type, __target });
+	}
+
+	bool Empty() const {
+		for(auto const& queue : _M_queue) {
+			if(!queue.commands.empty()) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// Calls __func on every command, worker by worker in recording order, then empties the queues (keeping capacity).
+	template<typename _Func>
+	void Drain(_Func const& __func) {
+		for(auto& queue : _M_queue) {
+			for(auto const& command : queue.commands) {
+				__func(command);
+			}
+			queue.commands.clear();
+		}
+	}
+
+private:
+	std::vector<_Queue> _M_queue;
+};
+
+} /* namespace manager */
+} /* namespace bul */
+
+#endif /* _BUL_MANAGER_COMMANDBUFFER_H */
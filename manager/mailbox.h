@@ -0,0 +1,290 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_MANAGER_MAILBOX_H
+#define _BUL_MANAGER_MAILBOX_H
+
+#include <type_traits>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <vector>
+
+#include "../common/handle.h"
+
+namespace bul {
+namespace manager {
+/// The messages of one type delivered to a node for the current step, in sending order (worker by worker
+/// in parallel mode). Valid until the next delivery.
+template<typename _Tp>
+class MessageRange {
+public:
+	MessageRange() : _M_begin(nullptr), _M_end(nullptr) { }
+	MessageRange(_Tp const* __begin, std::size_t __size) : _M_begin(__begin), _M_end(__begin + __size) { }
+
+	_Tp const* begin() const {
+		return _M_begin;
+	}
+
+	_Tp const* end() const {
+		return _M_end;
+	}
+
+	std::size_t size() const {
+		return static_cast<std::size_t>(_M_end - _M_begin);
+	}
+
+	bool empty() const {
+		return _M_begin == _M_end;
+	}
+
+	_Tp const& operator[](std::size_t __index) const {
+		return _M_begin[__index];
+	}
+
+private:
+	_Tp const* _M_begin;
+	_Tp const* _M_end;
+};
+
+/// Identifies a message type without RTTI: the address of a per-type tag.
+template<typename _Tp>
+struct _Message_Type {
+	static char const tag;
+
+	static std::uintptr_t Id() {
+		return reinterpret_cast<std::uintptr_t>(&tag);
+	}
+};
+
+template<typename _Tp>
+char const _Message_Type<_Tp>::tag = 0;
+
+/// Messages between the nodes of a scene. Senders append to the outbox of their worker, so that posting
+/// needs neither a lock nor an atomic; Deliver(...) buckets what was posted by recipient and type and packs
+/// it into the inbox, where the messages of one type for one node are a plain array. The outboxes and the
+/// inbox are cleared without releasing their memory, so steady-state messaging does not allocate.
+class _Mailbox final {
+	/// Storage unit of the buffers, every message starts on one.
+	typedef std::max_align_t _Word;
+
+	/// A posted message, its bytes are in the words of the outbox from __offset on.
+	struct _Record {
+		common::Handle recipient;
+		std::uintptr_t type;
+		std::uint32_t offset;
+		std::uint32_t size;
+	};
+
+	/// A worker's outbox, padded to its own cache line.
+	struct _Outbox {
+		std::vector<_Record> records;
+		std::vector<_Word> words;
+		char _padding[64 - 2 * sizeof(std::vector<_Record>) % 64];
+	};
+
+	/// A posted message to deliver.
+	struct _Entry {
+		std::uint32_t worker;
+		std::uint32_t position;
+	};
+
+	/// The messages of one type for one recipient, packed from word __offset of the inbox.
+	struct _Group {
+		std::uintptr_t type;
+		std::uint32_t offset;
+		std::uint32_t count;
+	};
+
+	/// The groups of a recipient, valid if __round is the current delivery. While delivering, __first
+	/// counts the messages of the recipient and then marks where its entries go.
+	struct _Inbox {
+		std::uint64_t round;
+		std::uint32_t generation;
+		std::uint32_t first;
+		std::uint32_t count;
+	};
+
+public:
+	_Mailbox() : _M_outbox(1), _M_round(0), _M_delivered(0) { }
+
+	/// Number of workers which may post concurrently.
+	void Resize(std::size_t __workers) {
+		_M_outbox.resize(__workers == 0 ? 1 : __workers);
+	}
+
+	/// Appends a copy of __message for __recipient to the outbox of __worker.
+	template<typename _Tp>
+	void Post(std::size_t __worker, common::Handle const& __recipient, _Tp const& __message) {
+		static_assert(std::is_trivially_copyable<_Tp>::value, "messages must be trivially copyable.");
+		static_assert(alignof(_Tp) <= alignof(_Word), "messages must not be over-aligned.");
+		if(__worker >= _M_outbox.size()) {
+			throw std::logic_error("bul::manager::_Mailbox::Post(...) : Unknown worker.");
+		}
+		_Outbox& outbox = _M_outbox[__worker];
+		std::size_t const offset = outbox.words.size();
+		if(offset + _S_Words(sizeof(_Tp)) > UINT32_MAX) {
+			throw std::length_error("bul::manager::_Mailbox::Post(...) : too many messages.");
+		}
+		outbox.words.resize(offset + _S_Words(sizeof(_Tp)));
+		std::memcpy(&outbox.words[offset], &__message, sizeof(_Tp));
+		outbox.records.push_back(_Record { __recipient, _Message_Type<_Tp>::Id(),
+				static_cast<std::uint32_t>(offset), static_cast<std::uint32_t>(sizeof(_Tp)) });
+	}
+
+	/// Number of messages posted since the last delivery.
+	std::size_t Pending() const {
+		std::size_t count = 0;
+		for(auto const& outbox : _M_outbox) {
+			count += outbox.records.size();
+		}
+		return count;
+	}
+
+	/// Number of messages in the inbox.
+	std::size_t Delivered() const {
+		return _M_delivered;
+	}
+
+	/// Replaces the inbox with the messages posted since the last delivery, dropping those whose recipient
+	/// fails __live(handle). The messages are bucketed by recipient with a counting sort, which keeps the
+	/// sending order, then grouped by type. Must not run concurrently with Post(...) or Receive(...).
+	template<typename _Live>
+	void Deliver(_Live const& __live) {
+		_M_round++;
+		_M_group.clear();
+		_M_recipient.clear();
+		_M_delivered = 0;
+
+		/// Count the messages of each live recipient, and list the recipients.
+		std::size_t words = 0;
+		for(auto& outbox : _M_outbox) {
+			for(auto& record : outbox.records) {
+				if(!__live(record.recipient)) {
+					record.recipient.Generation = 0;
+					continue;
+				}
+				if(record.recipient.Index >= _M_inbox.size()) {
+					_M_inbox.resize(record.recipient.Index + 1, _Inbox { 0, 0, 0, 0 });
+				}
+				_Inbox& inbox = _M_inbox[record.recipient.Index];
+				if(inbox.round != _M_round) {
+					inbox = _Inbox { _M_round, record.recipient.Generation, 0, 0 };
+					_M_recipient.push_back(record.recipient.Index);
+				}
+				inbox.first++;
+				_M_delivered++;
+			}
+			words += outbox.words.size();
+		}
+
+		/// Place the messages by recipient, the recipients in order of first message.
+		std::uint32_t start = 0;
+		for(auto recipient : _M_recipient) {
+			std::uint32_t const count = _M_inbox[recipient].first;
+			_M_inbox[recipient].first = start;
+			start += count;
+		}
+		_M_entry.resize(_M_delivered);
+		for(std::size_t w = 0; w < _M_outbox.size(); w++) {
+			auto const& records = _M_outbox[w].records;
+			for(std::size_t i = 0; i < records.size(); i++) {
+				if(!records[i].recipient.IsNull()) {
+					_M_entry[_M_inbox[records[i].recipient.Index].first++] = _Entry { static_cast<std::uint32_t>(w),
+							static_cast<std::uint32_t>(i) };
+				}
+			}
+		}
+
+		/// Pack the messages of each recipient, one group per type. Packed groups never take more words than
+		/// the outboxes, which round up each message.
+		_M_words.resize(words);
+		char* const inbox = reinterpret_cast<char*>(_M_words.data());
+		std::size_t cursor = 0;
+		std::size_t begin = 0;
+		for(auto recipient : _M_recipient) {
+			_Inbox& slot = _M_inbox[recipient];
+			std::size_t const end = slot.first;
+			slot.first = static_cast<std::uint32_t>(_M_group.size());
+			for(std::size_t e = begin; e < end; e++) {
+				std::uintptr_t const type = _M_Record(_M_entry[e]).type;
+				if(type == 0) {
+					continue;
+				}
+				/// Gather the messages of this type from here on, marking them as packed.
+				cursor = _S_Words(cursor) * sizeof(_Word);
+				_M_group.push_back(_Group { type, static_cast<std::uint32_t>(cursor / sizeof(_Word)), 0 });
+				slot.count++;
+				for(std::size_t f = e; f < end; f++) {
+					_Record& record = _M_Record(_M_entry[f]);
+					if(record.type == type) {
+						std::memcpy(inbox + cursor, &_M_outbox[_M_entry[f].worker].words[record.offset], record.size);
+						cursor += record.size;
+						_M_group.back().count++;
+						record.type = 0;
+					}
+				}
+			}
+			begin = end;
+		}
+
+		for(auto& outbox : _M_outbox) {
+			outbox.records.clear();
+			outbox.words.clear();
+		}
+	}
+
+	/// The messages of type _Tp delivered to __recipient.
+	template<typename _Tp>
+	MessageRange<_Tp> Receive(common::Handle const& __recipient) const {
+		if(__recipient.Index >= _M_inbox.size()) {
+			return MessageRange<_Tp>();
+		}
+		_Inbox const& inbox = _M_inbox[__recipient.Index];
+		if(inbox.round != _M_round || inbox.generation != __recipient.Generation) {
+			return MessageRange<_Tp>();
+		}
+		for(std::uint32_t g = inbox.first; g < inbox.first + inbox.count; g++) {
+			if(_M_group[g].type == _Message_Type<_Tp>::Id()) {
+				return MessageRange<_Tp>(reinterpret_cast<_Tp const*>(&_M_words[_M_group[g].offset]), _M_group[g].count);
+			}
+		}
+		return MessageRange<_Tp>();
+	}
+
+	/// Drops the pending and delivered messages, keeping the buffers.
+	void Clear() {
+		for(auto& outbox : _M_outbox) {
+			outbox.records.clear();
+			outbox.words.clear();
+		}
+		_M_round++;
+		_M_delivered = 0;
+	}
+
+private:
+	_Record& _M_Record(_Entry const& __entry) {
+		return _M_outbox[__entry.worker].records[__entry.position];
+	}
+
+	static std::size_t _S_Words(std::size_t __bytes) {
+		return (__bytes + sizeof(_Word) - 1) / sizeof(_Word);
+	}
+
+	std::vector<_Outbox> _M_outbox;
+	std::vector<_Entry> _M_entry;
+	std::vector<std::uint32_t> _M_recipient;
+	std::vector<_Group> _M_group;
+	std::vector<_Inbox> _M_inbox;
+	std::vector<_Word> _M_words;
+	std::uint64_t _M_round;
+	std::size_t _M_delivered;
+};
+
+} /* namespace manager */
+} /* namespace bul */
+
+#endif /* _BUL_MANAGER_MAILBOX_H */
@@ -0,0 +1,110 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_MANAGER_PROFILINGMONITOR_H
+#define _BUL_MANAGER_PROFILINGMONITOR_H
+
+#include <iostream>
+#include <vector>
+
+#include "../common/profiler.h"
+#include "monitor.h"
+
+namespace bul {
+namespace manager {
+/// Reports where step time went. Needs BUL_PROFILING to be defined, otherwise nothing is recorded.
+class ProfilingMonitor : public Monitor {
+public:
+	/// Configuration for a profiling monitor.
+	struct Configuration {
+		Configuration() { }
+		virtual ~Configuration() { }
+
+		/// Number of hotspots listed per category.
+		std::size_t Top = 10;
+		std::ostream* Output = &std::cerr;
+	};
+
+	ProfilingMonitor(Configuration* __conf) : _M_top(__conf->Top), _M_output(__conf->Output) { }
+	virtual ~ProfilingMonitor() { }
+
+	/// Results of the last run.
+	common::Histogram const& GetPhase(common::Profile_Phase __phase) const {
+		return _M_phase[static_cast<std::size_t>(__phase)];
+	}
+
+	std::vector<common::ProfileEntry> const& GetTopNodes() const {
+		return _M_nodes;
+	}
+
+	std::vector<common::ProfileEntry> const& GetTopComponentTypes() const {
+		return _M_component_types;
+	}
+
+	std::vector<common::ProfileEntry> const& GetTopPriorities() const {
+		return _M_priorities;
+	}
+
+protected:
+	virtual void Initialize() override {
+		common::Profiler::Instance().Reset();
+	}
+
+	virtual void Step() override { }
+
+	virtual void Finalize() override {
+		auto& profiler = common::Profiler::Instance();
+		for(std::size_t i = 0; i < common::_S_profile_phase_count; i++) {
+			_M_phase[i] = profiler.Phase(static_cast<common::Profile_Phase>(i));
+		}
+		_M_nodes = profiler.TopNodes(_M_top);
+		_M_component_types = profiler.TopComponentTypes(_M_top);
+		_M_priorities = profiler.TopPriorities(_M_top);
+
+		if(_M_output != nullptr) {
+			_M_Print(*_M_output);
+		}
+	}
+
+	void _M_Print(std::ostream& __out) const {
+#ifndef BUL_PROFILING
+		__out << "[profiling] disabled, define BUL_PROFILING to record timings." << std::endl;
+#endif
+		static const char* const phase_name[] = { "PreStep", "Actors", "Triggers", "PostStep", "Monitors" };
+		__out << "[profiling] phases (total ms / mean us / p99 us)" << std::endl;
+		for(std::size_t i = 0; i < common::_S_profile_phase_count; i++) {
+			_S_Print_Entry(__out, phase_name[i], _M_phase[i]);
+		}
+		_S_Print_Top(__out, "nodes", _M_nodes);
+		_S_Print_Top(__out, "component types", _M_component_types);
+		_S_Print_Top(__out, "component priorities", _M_priorities);
+	}
+
+	static void _S_Print_Top(std::ostream& __out, const char* __title, std::vector<common::ProfileEntry> const& __entries) {
+		__out << "[profiling] top " << __title << std::endl;
+		for(auto& entry : __entries) {
+			_S_Print_Entry(__out, entry.Name.c_str(), entry.Time);
+		}
+	}
+
+	static void _S_Print_Entry(std::ostream& __out, const char* __name, common::Histogram const& __time) {
+		double mean = __time.Count > 0 ? static_cast<double>(__time.Total) / __time.Count : 0.0;
+		__out << "  " << __name << " : " << __time.Total / 1e6 << " / " << mean / 1e3
+				<< " / " << __time.Quantile(0.99) / 1e3 << " (" << __time.Count << " calls)" << std::endl;
+	}
+
+private:
+	std::size_t const _M_top;
+	std::ostream* const _M_output;
+
+	common::Histogram _M_phase[common::_S_profile_phase_count];
+	std::vector<common::ProfileEntry> _M_nodes;
+	std::vector<common::ProfileEntry> _M_component_types;
+	std::vector<common::ProfileEntry> _M_priorities;
+};
+
+} /* namespace manager */
+} /* namespace bul */
+
+#endif /* _BUL_MANAGER_PROFILINGMONITOR_H */
@@ -0,0 +1,929 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_MANAGER_REPLAY_H
+#define _BUL_MANAGER_REPLAY_H
+
+#include <stdexcept>
+#include <exception>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../common/mappedfile.h"
+#include "../dynamics/actor.h"
+#include "monitor.h"
+#include "scenemgr.h"
+
+namespace bul {
+namespace manager {
+/// Layout of a replay log: a header, one frame per recorded step, then, once the run is over, the keyframe
+/// index and a trailer. A frame is its byte length (varint), its kind, its step (varint) and operations.
+/// Delta frames hold what changed since the previous frame, keyframes restate every node.
+struct ReplayHeader {
+	char Magic[8];
+	std::uint32_t Version;
+	std::uint32_t Reserved;
+	std::uint64_t KeyframeInterval;
+};
+
+/// A keyframe, __Offset is the position of its frame in the log.
+struct ReplayIndexEntry {
+	std::uint64_t Step;
+	std::uint64_t Offset;
+};
+
+/// Ends a complete log. The index has __Count entries and starts at __Index, where the frames end.
+struct ReplayTrailer {
+	std::uint64_t Index;
+	std::uint64_t Count;
+	std::uint64_t Frames;
+	std::uint64_t LastStep;
+	char Magic[8];
+};
+
+static const char _S_replay_magic[8] = { 'B', 'U', 'L', 'R', 'P', 'L', 'Y', '\0' };
+static const char _S_replay_index_magic[8] = { 'B', 'U', 'L', 'R', 'I', 'D', 'X', '\0' };
+static const std::uint32_t _S_replay_version = 1;
+
+/// Kinds of frames.
+enum class Replay_Frame : std::uint8_t {
+	Delta,
+	Keyframe
+};
+
+/// Operations of a frame, with their operands.
+enum class Replay_Op : std::uint8_t {
+	/// id, node type (byte), tag, flag: the node appeared, or is restated by a keyframe, with an empty pool.
+	AddNode,
+	/// id.
+	RemoveNode,
+	/// id, flag.
+	SetFlag,
+	/// id, size: the pool was resized, new slots are zero.
+	Resize,
+	/// id, byte length of the entries, then per changed slot: gap from the previous one, mask (byte), the
+	/// zigzag difference of the int if mask & 1 and the xor of the float bits if mask & 2.
+	Slots
+};
+
+/// LEB128 varints and zigzag coding.
+struct _Varint {
+	static void Put(std::vector<char>& __out, std::uint64_t __value) {
+		while(__value >= 0x80) {
+			__out.push_back(static_cast<char>(__value | 0x80));
+			__value >>= 7;
+		}
+		__out.push_back(static_cast<char>(__value));
+	}
+
+	static std::uint64_t Get(const char*& __data, const char* __end) {
+		std::uint64_t value = 0;
+		for(unsigned int shift = 0; shift < 64; shift += 7) {
+			if(__data >= __end) {
+				throw std::runtime_error("bul::manager::_Varint::Get(...) : truncated replay log.");
+			}
+			std::uint8_t const byte = static_cast<std::uint8_t>(*__data++);
+			value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+			if((byte & 0x80) == 0) {
+				return value;
+			}
+		}
+		throw std::runtime_error("bul::manager::_Varint::Get(...) : malformed replay log.");
+	}
+
+	static std::uint64_t Zigzag(std::int64_t __value) {
+		return (static_cast<std::uint64_t>(__value) << 1) ^ static_cast<std::uint64_t>(__value >> 63);
+	}
+
+	static std::int64_t Unzigzag(std::uint64_t __value) {
+		return static_cast<std::int64_t>(__value >> 1) ^ -static_cast<std::int64_t>(__value & 1);
+	}
+
+	static std::uint32_t Bits(float __value) {
+		std::uint32_t bits;
+		std::memcpy(&bits, &__value, sizeof(bits));
+		return bits;
+	}
+
+	static float Float(std::uint32_t __bits) {
+		float value;
+		std::memcpy(&value, &__bits, sizeof(value));
+		return value;
+	}
+};
+
+/// Appends chunks to a file on a background thread. Written chunks are kept for reuse, so that a steady
+/// recording does not allocate.
+class _Replay_Writer {
+public:
+	_Replay_Writer() : _M_file(nullptr), _M_queue_size(1), _M_stop(false) { }
+	~_Replay_Writer() {
+		try {
+			Close();
+		} catch(...) {
+		}
+	}
+
+	_Replay_Writer(_Replay_Writer const&) = delete;
+	_Replay_Writer& operator=(_Replay_Writer const&) = delete;
+
+	/// Truncates __path and starts the writing thread, at most __queue_size chunks wait to be written.
+	void Open(std::string const& __path, std::size_t __queue_size) {
+		Close();
+		_M_file = std::fopen(__path.c_str(), "wb");
+		if(_M_file == nullptr) {
+			throw std::runtime_error("bul::manager::_Replay_Writer::Open(...) : cannot open '" + __path + "'.");
+		}
+		_M_path = __path;
+		_M_queue_size = __queue_size == 0 ? 1 : __queue_size;
+		_M_stop = false;
+		_M_thread = std::thread(&_Replay_Writer::_M_Loop, this);
+	}
+
+	/// Queues __chunk and leaves an empty buffer in its place, blocks while the queue is full.
+	void Push(std::vector<char>& __chunk) {
+		std::unique_lock<std::mutex> lock(_M_mutex);
+		_M_not_full.wait(lock, [this] { return _M_queue.size() < _M_queue_size || _M_error; });
+		_M_Check();
+		_M_queue.push_back(std::vector<char>());
+		_M_queue.back().swap(__chunk);
+		if(!_M_free.empty()) {
+			__chunk.swap(_M_free.back());
+			_M_free.pop_back();
+		}
+		_M_not_empty.notify_one();
+	}
+
+	/// Writes what is queued, closes the file and reports the failure of a write, if any.
+	void Close() {
+		if(_M_thread.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock(_M_mutex);
+				_M_stop = true;
+			}
+			_M_not_empty.notify_one();
+			_M_thread.join();
+		}
+		if(_M_file != nullptr) {
+			if(std::fclose(_M_file) != 0 && !_M_error) {
+				_M_error = std::make_exception_ptr(std::runtime_error(
+						"bul::manager::_Replay_Writer::Close() : cannot write '" + _M_path + "'."));
+			}
+			_M_file = nullptr;
+		}
+		_M_queue.clear();
+		std::lock_guard<std::mutex> lock(_M_mutex);
+		_M_Check();
+	}
+
+private:
+	/// Reports the failure of a write, if any. Expects the lock to be held.
+	void _M_Check() {
+		if(_M_error) {
+			std::exception_ptr error = _M_error;
+			_M_error = nullptr;
+			std::rethrow_exception(error);
+		}
+	}
+
+	void _M_Loop() {
+		while(true) {
+			std::vector<char> chunk;
+			{
+				std::unique_lock<std::mutex> lock(_M_mutex);
+				_M_not_empty.wait(lock, [this] { return _M_stop || !_M_queue.empty(); });
+				if(_M_queue.empty()) {
+					return;
+				}
+				chunk.swap(_M_queue.front());
+				_M_queue.pop_front();
+			}
+
+			bool const written = std::fwrite(chunk.data(), 1, chunk.size(), _M_file) == chunk.size();
+			chunk.clear();
+			std::lock_guard<std::mutex> lock(_M_mutex);
+			_M_free.push_back(std::vector<char>());
+			_M_free.back().swap(chunk);
+			if(!written) {
+				_M_error = std::make_exception_ptr(std::runtime_error(
+						"bul::manager::_Replay_Writer : cannot write '" + _M_path + "'."));
+				_M_queue.clear();
+				_M_not_full.notify_one();
+				return;
+			}
+			_M_not_full.notify_one();
+		}
+	}
+
+	std::FILE* _M_file;
+	std::string _M_path;
+	std::size_t _M_queue_size;
+
+	std::mutex _M_mutex;
+	std::condition_variable _M_not_empty;
+	std::condition_variable _M_not_full;
+	std::deque<std::vector<char>> _M_queue;
+	std::vector<std::vector<char>> _M_free;
+	std::thread _M_thread;
+	bool _M_stop;
+	std::exception_ptr _M_error;
+};
+
+/// Records the scene to a replay log after every step: nodes appearing and disappearing, flag changes and
+/// the int and float values of the DataPool slots which changed (pointers are not recorded). The changes
+/// are found by comparing with the values of the previous step, only in the slots written since then for
+/// actors which track them (Actor::Configuration::TrackDirtyData). They are encoded on the scene thread
+/// and written by a background thread. Read the log back with ReplayReader. The schema slots of a
+/// SchemaActor are not recorded, its node appears with an empty DataPool.
+class ReplayRecorder : public Monitor {
+public:
+	/// Configuration for a replay recorder.
+	struct Configuration {
+		Configuration() { }
+		virtual ~Configuration() { }
+
+		std::string Path;
+		/// Every KeyframeInterval-th frame restates the whole scene, 0 keeps the first one only. Seeking
+		/// replays at most this many frames.
+		std::size_t KeyframeInterval = 100;
+		/// Bytes buffered before they are handed to the writing thread.
+		std::size_t ChunkSize = 1 << 20;
+		/// Chunks waiting to be written, the scene blocks when the writing thread is this far behind.
+		std::size_t QueueSize = 4;
+	};
+
+	ReplayRecorder(Configuration* __conf) : _M_path(__conf->Path), _M_keyframe_interval(__conf->KeyframeInterval),
+			_M_chunk_size(__conf->ChunkSize), _M_queue_size(__conf->QueueSize) {
+		_M_round = 0;
+		_M_frames = 0;
+		_M_offset = 0;
+	}
+	virtual ~ReplayRecorder() { }
+
+	/// Number of frames recorded, and bytes handed to the writer or buffered, in the current run.
+	std::size_t GetFrames() const {
+		return _M_frames;
+	}
+
+	std::uint64_t GetBytes() const {
+		return _M_offset + _M_chunk.size();
+	}
+
+protected:
+	virtual void Initialize() override {
+		_M_tracked.clear();
+		_M_index.clear();
+		_M_chunk.clear();
+		_M_frames = 0;
+		_M_offset = 0;
+		_M_last_step = 0;
+		_M_writer.Open(_M_path, _M_queue_size);
+
+		ReplayHeader header;
+		std::memcpy(header.Magic, _S_replay_magic, sizeof(header.Magic));
+		header.Version = _S_replay_version;
+		header.Reserved = 0;
+		header.KeyframeInterval = _M_keyframe_interval;
+		_M_Append(&header, sizeof(header));
+	}
+
+	virtual void Step() override {
+		auto scenemgr = GetSceneMgr();
+		bool const keyframe = _M_frames == 0 || (_M_keyframe_interval > 0 && _M_frames % _M_keyframe_interval == 0);
+		_M_round++;
+		_M_body.clear();
+
+		std::size_t seen = 0;
+		static const dynamics::Node_Type types[] = { dynamics::Node_Type::Actor, dynamics::Node_Type::Object,
+				dynamics::Node_Type::Trigger };
+		for(auto type : types) {
+			if(scenemgr->CountNodesByType(type) == 0) {
+				continue;
+			}
+			for(auto node : scenemgr->GetNodesByType(type)) {
+				_M_Record_Node(node, keyframe);
+				seen++;
+			}
+		}
+		/// Nodes which were not seen are gone, a keyframe drops them silently.
+		if(_M_tracked.size() > seen) {
+			for(auto tracked = _M_tracked.begin(); tracked != _M_tracked.end();) {
+				if((*tracked).second.round == _M_round) {
+					++tracked;
+					continue;
+				}
+				if(!keyframe) {
+					_M_body.push_back(static_cast<char>(Replay_Op::RemoveNode));
+					_Varint::Put(_M_body, (*tracked).first);
+				}
+				tracked = _M_tracked.erase(tracked);
+			}
+		}
+
+		std::size_t const step = scenemgr->GetCurrentStep();
+		_M_head.clear();
+		_M_head.push_back(static_cast<char>(keyframe ? Replay_Frame::Keyframe : Replay_Frame::Delta));
+		_Varint::Put(_M_head, step);
+		if(keyframe) {
+			_M_index.push_back(ReplayIndexEntry { step, GetBytes() });
+		}
+		_Varint::Put(_M_chunk, _M_head.size() + _M_body.size());
+		_M_chunk.insert(_M_chunk.end(), _M_head.begin(), _M_head.end());
+		_M_chunk.insert(_M_chunk.end(), _M_body.begin(), _M_body.end());
+		_M_frames++;
+		_M_last_step = step;
+		if(_M_chunk.size() >= _M_chunk_size) {
+			_M_Flush();
+		}
+	}
+
+	/// Writes the keyframe index and the trailer, and waits for the log to be on disk.
+	virtual void Finalize() override {
+		ReplayTrailer trailer;
+		trailer.Index = GetBytes();
+		trailer.Count = _M_index.size();
+		trailer.Frames = _M_frames;
+		trailer.LastStep = _M_last_step;
+		std::memcpy(trailer.Magic, _S_replay_index_magic, sizeof(trailer.Magic));
+		if(!_M_index.empty()) {
+			_M_Append(_M_index.data(), _M_index.size() * sizeof(ReplayIndexEntry));
+		}
+		_M_Append(&trailer, sizeof(trailer));
+		_M_Flush();
+		_M_writer.Close();
+	}
+
+private:
+	/// The last recorded state of a node, __round tells whether it was seen in the current step. The handle
+	/// tells a node from another one which took its Id within a step.
+	struct _Tracked {
+		common::Handle handle;
+		std::uint64_t round;
+		unsigned int flag;
+		std::vector<int> ints;
+		std::vector<std::uint32_t> floats;
+	};
+
+	void _M_Record_Node(dynamics::Node const* __node, bool __keyframe) {
+		std::uint64_t const id = __node->GetId();
+		auto found = _M_tracked.find(id);
+		if(found == _M_tracked.end()) {
+			found = _M_tracked.emplace(id, _Tracked()).first;
+		}
+		_Tracked& tracked = (*found).second;
+		/// A node removed and another added with the same Id is restated whole: AddNode replaces the old one.
+		bool const fresh = tracked.round == 0 || tracked.handle != __node->GetHandle();
+		tracked.handle = __node->GetHandle();
+		tracked.round = _M_round;
+
+		if(fresh || __keyframe) {
+			_M_body.push_back(static_cast<char>(Replay_Op::AddNode));
+			_Varint::Put(_M_body, id);
+			_M_body.push_back(static_cast<char>(__node->GetType()));
+			_Varint::Put(_M_body, __node->GetTag());
+			_Varint::Put(_M_body, __node->GetFlag());
+			tracked.flag = __node->GetFlag();
+			tracked.ints.clear();
+			tracked.floats.clear();
+		} else if(tracked.flag != __node->GetFlag()) {
+			_M_body.push_back(static_cast<char>(Replay_Op::SetFlag));
+			_Varint::Put(_M_body, id);
+			_Varint::Put(_M_body, __node->GetFlag());
+			tracked.flag = __node->GetFlag();
+		}
+
+		if(__node->GetType() != dynamics::Node_Type::Actor) {
+			return;
+		}
+		auto const& datapool = static_cast<dynamics::Actor const*>(__node)->GetDataPool();
+		std::size_t const size = datapool.Size();
+		if(size != tracked.ints.size()) {
+			_M_body.push_back(static_cast<char>(Replay_Op::Resize));
+			_Varint::Put(_M_body, id);
+			_Varint::Put(_M_body, size);
+			tracked.ints.resize(size, 0);
+			tracked.floats.resize(size, 0);
+		}
+
+		_M_slots.clear();
+		std::size_t next = 0;
+		if(datapool.IsTrackingDirty() && !fresh && !__keyframe) {
+			/// The scene clears the dirty slots after the monitors, so the others still hold what was recorded.
+			datapool.ForEachDirty([&](std::size_t __index) {
+				_M_Diff_Slot(datapool, tracked, __index, next);
+			});
+		} else {
+			for(std::size_t i = 0; i < size; i++) {
+				_M_Diff_Slot(datapool, tracked, i, next);
+			}
+		}
+		if(!_M_slots.empty()) {
+			_M_body.push_back(static_cast<char>(Replay_Op::Slots));
+			_Varint::Put(_M_body, id);
+			_Varint::Put(_M_body, _M_slots.size());
+			_M_body.insert(_M_body.end(), _M_slots.begin(), _M_slots.end());
+		}
+	}
+
+	/// Appends the change of slot __index to the scratch buffer, __next follows the last slot appended.
+	void _M_Diff_Slot(dynamics::Actor::datapool_type const& __datapool, _Tracked& __tracked, std::size_t __index,
+			std::size_t& __next) {
+		int const value = __datapool.Get<int>(__index);
+		std::uint32_t const bits = _Varint::Bits(__datapool.Get<float>(__index));
+		std::uint8_t const mask = (value != __tracked.ints[__index] ? 1 : 0) | (bits != __tracked.floats[__index] ? 2 : 0);
+		if(mask == 0) {
+			return;
+		}
+		_Varint::Put(_M_slots, __index - __next);
+		_M_slots.push_back(static_cast<char>(mask));
+		if(mask & 1) {
+			_Varint::Put(_M_slots, _Varint::Zigzag(static_cast<std::int64_t>(value) - __tracked.ints[__index]));
+			__tracked.ints[__index] = value;
+		}
+		if(mask & 2) {
+			_Varint::Put(_M_slots, bits ^ __tracked.floats[__index]);
+			__tracked.floats[__index] = bits;
+		}
+		__next = __index + 1;
+	}
+
+	void _M_Append(const void* __data, std::size_t __size) {
+		const char* bytes = static_cast<const char*>(__data);
+		_M_chunk.insert(_M_chunk.end(), bytes, bytes + __size);
+	}
+
+	void _M_Flush() {
+		if(!_M_chunk.empty()) {
+			_M_offset += _M_chunk.size();
+			_M_writer.Push(_M_chunk);
+		}
+	}
+
+	std::string const _M_path;
+	std::size_t const _M_keyframe_interval;
+	std::size_t const _M_chunk_size;
+	std::size_t const _M_queue_size;
+
+	std::unordered_map<std::uint64_t, _Tracked> _M_tracked;
+	std::uint64_t _M_round;
+	std::size_t _M_frames;
+	std::size_t _M_last_step;
+	std::vector<ReplayIndexEntry> _M_index;
+
+	/// Bytes handed to the writer so far, the chunk being filled, and scratch buffers of the frame.
+	std::uint64_t _M_offset;
+	std::vector<char> _M_chunk;
+	std::vector<char> _M_head;
+	std::vector<char> _M_body;
+	std::vector<char> _M_slots;
+	_Replay_Writer _M_writer;
+};
+
+/// Reads a replay log through a memory mapping. The reader is a cursor over the frames: Seek(...) restores
+/// the state of any step from the nearest keyframe, Next() moves one frame on. A log without trailer (the
+/// run did not finish) is indexed by walking the frame headers, up to the last complete frame.
+class ReplayReader final {
+public:
+	/// The recorded state of a node.
+	struct NodeState {
+		dynamics::Node_Type Type;
+		unsigned int Tag;
+		unsigned int Flag;
+		std::vector<int> Ints;
+		std::vector<float> Floats;
+	};
+
+	typedef std::unordered_map<std::size_t, NodeState> state_type;
+
+	ReplayReader(std::string const& __path) : _M_file(__path) {
+		if(_M_file.Size() < sizeof(ReplayHeader)) {
+			throw std::runtime_error("bul::manager::ReplayReader::ReplayReader(...) : '" + __path + "' is not a replay log.");
+		}
+		ReplayHeader header;
+		std::memcpy(&header, _M_file.Data(), sizeof(header));
+		if(std::memcmp(header.Magic, _S_replay_magic, sizeof(header.Magic)) != 0 || header.Version != _S_replay_version) {
+			throw std::runtime_error("bul::manager::ReplayReader::ReplayReader(...) : '" + __path + "' is not a replay log.");
+		}
+		_M_keyframe_interval = header.KeyframeInterval;
+		_M_begin = _M_file.Data() + sizeof(header);
+		if(!_M_Load_Index()) {
+			_M_Scan_Index();
+		}
+		Rewind();
+	}
+
+	ReplayReader(ReplayReader const&) = delete;
+	ReplayReader& operator=(ReplayReader const&) = delete;
+
+	/// Whether the log has its trailer, i.e. the run finished.
+	bool IsComplete() const {
+		return _M_complete;
+	}
+
+	std::size_t GetFrameCount() const {
+		return _M_frames;
+	}
+
+	/// Step of the last frame, 0 if there is none.
+	std::size_t GetLastStep() const {
+		return _M_last_step;
+	}
+
+	std::size_t GetKeyframeInterval() const {
+		return _M_keyframe_interval;
+	}
+
+	std::vector<ReplayIndexEntry> const& GetKeyframes() const {
+		return _M_index;
+	}
+
+	/// Moves before the first frame, the state is empty.
+	void Rewind() {
+		_M_position = _M_begin;
+		_M_state.clear();
+		_M_has_step = false;
+		_M_step = 0;
+	}
+
+	/// Restores the state at the end of the last frame whose step is __step or earlier, replaying at most
+	/// one keyframe interval of frames. Returns false (and rewinds) if every frame is later.
+	bool Seek(std::size_t __step) {
+		auto keyframe = std::upper_bound(_M_index.begin(), _M_index.end(), __step,
+				[](std::size_t __target, ReplayIndexEntry const& __entry) {
+			return __target < __entry.Step;
+		});
+		if(keyframe == _M_index.begin()) {
+			Rewind();
+		} else if(!_M_has_step || _M_step > __step || (*(keyframe - 1)).Step > _M_step) {
+			/// Replay from the keyframe unless the cursor is already between it and __step.
+			Rewind();
+			_M_position = _M_file.Data() + (*(keyframe - 1)).Offset;
+		}
+		std::size_t step;
+		while(_M_Peek(_M_position, step) && step <= __step) {
+			Next();
+		}
+		return _M_has_step;
+	}
+
+	/// Applies the next frame, returns false at the end of the log.
+	bool Next() {
+		if(_M_position >= _M_end) {
+			return false;
+		}
+		_State_Visitor visitor(_M_state);
+		_M_position = _M_Decode(_M_position, visitor);
+		_M_step = visitor.step;
+		_M_has_step = true;
+		return true;
+	}
+
+	/// Whether a frame was applied, and its step.
+	bool HasStep() const {
+		return _M_has_step;
+	}
+
+	std::size_t GetStep() const {
+		return _M_step;
+	}
+
+	state_type const& GetState() const {
+		return _M_state;
+	}
+
+	/// The state of a node, nullptr if it does not exist at the current step.
+	NodeState const* GetNode(std::size_t __id) const {
+		auto found = _M_state.find(__id);
+		return found != _M_state.end() ? &(*found).second : nullptr;
+	}
+
+	/// Calls __func(step, int value, float value) with the value of slot __slot of node __id at __first (as
+	/// restored by Seek(__first)), then at every later step up to __last where it changed, while the node
+	/// exists and the slot is in its pool. Only the entries of this node are decoded, those of the other
+	/// nodes are skipped by length. The cursor of the reader is not moved.
+	template<typename _Func>
+	void ForEachSlotValue(std::size_t __id, std::size_t __slot, std::size_t __first, std::size_t __last,
+			_Func const& __func) const {
+		auto keyframe = std::upper_bound(_M_index.begin(), _M_index.end(), __first,
+				[](std::size_t __target, ReplayIndexEntry const& __entry) {
+			return __target < __entry.Step;
+		});
+		const char* position = keyframe == _M_index.begin() ? _M_begin : _M_file.Data() + (*(keyframe - 1)).Offset;
+		_Slot_Visitor visitor(__id, __slot);
+		std::size_t step;
+		while(_M_Peek(position, step) && step <= __first) {
+			position = _M_Decode(position, visitor);
+		}
+
+		bool reported = false;
+		int value = 0;
+		std::uint32_t bits = 0;
+		auto report = [&](std::size_t __step) {
+			if(!visitor.present || __slot >= visitor.size) {
+				reported = false;
+				return;
+			}
+			if(!reported || visitor.value != value || visitor.bits != bits) {
+				reported = true;
+				value = visitor.value;
+				bits = visitor.bits;
+				__func(__step, value, _Varint::Float(bits));
+			}
+		};
+		report(__first);
+		while(_M_Peek(position, step) && step <= __last) {
+			position = _M_Decode(position, visitor);
+			report(step);
+		}
+	}
+
+private:
+	/// Applies frames to a full state.
+	struct _State_Visitor {
+		_State_Visitor(state_type& __state) : state(__state), current(nullptr), step(0) { }
+
+		void Begin(bool __keyframe, std::size_t __step) {
+			if(__keyframe) {
+				state.clear();
+			}
+			step = __step;
+		}
+
+		void Add(std::size_t __id, dynamics::Node_Type __type, unsigned int __tag, unsigned int __flag) {
+			state[__id] = NodeState { __type, __tag, __flag, std::vector<int>(), std::vector<float>() };
+		}
+
+		void Remove(std::size_t __id) {
+			state.erase(__id);
+		}
+
+		void Flag(std::size_t __id, unsigned int __flag) {
+			_M_Node(__id).Flag = __flag;
+		}
+
+		void Resize(std::size_t __id, std::size_t __size) {
+			NodeState& node = _M_Node(__id);
+			node.Ints.resize(__size, 0);
+			node.Floats.resize(__size, 0.0f);
+		}
+
+		bool Wants(std::size_t __id) {
+			current = &_M_Node(__id);
+			return true;
+		}
+
+		void Slot(std::size_t __slot, std::uint8_t __mask, std::int64_t __difference, std::uint32_t __bits) {
+			if(__slot >= current->Ints.size()) {
+				throw std::runtime_error("bul::manager::ReplayReader : slot out of range in replay log.");
+			}
+			if(__mask & 1) {
+				current->Ints[__slot] = static_cast<int>(current->Ints[__slot] + __difference);
+			}
+			if(__mask & 2) {
+				current->Floats[__slot] = _Varint::Float(_Varint::Bits(current->Floats[__slot]) ^ __bits);
+			}
+		}
+
+		NodeState& _M_Node(std::size_t __id) {
+			auto found = state.find(__id);
+			if(found == state.end()) {
+				throw std::runtime_error("bul::manager::ReplayReader : unknown node in replay log.");
+			}
+			return (*found).second;
+		}
+
+		state_type& state;
+		NodeState* current;
+		std::size_t step;
+	};
+
+	/// Follows one slot of one node.
+	struct _Slot_Visitor {
+		_Slot_Visitor(std::size_t __id, std::size_t __slot) : id(__id), slot(__slot), present(false), size(0),
+				value(0), bits(0) { }
+
+		void Begin(bool __keyframe, std::size_t) {
+			if(__keyframe) {
+				present = false;
+			}
+		}
+
+		void Add(std::size_t __id, dynamics::Node_Type, unsigned int, unsigned int) {
+			if(__id == id) {
+				present = true;
+				size = 0;
+				value = 0;
+				bits = 0;
+			}
+		}
+
+		void Remove(std::size_t __id) {
+			if(__id == id) {
+				present = false;
+			}
+		}
+
+		void Flag(std::size_t, unsigned int) { }
+
+		void Resize(std::size_t __id, std::size_t __size) {
+			if(__id == id) {
+				if(slot >= __size) {
+					value = 0;
+					bits = 0;
+				}
+				size = __size;
+			}
+		}
+
+		bool Wants(std::size_t __id) {
+			return __id == id;
+		}
+
+		void Slot(std::size_t __slot, std::uint8_t __mask, std::int64_t __difference, std::uint32_t __bits) {
+			if(__slot != slot) {
+				return;
+			}
+			if(__mask & 1) {
+				value = static_cast<int>(value + __difference);
+			}
+			if(__mask & 2) {
+				bits ^= __bits;
+			}
+		}
+
+		std::size_t const id;
+		std::size_t const slot;
+		bool present;
+		std::size_t size;
+		int value;
+		std::uint32_t bits;
+	};
+
+	/// Reads the step of the frame at __position, false at the end of the frames.
+	bool _M_Peek(const char* __position, std::size_t& __step) const {
+		if(__position >= _M_end) {
+			return false;
+		}
+		std::uint64_t const length = _Varint::Get(__position, _M_end);
+		if(length > static_cast<std::uint64_t>(_M_end - __position) || length == 0) {
+			throw std::runtime_error("bul::manager::ReplayReader : truncated replay log.");
+		}
+		const char* const end = __position + length;
+		__position++;
+		__step = _Varint::Get(__position, end);
+		return true;
+	}
+
+	/// Decodes the frame at __position into __visitor, returns the next frame.
+	template<typename _Visitor>
+	const char* _M_Decode(const char* __position, _Visitor& __visitor) const {
+		std::uint64_t const length = _Varint::Get(__position, _M_end);
+		if(length > static_cast<std::uint64_t>(_M_end - __position) || length == 0) {
+			throw std::runtime_error("bul::manager::ReplayReader : truncated replay log.");
+		}
+		const char* const end = __position + length;
+		Replay_Frame const kind = static_cast<Replay_Frame>(*__position++);
+		__visitor.Begin(kind == Replay_Frame::Keyframe, _Varint::Get(__position, end));
+		while(__position < end) {
+			Replay_Op const op = static_cast<Replay_Op>(*__position++);
+			std::size_t const id = _Varint::Get(__position, end);
+			switch(op) {
+			case Replay_Op::AddNode: {
+				if(__position == end) {
+					throw std::runtime_error("bul::manager::ReplayReader : truncated replay log.");
+				}
+				dynamics::Node_Type const type = static_cast<dynamics::Node_Type>(*__position++);
+				unsigned int const tag = static_cast<unsigned int>(_Varint::Get(__position, end));
+				unsigned int const flag = static_cast<unsigned int>(_Varint::Get(__position, end));
+				__visitor.Add(id, type, tag, flag);
+				break;
+			}
+			case Replay_Op::RemoveNode:
+				__visitor.Remove(id);
+				break;
+			case Replay_Op::SetFlag:
+				__visitor.Flag(id, static_cast<unsigned int>(_Varint::Get(__position, end)));
+				break;
+			case Replay_Op::Resize:
+				__visitor.Resize(id, _Varint::Get(__position, end));
+				break;
+			case Replay_Op::Slots: {
+				std::uint64_t const bytes = _Varint::Get(__position, end);
+				if(bytes > static_cast<std::uint64_t>(end - __position)) {
+					throw std::runtime_error("bul::manager::ReplayReader : truncated replay log.");
+				}
+				const char* const slots_end = __position + bytes;
+				if(__visitor.Wants(id)) {
+					std::size_t slot = 0;
+					while(__position < slots_end) {
+						slot += _Varint::Get(__position, slots_end);
+						if(__position == slots_end) {
+							throw std::runtime_error("bul::manager::ReplayReader : truncated replay log.");
+						}
+						std::uint8_t const mask = static_cast<std::uint8_t>(*__position++);
+						std::int64_t const difference = mask & 1 ? _Varint::Unzigzag(_Varint::Get(__position, slots_end)) : 0;
+						std::uint32_t const bits = mask & 2 ? static_cast<std::uint32_t>(_Varint::Get(__position, slots_end)) : 0;
+						__visitor.Slot(slot, mask, difference, bits);
+						slot++;
+					}
+				}
+				__position = slots_end;
+				break;
+			}
+			default:
+				throw std::runtime_error("bul::manager::ReplayReader : malformed replay log.");
+			}
+		}
+		return end;
+	}
+
+	/// Uses the index written at the end of a complete log.
+	bool _M_Load_Index() {
+		const char* const data = _M_file.Data();
+		std::size_t const size = _M_file.Size();
+		ReplayTrailer trailer;
+		if(size < sizeof(ReplayHeader) + sizeof(trailer)) {
+			return false;
+		}
+		std::memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+		if(std::memcmp(trailer.Magic, _S_replay_index_magic, sizeof(trailer.Magic)) != 0 ||
+				trailer.Index < sizeof(ReplayHeader) || trailer.Index > size - sizeof(trailer) ||
+				trailer.Count != (size - sizeof(trailer) - trailer.Index) / sizeof(ReplayIndexEntry) ||
+				trailer.Index + trailer.Count * sizeof(ReplayIndexEntry) + sizeof(trailer) != size) {
+			return false;
+		}
+		_M_index.resize(trailer.Count);
+		if(trailer.Count > 0) {
+			std::memcpy(_M_index.data(), data + trailer.Index, trailer.Count * sizeof(ReplayIndexEntry));
+		}
+		_M_end = data + trailer.Index;
+		_M_frames = trailer.Frames;
+		_M_last_step = trailer.LastStep;
+		_M_complete = true;
+		return true;
+	}
+
+	/// Walks the frame headers of an unfinished log, dropping a frame which was cut short.
+	void _M_Scan_Index() {
+		const char* const end = _M_file.Data() + _M_file.Size();
+		const char* position = _M_begin;
+		_M_index.clear();
+		_M_frames = 0;
+		_M_last_step = 0;
+		_M_complete = false;
+		while(position < end) {
+			const char* frame = position;
+			std::uint64_t length;
+			std::size_t step;
+			try {
+				length = _Varint::Get(position, end);
+				if(length == 0 || length > static_cast<std::uint64_t>(end - position)) {
+					position = frame;
+					break;
+				}
+				const char* body = position + 1;
+				step = _Varint::Get(body, position + length);
+			} catch(std::runtime_error const&) {
+				position = frame;
+				break;
+			}
+			if(static_cast<Replay_Frame>(*position) == Replay_Frame::Keyframe) {
+				_M_index.push_back(ReplayIndexEntry { step, static_cast<std::uint64_t>(frame - _M_file.Data()) });
+			}
+			position += length;
+			_M_frames++;
+			_M_last_step = step;
+		}
+		_M_end = position;
+	}
+
+	common::MappedFile _M_file;
+	std::size_t _M_keyframe_interval;
+	const char* _M_begin;
+	const char* _M_end;
+	bool _M_complete;
+	std::size_t _M_frames;
+	std::size_t _M_last_step;
+	std::vector<ReplayIndexEntry> _M_index;
+
+	const char* _M_position;
+	state_type _M_state;
+	bool _M_has_step;
+	std::size_t _M_step;
+};
+
+} /* namespace manager */
+} /* namespace bul */
+
+#endif /* _BUL_MANAGER_REPLAY_H */
@@ -7,43 +7,123 @@
 
 #include <type_traits>
 #include <stdexcept>
+#include <atomic>
+#include <typeindex>
+#include <typeinfo>
+#include <cstdint>
+#include <cstring>
+#include <exception>
 
+#include <algorithm>
 #include <unordered_map>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
 #include <set>
 
+#include "../common/allocator.h"
 #include "../common/container.h"
+#include "../common/flagindex.h"
+#include "../common/handle.h"
+#include "../common/timingwheel.h"
+#include "../common/mappedfile.h"
+#include "../common/profiler.h"
+#include "../common/spatialgrid.h"
+#include "../common/threadpool.h"
 #include "../dynamics/actor.h"
 #include "../dynamics/object.h"
 #include "../dynamics/trigger.h"
+#include "asyncmonitor.h"
+#include "checkpoint.h"
+#include "commandbuffer.h"
+#include "mailbox.h"
 #include "monitor.h"
+#include "system.h"
 
 namespace bul {
 namespace manager {
 /// A SceneMgr managers all objects, actors and triggers.
 class SceneMgr {
 public:
-	/// Defines some types.
+	/// Defines some types. The buckets keep insertion order, so GetNodesByType(...) and GetNodesByTag(...)
+	/// list the nodes in the order they were added, removals included; removals of a step are batched.
 	typedef common::Container<dynamics::Node*, common::Key<std::size_t>,
-				common::Tag<dynamics::Node_Type, unsigned int>, std::unordered_map> storage_type;
+				common::Tag<dynamics::Node_Type, unsigned int>, std::unordered_map, common::OrderedVectorBucket> storage_type;
+	typedef std::function<dynamics::Node*(SceneMgr&, NodeRecord const&)> node_factory_type;
+	typedef std::function<dynamics::Actor::Component*(dynamics::Actor&, ComponentRecord const&)> component_factory_type;
 
 	/// Configuration for a scene manager.
 	struct Configuration {
 		std::size_t MaxStep = 7200;
+
+		/// Number of threads used to step actors, 1 keeps the serial (deterministic) order.
+		std::size_t Threads = 1;
+		/// Number of actors handed to a thread at a time in parallel mode.
+		std::size_t ChunkSize = 256;
+
+		/// Bytes per slab of the node / component pools, 0 allocates each node on the heap.
+		std::size_t SlabSize = 64 * 1024;
+
+		/// Write a checkpoint to CheckpointPath every CheckpointInterval steps, 0 disables it.
+		std::size_t CheckpointInterval = 0;
+		std::string CheckpointPath;
+
+		/// DataPool float slots holding the coordinates of the actors. Two or three slots enable the spatial
+		/// index, which is rebuilt at the start of each step; none disables it.
+		std::vector<std::size_t> PositionSlots;
+		/// Cell size of the spatial index, about the radius of the usual queries.
+		float CellSize = 1.0f;
 	};
 
-	SceneMgr(Configuration* __conf) : _M_max_step(__conf->MaxStep) {
+	SceneMgr(Configuration* __conf) : _M_max_step(__conf->MaxStep), _M_chunk_size(__conf->ChunkSize),
+			_M_allocator(__conf->SlabSize > 0 ? new common::SlabAllocator(__conf->SlabSize) : nullptr),
+			_M_checkpoint_interval(__conf->CheckpointInterval), _M_checkpoint_path(__conf->CheckpointPath),
+			_M_position_slots(__conf->PositionSlots) {
 		_M_current_step = 0;
+		_M_data_epoch = 0;
 		_M_terminated = false;
 		_M_step_lock = false;
+		_M_deferring = false;
+		_M_checkpoint_size = 0;
+		_M_dirty_round = 1;
+		if(__conf->Threads > 1) {
+			_M_thread_pool.reset(new common::ThreadPool(__conf->Threads));
+		}
+		_M_command.Resize(GetThreads());
+		_M_mailbox.Resize(GetThreads());
+		_M_dirty_list.resize(GetThreads());
+		if(!_M_position_slots.empty()) {
+			if(_M_position_slots.size() != 2 && _M_position_slots.size() != 3) {
+				throw std::invalid_argument("bul::manager::SceneMgr::SceneMgr(...) : PositionSlots needs 2 or 3 slots.");
+			}
+			_M_spatial_grid.Configure(_M_position_slots.size(), __conf->CellSize);
+		}
 	}
 	virtual ~SceneMgr() {
-		auto iter_end = _M_node.EndByKey<0>();
-		for(auto iter = _M_node.BeginByKey<0>(); iter != iter_end;) {
-			auto tmp = iter;
-			iter++;
-			auto node = (*tmp).second;
-			RemoveNode(node);
+		_M_Clear(false);
+		if(_M_allocator) {
+			_M_allocator->Release();
+		}
+	}
+
+	/// Remove every node and monitor and rewind to step 0, so that the scene can run another episode.
+	/// Registered systems and factories are kept, and so are the slabs: new nodes reuse the freed blocks.
+	void Reset() {
+		if(_M_step_lock) {
+			throw std::logic_error("bul::manager::SceneMgr::Reset() : the simulation is running.");
 		}
+		_M_Clear(true);
+		_M_handle_table.Clear();
+		_M_actor_partition.clear();
+		_M_anyway_partition.clear();
+		_M_trigger_partition.clear();
+		_M_flag_index.Clear();
+		_M_Clear_Pending(0);
+		_M_monitor.clear();
+		_M_current_step = 0;
+		_M_terminated = false;
 	}
 
 	/// Accept monitors and run the simulation.
@@ -55,7 +135,8 @@ public:
 		_M_Run<0, _Tpls...>(__tpls...);
 	}
 
-	/// Add a node.
+	/// Add a node. While the scene is stepping (also from worker threads), the node is constructed right away
+	/// but joins the scene at the end of the step; it cannot be looked up until then.
 	template<typename _Tp>
 	_Tp* AddNode(typename _Tp::Configuration* __conf) {
 		static_assert(std::is_base_of<dynamics::Object, _Tp>::value ||
@@ -64,17 +145,199 @@ public:
 				"bul::manager::SceneMgr::AddObject(...): Illegal node type.");
 
 		__conf -> SceneManager = this;
+		__conf -> Allocator = _M_allocator.get();
 
-		_Tp* node = new _Tp(__conf);
-		_M_node.Insert(node, __conf->Id, __conf->NodeType, __conf->Tag);
+		_Tp* node = _M_allocator ? _M_allocator->New<_Tp>(__conf) : new _Tp(__conf);
+		if(_M_deferring) {
+			_M_Push_Command(Command_Type::AddNode, node);
+		} else {
+			_M_Insert_Node(node);
+		}
 
 		return node;
 	}
 
-	/// Remove a node.
+	/// Remove a node. While the scene is stepping, this takes effect at the end of the step.
 	void RemoveNode(dynamics::Node* __node) {
+		if(_M_deferring) {
+			_M_Push_Command(Command_Type::RemoveNode, __node);
+			return;
+		}
 		_M_node.EraseByValue(__node);
-		delete __node;
+		_M_Leave(__node);
+		if(_M_allocator) {
+			common::SlabAllocator::Delete(__node);
+		} else {
+			delete __node;
+		}
+	}
+
+	/// Step every component of the concrete type _Tp in one call per step instead of one virtual call per component.
+	/// __act gets the active components of active, awake actors, __act_anyway (optional) gets the components
+	/// acting anyway of awake actors. Systems run after the actors, in ascending priority (registration order
+	/// among equal priorities). With Threads > 1 the span is cut into chunks of about ChunkSize components which
+	/// are handed to the callback concurrently; a chunk ends at an actor boundary, so the components of one actor
+	/// are called on one thread and may all write its DataPool.
+	template<typename _Tp>
+	System<_Tp>* RegisterSystem(std::size_t __priority, typename System<_Tp>::callback_type const& __act,
+			typename System<_Tp>::callback_type const& __act_anyway = nullptr) {
+		static_assert(std::is_base_of<dynamics::Actor::Component, _Tp>::value,
+				"bul::manager::SceneMgr::RegisterSystem(...): Illegal component type.");
+		if(_M_step_lock) {
+			throw std::runtime_error("bul::manager::SceneMgr::RegisterSystem(...) : can only be used in single step mode.");
+		}
+		if(_M_system_index.count(std::type_index(typeid(_Tp)))) {
+			throw std::logic_error("bul::manager::SceneMgr::RegisterSystem(...) : System already exists.");
+		}
+
+		System<_Tp>* system = new System<_Tp>(__priority, __act, __act_anyway);
+		auto position = _M_system.begin();
+		while(position != _M_system.end() && (*position)->GetPriority() <= __priority) {
+			position++;
+		}
+		_M_system.emplace(position, system);
+		_M_system_index[std::type_index(typeid(_Tp))] = system;
+
+		/// Components added before the system was registered.
+		if(_M_node.CountTag<0>(dynamics::Node_Type::Actor) > 0) {
+			for(auto node : _M_node.GetByTag<0>(dynamics::Node_Type::Actor)) {
+				auto actor = static_cast<dynamics::Actor*>(node);
+				for(auto iter = actor->_M_component.BeginByKey<0>(); iter != actor->_M_component.EndByKey<0>(); iter++) {
+					auto component = (*iter).second;
+					if(typeid(*component) == typeid(_Tp)) {
+						actor->_M_Unschedule_Component(component);
+						system->_M_Attach(component);
+					}
+				}
+			}
+		}
+		return system;
+	}
+
+	/// Register how nodes of type _Tp are rebuilt from a checkpoint, __kind identifies the type in the file.
+	template<typename _Tp>
+	void RegisterNodeFactory(std::uint32_t __kind) {
+		RegisterNodeFactory<_Tp>(__kind, [](SceneMgr& __scenemgr, NodeRecord const& __record) -> dynamics::Node* {
+			typename _Tp::Configuration conf;
+			conf.Id = __record.Id;
+			conf.Tag = __record.Tag;
+			conf.Flag = __record.Flag;
+			_S_Set_Active(&conf, __record.Active != 0);
+			return __scenemgr.AddNode<_Tp>(&conf);
+		});
+	}
+
+	template<typename _Tp>
+	void RegisterNodeFactory(std::uint32_t __kind, node_factory_type __factory) {
+		static_assert(std::is_base_of<dynamics::Node, _Tp>::value,
+				"bul::manager::SceneMgr::RegisterNodeFactory(...): Illegal node type.");
+		if(_M_node_factory.count(__kind)) {
+			throw std::logic_error("bul::manager::SceneMgr::RegisterNodeFactory(...) : Kind already exists.");
+		}
+		_M_factory_kind[std::type_index(typeid(_Tp))] = __kind;
+		_M_node_factory[__kind] = __factory;
+	}
+
+	/// Register how components of type _Tp are rebuilt from a checkpoint.
+	template<typename _Tp>
+	void RegisterComponentFactory(std::uint32_t __kind) {
+		RegisterComponentFactory<_Tp>(__kind, [](dynamics::Actor& __actor, ComponentRecord const& __record) -> dynamics::Actor::Component* {
+			typename _Tp::Configuration conf;
+			conf.Id = __record.Id;
+			conf.Tag = __record.Tag;
+			conf.Flag = __record.Flag;
+			conf.Priority = __record.Priority;
+			conf.Active = __record.Active != 0;
+			return __actor.AddComponent<_Tp>(&conf);
+		});
+	}
+
+	template<typename _Tp>
+	void RegisterComponentFactory(std::uint32_t __kind, component_factory_type __factory) {
+		static_assert(std::is_base_of<dynamics::Actor::Component, _Tp>::value,
+				"bul::manager::SceneMgr::RegisterComponentFactory(...): Illegal component type.");
+		if(_M_component_factory.count(__kind)) {
+			throw std::logic_error("bul::manager::SceneMgr::RegisterComponentFactory(...) : Kind already exists.");
+		}
+		_M_factory_kind[std::type_index(typeid(_Tp))] = __kind;
+		_M_component_factory[__kind] = __factory;
+	}
+
+	/// Write the scene to a checkpoint file. The image is built here, the file is written in the background.
+	/// Actors are saved with their DataPool and, for a SchemaActor, its schema slots; other members of derived
+	/// types are not saved.
+	void Checkpoint(std::string const& __path) {
+		if(_M_step_lock) {
+			throw std::runtime_error("bul::manager::SceneMgr::Checkpoint(...) : can only be used in single step mode.");
+		}
+		_M_Checkpoint(__path, _M_current_step);
+	}
+
+	/// Wait until the last checkpoint is on disk.
+	void WaitCheckpoint() {
+		_M_checkpoint_writer.Wait();
+	}
+
+	/// Replace the scene with the content of a checkpoint file, through the registered factories. Pending
+	/// wake-ups, messages and dirty lists are dropped, sleeping nodes are put back to sleep.
+	void Restore(std::string const& __path) {
+		if(_M_step_lock) {
+			throw std::runtime_error("bul::manager::SceneMgr::Restore(...) : can only be used in single step mode.");
+		}
+		common::MappedFile file(__path);
+		_Checkpoint_Reader reader(file.Data(), file.Size());
+
+		auto header = reader.Read<CheckpointHeader>();
+		if(std::memcmp(header.Magic, _S_checkpoint_magic, sizeof(header.Magic)) != 0 ||
+				header.Version != _S_checkpoint_version) {
+			throw std::runtime_error("bul::manager::SceneMgr::Restore(...) : '" + __path + "' is not a checkpoint.");
+		}
+
+		_M_Clear();
+		_M_Clear_Pending(header.CurrentStep);
+		for(std::uint64_t i = 0; i < header.NodeCount; i++) {
+			auto record = reader.Read<NodeRecord>();
+			auto factory = _M_node_factory.find(record.Kind);
+			if(factory == _M_node_factory.end()) {
+				throw std::out_of_range("bul::manager::SceneMgr::Restore(...) : Node kind is not registered.");
+			}
+			dynamics::Node* node = (*factory).second(*this, record);
+			if(record.Sleeping) {
+				node->SleepUntil(record.WakeStep);
+			}
+			const char* data = reader.Skip(record.DataPoolBytes);
+			if(static_cast<dynamics::Node_Type>(record.NodeType) != dynamics::Node_Type::Actor) {
+				continue;
+			}
+
+			auto actor = static_cast<dynamics::Actor*>(node);
+			auto& datapool = actor->GetDataPool();
+			if(record.DataPoolBytes != record.DataPoolSize * datapool.ElementSize()) {
+				throw std::runtime_error("bul::manager::SceneMgr::Restore(...) : DataPool layout mismatch.");
+			}
+			datapool.Resize(record.DataPoolSize);
+			if(record.DataPoolBytes > 0) {
+				std::memcpy(datapool.Data(), data, record.DataPoolBytes);
+			}
+			if(record.SlotsBytes != actor->_M_Slots_Bytes()) {
+				throw std::runtime_error("bul::manager::SceneMgr::Restore(...) : Schema slots layout mismatch.");
+			}
+			if(record.SlotsBytes > 0) {
+				actor->_M_Load_Slots(reader.Skip(record.SlotsBytes));
+			}
+
+			for(std::uint64_t j = 0; j < record.ComponentCount; j++) {
+				auto component_record = reader.Read<ComponentRecord>();
+				auto component_factory = _M_component_factory.find(component_record.Kind);
+				if(component_factory == _M_component_factory.end()) {
+					throw std::out_of_range("bul::manager::SceneMgr::Restore(...) : Component kind is not registered.");
+				}
+				(*component_factory).second(*actor, component_record);
+			}
+		}
+
+		_M_current_step = header.CurrentStep;
+		_M_terminated = false;
 	}
 
 	/// Terminate the simulation (after the current step is completely done).
@@ -82,16 +345,25 @@ public:
 		_M_terminated = true;
 	}
 
+	/// Get a node by handle, nullptr if the node has been removed since the handle was issued.
+	dynamics::Node* GetNodeByHandle(common::Handle const& __handle) {
+		return _M_handle_table.Get(__handle);
+	}
+
+	const dynamics::Node* GetNodeByHandle(common::Handle const& __handle) const {
+		return _M_handle_table.Get(__handle);
+	}
+
 	/// Get node(s) by id / type / tag.
 	typename storage_type::value_type GetNodeById(std::size_t __id) {
 		return _M_node.GetByKey<0>(__id);
 	}
 
-	typename storage_type::value_list_type const& GetNodesByType(dynamics::Node_Type __type) {
+	typename storage_type::value_list_type const& GetNodesByType(dynamics::Node_Type __type) const {
 		return _M_node.GetByTag<0>(__type);
 	}
 
-	typename storage_type::value_list_type const& GetNodesByTag(unsigned int __tag) {
+	typename storage_type::value_list_type const& GetNodesByTag(unsigned int __tag) const {
 		return _M_node.GetByTag<1>(__tag);
 	}
 
@@ -112,6 +384,175 @@ public:
 		return _M_node.CountValue(__node);
 	}
 
+	/// Get / count the nodes having all the bits of __mask (every node if __mask is 0), by handle index.
+	/// The cost follows the number of matches rather than the number of nodes. Flags changed during
+	/// a step are indexed at the end of the step.
+	std::vector<dynamics::Node*> QueryNodesByFlags(unsigned int __mask) const {
+		std::vector<dynamics::Node*> nodes;
+		ForEachNodeByFlags(__mask, [&nodes](dynamics::Node* __node) {
+			nodes.push_back(__node);
+		});
+		return nodes;
+	}
+
+	template<typename _Func>
+	void ForEachNodeByFlags(unsigned int __mask, _Func const& __func) const {
+		_M_flag_index.ForEach(__mask, [this, &__func](std::uint32_t __slot) {
+			__func(_M_handle_table.At(__slot));
+		});
+	}
+
+	std::size_t CountNodesByFlags(unsigned int __mask) const {
+		return _M_flag_index.Count(__mask);
+	}
+
+	/// Flags of the nodes by handle index (GetHandle().Index), 0 where there is no node; scanning it
+	/// directly suits masks which most nodes match.
+	common::FlagIndex const& GetFlagIndex() const {
+		return _M_flag_index;
+	}
+
+	/// Nodes matching every criterion given, found without copying them: the smaller of the type and tag
+	/// buckets (or every node if neither is given) drives the iteration, the node itself is checked for
+	/// the rest. The scene must not change while a query is iterated, e.g. by the query's own loop.
+	class NodeQuery {
+	public:
+		/// Forward iterator over the matching nodes.
+		class const_iterator {
+		public:
+			typedef std::forward_iterator_tag iterator_category;
+			typedef dynamics::Node* value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef value_type const* pointer;
+			typedef value_type const& reference;
+
+			const_iterator(NodeQuery const* __query, dynamics::Node* const* __iter, dynamics::Node* const* __end) :
+					_M_query(__query), _M_iter(__iter), _M_end(__end) {
+				_M_Skip();
+			}
+
+			reference operator*() const {
+				return *_M_iter;
+			}
+
+			const_iterator& operator++() {
+				++_M_iter;
+				_M_Skip();
+				return *this;
+			}
+
+			const_iterator operator++(int) {
+				const_iterator ret = *this;
+				++*this;
+				return ret;
+			}
+
+			bool operator==(const_iterator const& __other) const {
+				return _M_iter == __other._M_iter;
+			}
+
+			bool operator!=(const_iterator const& __other) const {
+				return _M_iter != __other._M_iter;
+			}
+
+		private:
+			void _M_Skip() {
+				while(_M_iter != _M_end && !_M_query->_M_Match(*_M_iter)) {
+					++_M_iter;
+				}
+			}
+
+			NodeQuery const* _M_query;
+			dynamics::Node* const* _M_iter;
+			dynamics::Node* const* _M_end;
+		};
+
+		NodeQuery(SceneMgr const* __scenemgr) : _M_scenemgr(__scenemgr), _M_has_type(false),
+				_M_type(dynamics::Node_Type::Actor), _M_has_tag(false), _M_tag(0), _M_mask(0), _M_empty(false) { }
+
+		/// Returns the query narrowed to the nodes of a type / with a tag / having all the bits of __mask.
+		/// Queries are returned by value so that a chain can be iterated directly by a range-for loop.
+		NodeQuery Type(dynamics::Node_Type __type) const {
+			NodeQuery ret(*this);
+			ret._M_empty = _M_empty || (_M_has_type && _M_type != __type);
+			ret._M_has_type = true;
+			ret._M_type = __type;
+			return ret;
+		}
+
+		NodeQuery Tag(unsigned int __tag) const {
+			NodeQuery ret(*this);
+			ret._M_empty = _M_empty || (_M_has_tag && _M_tag != __tag);
+			ret._M_has_tag = true;
+			ret._M_tag = __tag;
+			return ret;
+		}
+
+		NodeQuery Flags(unsigned int __mask) const {
+			NodeQuery ret(*this);
+			ret._M_mask |= __mask;
+			return ret;
+		}
+
+		const_iterator begin() const {
+			dynamics::Node* const* first;
+			dynamics::Node* const* last;
+			_M_Driver(first, last);
+			return const_iterator(this, first, last);
+		}
+
+		const_iterator end() const {
+			dynamics::Node* const* first;
+			dynamics::Node* const* last;
+			_M_Driver(first, last);
+			return const_iterator(this, last, last);
+		}
+
+		/// Number of matching nodes, found by iterating.
+		std::size_t Count() const {
+			return static_cast<std::size_t>(std::distance(begin(), end()));
+		}
+
+	private:
+		/// The smallest range holding every match.
+		void _M_Driver(dynamics::Node* const*& __first, dynamics::Node* const*& __last) const {
+			__first = __last = nullptr;
+			if(_M_empty) {
+				return;
+			}
+			auto const& nodes = _M_scenemgr->_M_node;
+			std::size_t size = _M_scenemgr->_M_handle_table.Size();
+			__first = _M_scenemgr->_M_handle_table.Data();
+			if(_M_has_type) {
+				size = nodes.CountTag<0>(_M_type);
+				__first = size > 0 ? nodes.GetByTag<0>(_M_type).data() : nullptr;
+			}
+			if(_M_has_tag && nodes.CountTag<1>(_M_tag) < size) {
+				size = nodes.CountTag<1>(_M_tag);
+				__first = size > 0 ? nodes.GetByTag<1>(_M_tag).data() : nullptr;
+			}
+			__last = __first + size;
+		}
+
+		bool _M_Match(dynamics::Node const* __node) const {
+			return (!_M_has_type || __node->GetType() == _M_type) && (!_M_has_tag || __node->GetTag() == _M_tag) &&
+					(__node->GetFlag() & _M_mask) == _M_mask;
+		}
+
+		SceneMgr const* _M_scenemgr;
+		bool _M_has_type;
+		dynamics::Node_Type _M_type;
+		bool _M_has_tag;
+		unsigned int _M_tag;
+		unsigned int _M_mask;
+		bool _M_empty;
+	};
+
+	/// Starts a query, e.g. Query().Type(dynamics::Node_Type::Actor).Tag(3).Flags(0x4).
+	NodeQuery Query() const {
+		return NodeQuery(this);
+	}
+
 	/// Get max / current step.
 	std::size_t GetMaxStep() const {
 		return _M_max_step;
@@ -134,6 +575,110 @@ public:
 		return _M_terminated || _M_current_step >= _M_max_step;
 	}
 
+	/// Allocation counters of the node / component pools.
+	common::AllocatorStats GetAllocatorStats() const {
+		return _M_allocator ? _M_allocator->Stats() : common::AllocatorStats();
+	}
+
+	/// Number of threads used to step actors.
+	std::size_t GetThreads() const {
+		return _M_thread_pool ? _M_thread_pool->Size() : 1;
+	}
+
+	/// Rebuild the spatial index from the DataPools of the actors, which the scene does at the start of each
+	/// step. Call it to query positions set outside of a step. Actors whose pool lacks the slots are left out.
+	void UpdateSpatialIndex() {
+		if(_M_position_slots.empty()) {
+			throw std::logic_error("bul::manager::SceneMgr::UpdateSpatialIndex() : No PositionSlots configured.");
+		}
+		if(_M_deferring) {
+			throw std::logic_error("bul::manager::SceneMgr::UpdateSpatialIndex() : the scene is stepping.");
+		}
+		std::size_t const size = *std::max_element(_M_position_slots.begin(), _M_position_slots.end()) + 1;
+		_M_actor_partition.Commit();
+		dynamics::Actor* const* actors = _M_actor_partition.data();
+		for(std::size_t i = 0; i < _M_actor_partition.size(); i++) {
+			auto const& datapool = actors[i]->GetDataPool();
+			if(datapool.Size() < size) {
+				continue;
+			}
+			float position[common::SpatialGrid<common::Handle>::MaxDimensions];
+			for(std::size_t d = 0; d < _M_position_slots.size(); d++) {
+				position[d] = datapool.Get<float>(_M_position_slots[d]);
+			}
+			_M_spatial_grid.Push(actors[i]->GetHandle(), position);
+		}
+		_M_spatial_grid.Build();
+	}
+
+	/// Appends to __out the handles of the actors within __radius of __center, as of the last rebuild of the
+	/// spatial index. Can be called from worker threads.
+	void QueryRadius(float const* __center, float __radius, std::vector<common::Handle>& __out) const {
+		_M_spatial_grid.QueryRadius(__center, __radius, __out);
+	}
+
+	/// Fills __out with the __k actors nearest to __center, nearest first, as of the last rebuild of the
+	/// spatial index. Can be called from worker threads.
+	void QueryNearest(float const* __center, std::size_t __k,
+			std::vector<common::SpatialGrid<common::Handle>::Hit>& __out) const {
+		_M_spatial_grid.QueryNearest(__center, __k, __out);
+	}
+
+	/// The spatial index, for ForEachInRadius(...) and the like.
+	common::SpatialGrid<common::Handle> const& GetSpatialIndex() const {
+		return _M_spatial_grid;
+	}
+
+	/// Calls __func(actor) for every actor whose DataPool tracks its writes and became dirty since the dirty
+	/// state was last cleared, in order of first write (worker by worker in parallel mode). The scene clears
+	/// it after the monitors of each step, so that they see what changed in the step; the written slots are
+	/// in Actor::GetDataPool().ForEachDirty(...).
+	template<typename _Func>
+	void ForEachDirtyActor(_Func const& __func) const {
+		for(auto const& list : _M_dirty_list) {
+			for(auto const& handle : list.handles) {
+				auto node = _M_handle_table.Get(handle);
+				if(node) {
+					auto actor = static_cast<dynamics::Actor const*>(node);
+					if(actor->GetDataPool().IsDirty()) {
+						__func(actor);
+					}
+				}
+			}
+		}
+	}
+
+	/// Marks the DataPools of the dirty actors clean, in time proportional to their number.
+	void ClearDirty() {
+		if(_M_deferring) {
+			throw std::logic_error("bul::manager::SceneMgr::ClearDirty() : the scene is stepping.");
+		}
+		for(auto& list : _M_dirty_list) {
+			for(auto const& handle : list.handles) {
+				auto node = _M_handle_table.Get(handle);
+				if(node) {
+					static_cast<dynamics::Actor*>(node)->_M_datapool.ClearDirty();
+				}
+			}
+			list.handles.clear();
+		}
+		_M_dirty_round++;
+	}
+
+	/// Send a copy of __message to the node of __recipient, it is delivered at the start of the next step and
+	/// dropped if the node is gone by then. Can be called from worker threads, _Tp must be trivially copyable.
+	/// Pending messages are not saved by checkpoints.
+	template<typename _Tp>
+	void Send(common::Handle const& __recipient, _Tp const& __message) {
+		_M_mailbox.Post(_M_Worker(), __recipient, __message);
+	}
+
+	/// The messages of type _Tp delivered to the node of __recipient at the start of the current step.
+	template<typename _Tp>
+	MessageRange<_Tp> Receive(common::Handle const& __recipient) const {
+		return _M_mailbox.Receive<_Tp>(__recipient);
+	}
+
 protected:
 	/// Actions before actors and triggers act.
 	virtual void PreStep() = 0;
@@ -141,53 +686,652 @@ protected:
 	/// Actions after actors and triggers act.
 	virtual void PostStep() = 0;
 
-	/// Call actors and triggers.
+	/// Call actors and triggers, structural changes they make are applied afterwards.
 	void _M_Step() {
-		if(_M_node.CountTag<0>(dynamics::Node_Type::Actor) > 0) {
-			auto& actor_list = _M_node.GetByTag<0>(dynamics::Node_Type::Actor);
-			for(auto iter = actor_list.begin(); iter !=  actor_list.end(); iter++) {
-				auto actor = static_cast<dynamics::Actor*>(*iter);
-				if(actor -> IsActive()) {
-					actor -> PreAct();
-					actor -> _M_Act();
-					actor -> PostAct();
+		_M_mailbox.Deliver([this](common::Handle const& __handle) {
+			return _M_handle_table.Contains(__handle);
+		});
+		_M_Wake_Nodes();
+		_M_actor_partition.Commit();
+		_M_anyway_partition.Commit();
+		_M_trigger_partition.Commit();
+		if(!_M_position_slots.empty()) {
+			UpdateSpatialIndex();
+		}
+		_M_deferring = true;
+		_M_data_epoch++;
+		try {
+			_M_Step_Nodes();
+		} catch(...) {
+			_M_data_epoch++;
+			_M_deferring = false;
+			_M_Apply_Commands();
+			throw;
+		}
+		_M_data_epoch++;
+		_M_deferring = false;
+		_M_Apply_Commands();
+	}
+
+	void _M_Step_Nodes() {
+		{
+			BUL_PROFILE_PHASE(common::Profile_Phase::Actors);
+			_M_Step_Actors();
+			for(auto& system : _M_system) {
+				system->_M_Run(_M_thread_pool.get(), _M_chunk_size);
+			}
+			for(auto& system : _M_system) {
+				system->_M_Run_Anyway(_M_thread_pool.get(), _M_chunk_size);
+			}
+		}
+
+		BUL_PROFILE_PHASE(common::Profile_Phase::Triggers);
+		dynamics::Trigger* const* triggers = _M_trigger_partition.data();
+		for(std::size_t i = 0; i < _M_trigger_partition.ActiveSize(); i++) {
+			auto trigger = triggers[i];
+			BUL_PROFILE_NODE("Trigger", trigger->GetId(), typeid(*trigger));
+			trigger -> Act();
+		}
+	}
+
+	/// Wake the nodes due in the current step, stale entries of the wheel are dropped here.
+	void _M_Wake_Nodes() {
+		_M_timing_wheel.Advance(_M_current_step, [this](common::Handle const& __handle) {
+			auto node = _M_handle_table.Get(__handle);
+			if(node && node->_M_sleeping && node->_M_wake_step <= _M_current_step) {
+				node->_M_sleeping = false;
+				_M_Sync_Node(node);
+			}
+		});
+	}
+
+	/// Put a constructed node in place.
+	void _M_Insert_Node(dynamics::Node* __node) {
+		_M_node.Insert(__node, __node->GetId(), __node->GetType(), __node->GetTag());
+		_M_Join(__node);
+	}
+
+	/// Issue the handle of a node which was put in the index, and place actors and triggers in the partitions.
+	void _M_Join(dynamics::Node* __node) {
+		__node->_M_handle = _M_handle_table.Insert(__node);
+		_M_flag_index.Insert(__node->_M_handle.Index, __node->_M_flag);
+		bool const awake = !__node->_M_sleeping;
+		switch(__node->GetType()) {
+		case dynamics::Node_Type::Actor: {
+			auto actor = static_cast<dynamics::Actor*>(__node);
+			if(actor->_M_double_buffered) {
+				actor->_M_datapool.SetEpoch(&_M_data_epoch);
+			}
+			actor->_M_datapool.SetDirtyCallback(&dynamics::Actor::_S_Data_Dirty, actor);
+			if(actor->_M_datapool.IsDirty()) {
+				_M_Mark_Dirty(actor);
+			}
+			_M_actor_partition.Push(actor, awake && actor->IsActive(), &actor->_M_active_slot);
+			_M_anyway_partition.Push(actor, awake && actor->_M_anyway_count > 0, &actor->_M_anyway_slot);
+			/// The actor may have been switched or put to sleep before it joined.
+			actor->_M_Sync_Systems();
+			break;
+		}
+		case dynamics::Node_Type::Trigger: {
+			auto trigger = static_cast<dynamics::Trigger*>(__node);
+			_M_trigger_partition.Push(trigger, awake, &trigger->_M_awake_slot);
+			break;
+		}
+		default:
+			return;
+		}
+		if(!awake) {
+			_M_timing_wheel.Schedule(__node->_M_handle, __node->_M_wake_step);
+		}
+	}
+
+	/// The reverse of _M_Join(...), for a node taken out of the index.
+	void _M_Leave(dynamics::Node* __node) {
+		_M_flag_index.Erase(__node->_M_handle.Index);
+		_M_handle_table.Erase(__node->_M_handle);
+		__node->_M_handle = common::Handle();
+		if(__node->GetType() == dynamics::Node_Type::Actor) {
+			auto actor = static_cast<dynamics::Actor*>(__node);
+			actor->_M_datapool.SetDirtyCallback(nullptr, nullptr);
+			_M_actor_partition.Erase(&actor->_M_active_slot);
+			_M_anyway_partition.Erase(&actor->_M_anyway_slot);
+		} else if(__node->GetType() == dynamics::Node_Type::Trigger) {
+			_M_trigger_partition.Erase(&static_cast<dynamics::Trigger*>(__node)->_M_awake_slot);
+		}
+	}
+
+	/// List an actor whose DataPool became dirty, once per round, in the list of the calling worker.
+	void _M_Mark_Dirty(dynamics::Actor* __actor) {
+		if(__actor->_M_dirty_round == _M_dirty_round) {
+			return;
+		}
+		__actor->_M_dirty_round = _M_dirty_round;
+		std::size_t const worker = _M_Worker();
+		if(worker >= _M_dirty_list.size()) {
+			throw std::logic_error("bul::manager::SceneMgr::_M_Mark_Dirty(...) : Unknown worker.");
+		}
+		_M_dirty_list[worker].handles.push_back(__actor->GetHandle());
+	}
+
+	/// Move an actor or trigger to the partitions matching its activity, components and sleep, at the end
+	/// of the step if stepping.
+	void _M_Sync_Node(dynamics::Node* __node) {
+		if(_M_deferring) {
+			_M_Push_Command(Command_Type::SyncNode, __node);
+			return;
+		}
+		bool const awake = !__node->_M_sleeping;
+		if(__node->GetType() == dynamics::Node_Type::Actor) {
+			auto actor = static_cast<dynamics::Actor*>(__node);
+			_M_actor_partition.SetActive(&actor->_M_active_slot, awake && actor->IsActive());
+			_M_anyway_partition.SetActive(&actor->_M_anyway_slot, awake && actor->_M_anyway_count > 0);
+			actor->_M_Sync_Systems();
+		} else if(__node->GetType() == dynamics::Node_Type::Trigger) {
+			_M_trigger_partition.SetActive(&static_cast<dynamics::Trigger*>(__node)->_M_awake_slot, awake);
+		}
+	}
+
+	/// Bring the flag index up to date with a node's flags, at the end of the step if stepping.
+	void _M_Sync_Flag(dynamics::Node* __node) {
+		if(_M_deferring) {
+			_M_Push_Command(Command_Type::SyncFlag, __node);
+			return;
+		}
+		_M_flag_index.Set(__node->_M_handle.Index, __node->_M_flag);
+	}
+
+	/// A node started or stopped sleeping: schedule its wake-up, the wheel keeps earlier entries which
+	/// are dropped when they come due.
+	void _M_Schedule_Node(dynamics::Node* __node) {
+		if(_M_deferring) {
+			_M_Push_Command(Command_Type::ScheduleNode, __node);
+			return;
+		}
+		if(__node->_M_sleeping) {
+			_M_timing_wheel.Schedule(__node->_M_handle, __node->_M_wake_step);
+		}
+		_M_Sync_Node(__node);
+	}
+
+	/// Index of the calling thread in the scene's own pool, 0 for any other thread, so that a scene stepped
+	/// by a worker of another pool (see BatchRunner) never uses that pool's index.
+	std::size_t _M_Worker() const {
+		return _M_thread_pool ? _M_thread_pool->Worker() : 0;
+	}
+
+	/// Record a structural change made during the step, in the queue of the calling worker.
+	void _M_Push_Command(Command_Type __type, dynamics::Node* __target) {
+		_M_command.Push(_M_Worker(), __type, __target);
+	}
+
+	/// Apply the changes recorded during the step: additions first, then removals (components grouped by actor,
+	/// nodes in one batch), each target once. The first error is rethrown after all are applied.
+	void _M_Apply_Commands() {
+		if(_M_command.Empty()) {
+			return;
+		}
+
+		_M_add_node.clear();
+		_M_sync_node.clear();
+		_M_schedule_node.clear();
+		_M_sync_flag.clear();
+		_M_sync_component.clear();
+		_M_add_component.clear();
+		_M_remove_component.clear();
+		_M_remove_node.clear();
+		_M_failed.clear();
+		_M_command.Drain([this](_Command const& __command) {
+			switch(__command.Type) {
+			case Command_Type::AddNode:
+				_M_add_node.push_back(__command.Target);
+				break;
+			case Command_Type::AddComponent:
+				_M_add_component.push_back(static_cast<dynamics::Actor::Component*>(__command.Target));
+				break;
+			case Command_Type::RemoveComponent:
+				_M_remove_component.push_back(static_cast<dynamics::Actor::Component*>(__command.Target));
+				break;
+			case Command_Type::RemoveNode:
+				_M_remove_node.push_back(__command.Target);
+				break;
+			case Command_Type::SyncNode:
+				_M_sync_node.push_back(__command.Target);
+				break;
+			case Command_Type::ScheduleNode:
+				_M_schedule_node.push_back(__command.Target);
+				break;
+			case Command_Type::SyncFlag:
+				_M_sync_flag.push_back(__command.Target);
+				break;
+			case Command_Type::SyncComponent:
+				_M_sync_component.push_back(static_cast<dynamics::Actor::Component*>(__command.Target));
+				break;
+			}
+		});
+
+		std::exception_ptr error;
+		_M_node.Reserve(_M_add_node.size());
+		_M_handle_table.Reserve(_M_add_node.size());
+		_M_actor_partition.reserve(_M_actor_partition.size() + _M_add_node.size());
+		_M_trigger_partition.reserve(_M_trigger_partition.size() + _M_add_node.size());
+		_M_anyway_partition.reserve(_M_anyway_partition.size() + _M_add_node.size());
+		/// One by one rather than InsertBatch(...), so that a node which cannot be inserted is known. It is
+		/// destroyed once every pass has run, the later commands of the step may still point to it.
+		for(auto node : _M_add_node) {
+			try {
+				_M_Insert_Node(node);
+			} catch(...) {
+				_M_failed.push_back(node);
+				if(!error) {
+					error = std::current_exception();
+				}
+			}
+		}
+		for(auto component : _M_add_component) {
+			try {
+				component->GetActor()->_M_Insert_Component(component);
+			} catch(...) {
+				_M_failed.push_back(component);
+				if(!error) {
+					error = std::current_exception();
 				}
-				actor -> _M_Act_Anyway();
 			}
 		}
+		std::sort(_M_failed.begin(), _M_failed.end());
+		auto failed = [this](dynamics::Node* __node) {
+			return std::binary_search(_M_failed.begin(), _M_failed.end(), __node);
+		};
 
-		if(_M_node.CountTag<0>(dynamics::Node_Type::Trigger) > 0) {
-			auto& trigger_list = _M_node.GetByTag<0>(dynamics::Node_Type::Trigger);
-			for(auto iter = trigger_list.begin(); iter != trigger_list.end(); iter++) {
-				auto trigger = static_cast<dynamics::Trigger*>(*iter);
-				trigger -> Act();
+		/// Before removals, so that every node is still alive.
+		for(auto node : _M_schedule_node) {
+			if(!node->GetHandle().IsNull() && !failed(node)) {
+				_M_Schedule_Node(node);
 			}
 		}
+		for(auto node : _M_sync_node) {
+			if(!node->GetHandle().IsNull() && !failed(node)) {
+				_M_Sync_Node(node);
+			}
+		}
+		for(auto node : _M_sync_flag) {
+			if(!node->GetHandle().IsNull() && !failed(node)) {
+				_M_Sync_Flag(node);
+			}
+		}
+		for(auto component : _M_sync_component) {
+			if(!component->GetHandle().IsNull() && !failed(component) && !failed(component->GetActor())) {
+				component->GetActor()->_M_Sync_Component(component);
+			}
+		}
+		if(!_M_failed.empty()) {
+			_M_remove_component.erase(std::remove_if(_M_remove_component.begin(), _M_remove_component.end(),
+					[&failed](dynamics::Actor::Component* __component) {
+				return failed(__component) || failed(__component->GetActor());
+			}), _M_remove_component.end());
+			_M_remove_node.erase(std::remove_if(_M_remove_node.begin(), _M_remove_node.end(), failed),
+					_M_remove_node.end());
+		}
+
+		std::sort(_M_remove_component.begin(), _M_remove_component.end(),
+				[](dynamics::Actor::Component* __a, dynamics::Actor::Component* __b) {
+			return __a->GetActor() != __b->GetActor() ? __a->GetActor() < __b->GetActor() : __a < __b;
+		});
+		_M_remove_component.erase(std::unique(_M_remove_component.begin(), _M_remove_component.end()), _M_remove_component.end());
+		for(auto component : _M_remove_component) {
+			try {
+				component->GetActor()->_M_Erase_Component(component);
+			} catch(...) {
+				if(!error) {
+					error = std::current_exception();
+				}
+			}
+		}
+
+		std::sort(_M_remove_node.begin(), _M_remove_node.end());
+		_M_remove_node.erase(std::unique(_M_remove_node.begin(), _M_remove_node.end()), _M_remove_node.end());
+		if(_M_Erase_Nodes()) {
+			for(auto node : _M_remove_node) {
+				_M_Destroy_Block(node);
+			}
+		} else {
+			/// Some node is not in the scene, remove them one by one.
+			for(auto node : _M_remove_node) {
+				try {
+					RemoveNode(node);
+				} catch(...) {
+					if(!error) {
+						error = std::current_exception();
+					}
+				}
+			}
+		}
+
+		for(auto node : _M_failed) {
+			_M_Destroy_Block(node);
+		}
+		_M_failed.clear();
+		if(error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	/// Take the nodes to remove out of the index in one batch, false if one of them is not in the scene.
+	bool _M_Erase_Nodes() {
+		try {
+			_M_node.EraseBatch(_M_remove_node.begin(), _M_remove_node.end());
+		} catch(std::out_of_range const&) {
+			return false;
+		}
+		for(auto node : _M_remove_node) {
+			_M_Leave(node);
+		}
+		return true;
+	}
+
+	/// Remove every node, in one batch.
+	void _M_Clear() {
+		_M_remove_node.clear();
+		for(auto iter = _M_node.BeginByKey<0>(); iter != _M_node.EndByKey<0>(); iter++) {
+			_M_remove_node.push_back((*iter).second);
+		}
+		_M_node.EraseBatch(_M_remove_node.begin(), _M_remove_node.end());
+		for(auto node : _M_remove_node) {
+			_M_Leave(node);
+			_M_Destroy_Block(node);
+		}
+		_M_remove_node.clear();
+	}
+
+	/// Drops the wake-ups, messages and dirty lists of the nodes, the wheel goes on from step __step.
+	void _M_Clear_Pending(std::size_t __step) {
+		_M_timing_wheel.Clear(__step);
+		_M_mailbox.Clear();
+		_M_spatial_grid.Clear();
+		for(auto& list : _M_dirty_list) {
+			list.handles.clear();
+		}
+		_M_dirty_round++;
+	}
+
+	/// Copy the activity into configurations which have it.
+	static void _S_Set_Active(dynamics::_Actable::_Configuration* __conf, bool __active) {
+		__conf->Active = __active;
+	}
+
+	static void _S_Set_Active(void*, bool) { }
+
+	/// Look up the checkpoint kind of a node or component.
+	std::uint32_t _M_Kind_Of(dynamics::Node* __node) const {
+		auto kind = _M_factory_kind.find(std::type_index(typeid(*__node)));
+		if(kind == _M_factory_kind.end()) {
+			throw std::out_of_range(std::string("bul::manager::SceneMgr::Checkpoint(...) : No factory registered for '")
+					+ typeid(*__node).name() + "'.");
+		}
+		return (*kind).second;
+	}
+
+	/// Serialize the scene into an image and hand it to the background writer.
+	void _M_Checkpoint(std::string const& __path, std::size_t __step) {
+		_Checkpoint_Buffer buffer;
+		buffer.Reserve(_M_checkpoint_size);
+
+		CheckpointHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.Magic, _S_checkpoint_magic, sizeof(header.Magic));
+		header.Version = _S_checkpoint_version;
+		header.CurrentStep = __step;
+		header.NodeCount = 0;
+		buffer.Write(header);
+
+		/// Nodes are written bucket by bucket. Buckets and partitions keep insertion order, so restoring them
+		/// in this order gives actors and triggers the same step order.
+		for(auto iter = _M_node.BeginByTag<0>(); iter != _M_node.EndByTag<0>(); iter++) {
+			for(auto node : (*iter).second) {
+				NodeRecord record;
+				std::memset(&record, 0, sizeof(record));
+				record.Id = node->GetId();
+				record.Tag = node->GetTag();
+				record.Flag = node->GetFlag();
+				record.Kind = _M_Kind_Of(node);
+				record.NodeType = static_cast<std::uint8_t>(node->GetType());
+				record.Active = 1;
+				record.Sleeping = node->IsSleeping() ? 1 : 0;
+				record.WakeStep = node->GetWakeStep();
+
+				if(node->GetType() != dynamics::Node_Type::Actor) {
+					buffer.Write(record);
+					header.NodeCount++;
+					continue;
+				}
+
+				auto actor = static_cast<dynamics::Actor*>(node);
+				auto const& datapool = actor->GetDataPool();
+				record.Active = actor->IsActive() ? 1 : 0;
+				record.DataPoolSize = datapool.Size();
+				record.DataPoolBytes = datapool.Size() * datapool.ElementSize();
+				record.SlotsBytes = actor->_M_Slots_Bytes();
+				record.ComponentCount = actor->_M_component.Size();
+				buffer.Write(record);
+				buffer.Write(datapool.Data(), record.DataPoolBytes);
+				if(record.SlotsBytes > 0) {
+					actor->_M_Save_Slots(buffer.Extend(record.SlotsBytes));
+				}
+				header.NodeCount++;
+
+				for(auto iter_p = actor->_M_component.BeginByTag<0>(); iter_p != actor->_M_component.EndByTag<0>(); iter_p++) {
+					for(auto component : (*iter_p).second) {
+						ComponentRecord component_record;
+						std::memset(&component_record, 0, sizeof(component_record));
+						component_record.Id = component->GetId();
+						component_record.Priority = component->GetPriority();
+						component_record.Tag = component->GetTag();
+						component_record.Flag = component->GetFlag();
+						component_record.Kind = _M_Kind_Of(component);
+						component_record.Active = component->IsActive() ? 1 : 0;
+						buffer.Write(component_record);
+					}
+				}
+			}
+		}
+		std::memcpy(buffer.Bytes().data(), &header, sizeof(header));
+
+		_M_checkpoint_size = buffer.Bytes().size();
+		_M_checkpoint_writer.Write(__path, std::move(buffer.Bytes()));
+	}
+
+	/// Destroys a node and gives its block back, for nodes which never joined the scene.
+	void _M_Destroy_Block(dynamics::Node* __node) {
+		if(_M_allocator) {
+			common::SlabAllocator::Delete(__node);
+		} else {
+			delete __node;
+		}
+	}
+
+	/// Destroys every node, and the nodes added by a step which did not complete (the buffer owns them).
+	/// Their blocks are given back to the allocator if __reuse, otherwise they go away with the slabs.
+	void _M_Clear(bool __reuse) {
+		_M_deferring = false;
+		_M_command.Drain([this, __reuse](_Command const& __command) {
+			if(__command.Type == Command_Type::AddNode || __command.Type == Command_Type::AddComponent) {
+				__reuse ? _M_Destroy_Block(__command.Target) : _M_Destroy(__command.Target);
+			}
+		});
+		_M_remove_node.clear();
+		for(auto iter = _M_node.BeginByKey<0>(); iter != _M_node.EndByKey<0>(); iter++) {
+			_M_remove_node.push_back((*iter).second);
+		}
+		_M_node.EraseBatch(_M_remove_node.begin(), _M_remove_node.end());
+		for(auto node : _M_remove_node) {
+			node->_M_handle = common::Handle();
+			__reuse ? _M_Destroy_Block(node) : _M_Destroy(node);
+		}
+		_M_remove_node.clear();
+	}
+
+	/// Destroys a node at teardown, its block goes away with the slabs.
+	void _M_Destroy(dynamics::Node* __node) {
+		if(_M_allocator) {
+			common::SlabAllocator::Destroy(__node);
+		} else {
+			delete __node;
+		}
+	}
+
+	/// Call one active actor and its components. The activity is tested again in case an actor was
+	/// deactivated earlier in this step, the partitions only follow at the end of the step.
+	static void _M_Step_Actor(dynamics::Actor* __actor) {
+		BUL_PROFILE_NODE("Actor", __actor->GetId(), typeid(*__actor));
+		if(__actor -> IsActive()) {
+			__actor -> PreAct();
+			__actor -> _M_Act();
+			__actor -> PostAct();
+		}
+	}
+
+	static void _M_Step_Actor_Anyway(dynamics::Actor* __actor) {
+		BUL_PROFILE_NODE("Actor", __actor->GetId(), typeid(*__actor));
+		__actor -> _M_Act_Anyway();
+	}
+
+	/// Call the active actors, then the actors which have components acting anyway. Dormant actors are not
+	/// touched. With a thread pool, each pass returns after all of its actors are done.
+	void _M_Step_Actors() {
+		dynamics::Actor* const* actors = _M_actor_partition.data();
+		std::size_t const active = _M_actor_partition.ActiveSize();
+		dynamics::Actor* const* anyway = _M_anyway_partition.data();
+		std::size_t const anyway_count = _M_anyway_partition.ActiveSize();
+
+		if(_M_thread_pool) {
+			_M_thread_pool->ParallelFor(0, active, _M_chunk_size, [actors](std::size_t __i) {
+				_M_Step_Actor(actors[__i]);
+			});
+			_M_thread_pool->ParallelFor(0, anyway_count, _M_chunk_size, [anyway](std::size_t __i) {
+				_M_Step_Actor_Anyway(anyway[__i]);
+			});
+			return;
+		}
+		for(std::size_t i = 0; i < active; i++) {
+			_M_Step_Actor(actors[i]);
+		}
+		for(std::size_t i = 0; i < anyway_count; i++) {
+			_M_Step_Actor_Anyway(anyway[i]);
+		}
+	}
+
+	/// Reuse a snapshot no monitor holds any more, or make a new one.
+	std::shared_ptr<Snapshot> _M_Acquire_Snapshot() {
+		for(auto& snapshot : _M_snapshot_pool) {
+			if(snapshot.use_count() == 1) {
+				/// Pairs with the release of the last reference on the monitor thread.
+				std::atomic_thread_fence(std::memory_order_acquire);
+				return snapshot;
+			}
+		}
+		_M_snapshot_pool.push_back(std::make_shared<Snapshot>());
+		return _M_snapshot_pool.back();
+	}
+
+	/// Copy the actors' state into a snapshot and hand it to the asynchronous monitors which want it.
+	void _M_Publish(std::vector<AsyncMonitor*> const& __monitors) {
+		_M_async_wanting.clear();
+		for(auto monitor : __monitors) {
+			if(monitor->_M_Wants(_M_current_step)) {
+				_M_async_wanting.push_back(monitor);
+			}
+		}
+		if(_M_async_wanting.empty()) {
+			return;
+		}
+
+		auto snapshot = _M_Acquire_Snapshot();
+		snapshot->Step = _M_current_step;
+		std::size_t count = _M_node.CountTag<0>(dynamics::Node_Type::Actor);
+		snapshot->Actors.resize(count);
+		if(count > 0) {
+			auto& actor_list = _M_node.GetByTag<0>(dynamics::Node_Type::Actor);
+			for(std::size_t i = 0; i < count; i++) {
+				auto actor = static_cast<dynamics::Actor*>(actor_list[i]);
+				auto& state = snapshot->Actors[i];
+				state.Id = actor->GetId();
+				state.Tag = actor->GetTag();
+				state.Flag = actor->GetFlag();
+				state.Active = actor->IsActive();
+				state.DataPool = actor->GetDataPool();
+			}
+		}
+
+		std::shared_ptr<const Snapshot> published(snapshot);
+		for(auto monitor : _M_async_wanting) {
+			monitor->_M_Publish(published);
+		}
 	}
 
 	/// Run the simulation.
 	template<std::size_t _PH>
 	void _M_Run() {
+		_Async_Stopper stopper;
+		std::vector<AsyncMonitor*>& async_monitor = stopper.monitors;
 		for(auto monitor : _M_monitor) {
 			monitor ->_M_scenemgr = this;
 			monitor -> Initialize();
+			if(auto async = dynamic_cast<AsyncMonitor*>(monitor)) {
+				async->_M_Start();
+				async_monitor.push_back(async);
+			}
 		}
 
 		_M_step_lock = true;
 		while(!IsTerminated()) {
-			PreStep();
+			{
+				BUL_PROFILE_PHASE(common::Profile_Phase::PreStep);
+				PreStep();
+			}
 			_M_Step();
-			PostStep();
-			for(auto monitor : _M_monitor) {
-				monitor -> Step();
+			{
+				BUL_PROFILE_PHASE(common::Profile_Phase::PostStep);
+				PostStep();
+			}
+			{
+				BUL_PROFILE_PHASE(common::Profile_Phase::Monitors);
+				for(auto monitor : _M_monitor) {
+					BUL_PROFILE_NODE("Monitor", 0, typeid(*monitor));
+					monitor -> Step();
+				}
+				if(!async_monitor.empty()) {
+					_M_Publish(async_monitor);
+				}
 			}
+			ClearDirty();
 			_M_current_step++;
+			if(_M_checkpoint_interval > 0 && _M_current_step % _M_checkpoint_interval == 0) {
+				_M_Checkpoint(_M_checkpoint_path, _M_current_step);
+			}
+		}
+		_M_step_lock = false;
+		if(_M_checkpoint_interval > 0) {
+			_M_checkpoint_writer.Wait();
+		}
+		/// Every async monitor is finished even if one of them failed, the first failure is rethrown after the
+		/// monitors are finalized.
+		std::exception_ptr error;
+		for(auto monitor : async_monitor) {
+			try {
+				monitor -> _M_Finish();
+			} catch(...) {
+				if(!error) {
+					error = std::current_exception();
+				}
+			}
 		}
-		_M_step_lock = false;		
+		async_monitor.clear();
 
 		for(auto monitor : _M_monitor) {
 			monitor -> Finalize();
 		}
+		if(error) {
+			std::rethrow_exception(error);
+		}
 	}
 
 	/// Add monitors.
@@ -201,18 +1345,172 @@ protected:
 	}
 
 private:
+	/// Stops the threads of the async monitors started by _M_Run(), whichever way it is left.
+	struct _Async_Stopper {
+		std::vector<AsyncMonitor*> monitors;
+
+		~_Async_Stopper() {
+			for(auto monitor : monitors) {
+				monitor->_M_Stop();
+			}
+		}
+	};
+
+	friend class dynamics::Node;
+	friend class dynamics::Actor;
+
 	std::size_t const _M_max_step;
 	std::size_t _M_current_step;
+	/// Odd while the nodes of a step act, double-buffered DataPools commit their writes when it moves on.
+	std::uint64_t _M_data_epoch;
 
 	bool _M_terminated;
 	bool _M_step_lock;
+	bool _M_deferring;
 
 	storage_type _M_node;
+	common::HandleTable<dynamics::Node> _M_handle_table;
+
+	std::size_t const _M_chunk_size;
+	std::unique_ptr<common::SlabAllocator> _M_allocator;
+	std::unique_ptr<common::ThreadPool> _M_thread_pool;
+	/// Actors with the active ones first, and with those having components acting anyway first.
+	common::Partition<dynamics::Actor*> _M_actor_partition;
+	common::Partition<dynamics::Actor*> _M_anyway_partition;
+	/// Triggers with the awake ones first, and the wake-ups of sleeping nodes by step.
+	common::Partition<dynamics::Trigger*> _M_trigger_partition;
+	common::TimingWheel<common::Handle> _M_timing_wheel;
+	/// Flags of the nodes by handle index.
+	common::FlagIndex _M_flag_index;
+
+	std::size_t const _M_checkpoint_interval;
+	std::string const _M_checkpoint_path;
+	std::size_t _M_checkpoint_size;
+	_Checkpoint_Writer _M_checkpoint_writer;
+	std::unordered_map<std::type_index, std::uint32_t> _M_factory_kind;
+	std::unordered_map<std::uint32_t, node_factory_type> _M_node_factory;
+	std::unordered_map<std::uint32_t, component_factory_type> _M_component_factory;
+
+	std::vector<std::shared_ptr<Snapshot>> _M_snapshot_pool;
+	std::vector<AsyncMonitor*> _M_async_wanting;
+
+	_Command_Buffer _M_command;
+	/// Messages sent during a step, and those delivered at its start.
+	_Mailbox _M_mailbox;
+	/// Positions of the actors as of the start of the step.
+	std::vector<std::size_t> const _M_position_slots;
+	common::SpatialGrid<common::Handle> _M_spatial_grid;
+
+	/// Handles of the actors whose DataPool became dirty, one list per worker, each on its own cache line.
+	struct _Dirty_List {
+		std::vector<common::Handle> handles;
+		char _padding[64 - sizeof(std::vector<common::Handle>) % 64];
+	};
+	std::vector<_Dirty_List> _M_dirty_list;
+	/// Bumped by ClearDirty(), an actor is listed once per round.
+	std::uint64_t _M_dirty_round;
+	std::vector<dynamics::Node*> _M_add_node;
+	std::vector<dynamics::Node*> _M_sync_node;
+	std::vector<dynamics::Node*> _M_schedule_node;
+	std::vector<dynamics::Node*> _M_sync_flag;
+	std::vector<dynamics::Actor::Component*> _M_sync_component;
+	std::vector<dynamics::Actor::Component*> _M_add_component;
+	std::vector<dynamics::Actor::Component*> _M_remove_component;
+	std::vector<dynamics::Node*> _M_remove_node;
+	std::vector<dynamics::Node*> _M_failed;
+
+	std::vector<std::unique_ptr<_System_Base>> _M_system;
+	std::unordered_map<std::type_index, _System_Base*> _M_system_index;
 
 	std::set<Monitor*> _M_monitor;
 };
 
 } /* namespace manager */
+
+namespace dynamics {
+/// Node and actor members which need the scene manager.
+inline bool Actor::_M_Defer(manager::Command_Type __type, Component* __component) {
+	auto scenemgr = GetSceneMgr();
+	if(!scenemgr || !scenemgr->_M_deferring) {
+		return false;
+	}
+	scenemgr->_M_Push_Command(__type, __component);
+	return true;
+}
+
+inline void Actor::Component::_M_Active_Changed() {
+	if(_M_actor && !GetHandle().IsNull() && !_M_actor->_M_Defer(manager::Command_Type::SyncComponent, this)) {
+		_M_actor->_M_Sync_Component(this);
+	}
+}
+
+inline void Actor::_M_Active_Changed() {
+	auto scenemgr = GetSceneMgr();
+	if(scenemgr && !GetHandle().IsNull()) {
+		scenemgr->_M_Sync_Node(this);
+	}
+}
+
+inline void Actor::_S_Data_Dirty(void* __actor) {
+	auto actor = static_cast<Actor*>(__actor);
+	auto scenemgr = actor->GetSceneMgr();
+	if(scenemgr && !actor->GetHandle().IsNull()) {
+		scenemgr->_M_Mark_Dirty(actor);
+	}
+}
+
+inline void Actor::_M_Anyway_Changed() {
+	auto scenemgr = GetSceneMgr();
+	if(scenemgr && !GetHandle().IsNull()) {
+		scenemgr->_M_Sync_Node(this);
+	}
+}
+
+inline void Node::_M_Schedule_Changed() {
+	if(_M_scenemgr && !_M_handle.IsNull() && (_M_type == Node_Type::Actor || _M_type == Node_Type::Trigger)) {
+		_M_scenemgr->_M_Schedule_Node(this);
+	}
+}
+
+template<typename _Tp>
+inline void Node::Send(common::Handle const& __recipient, _Tp const& __message) {
+	_M_scenemgr->Send(__recipient, __message);
+}
+
+template<typename _Tp>
+inline manager::MessageRange<_Tp> Node::GetMessages() const {
+	if(!_M_scenemgr || _M_type == Node_Type::Actor_Component) {
+		return manager::MessageRange<_Tp>();
+	}
+	return _M_scenemgr->Receive<_Tp>(_M_handle);
+}
+
+inline void Node::_M_Flag_Changed() {
+	if(_M_scenemgr && !_M_handle.IsNull() && _M_type != Node_Type::Actor_Component) {
+		_M_scenemgr->_M_Sync_Flag(this);
+	}
+}
+
+inline void Actor::_M_Attach_System(Component* __component) {
+	auto scenemgr = GetSceneMgr();
+	if(!scenemgr || scenemgr->_M_system_index.empty()) {
+		return;
+	}
+	auto system = scenemgr->_M_system_index.find(std::type_index(typeid(*__component)));
+	if(system != scenemgr->_M_system_index.end()) {
+		(*system).second->_M_Attach(__component);
+	}
+}
+
+inline void Actor::_M_Detach_System(Component* __component) {
+	__component->_M_system->_M_Detach(__component);
+}
+
+inline void Actor::_M_Sync_System(Component* __component) {
+	__component->_M_system->_M_Sync(__component);
+}
+
+} /* namespace dynamics */
 } /* namespace bul */
 
 #endif /* _BUL_MANAGER_SCENEMGR_H */
@@ -0,0 +1,265 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_MANAGER_SYSTEM_H
+#define _BUL_MANAGER_SYSTEM_H
+
+#include <cstdint>
+#include <typeinfo>
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "../common/container.h"
+#include "../common/profiler.h"
+#include "../common/threadpool.h"
+#include "../dynamics/actor.h"
+
+namespace bul {
+namespace manager {
+/// A contiguous range of components of one type, with the data pools of their actors.
+template<typename _Tp>
+class SystemSpan {
+public:
+	/// Defines some types.
+	typedef dynamics::Actor::datapool_type datapool_type;
+
+	SystemSpan(_Tp* const* __component, datapool_type* const* __datapool, std::size_t __size) :
+			_M_component(__component), _M_datapool(__datapool), _M_size(__size) { }
+
+	/// Number of components in the span.
+	std::size_t Size() const {
+		return _M_size;
+	}
+
+	bool Empty() const {
+		return _M_size == 0;
+	}
+
+	/// The i-th component and the data pool of its actor.
+	_Tp* operator[](std::size_t __index) const {
+		return _M_component[__index];
+	}
+
+	_Tp* GetComponent(std::size_t __index) const {
+		return _M_component[__index];
+	}
+
+	datapool_type & GetDataPool(std::size_t __index) const {
+		return *_M_datapool[__index];
+	}
+
+	/// Iterate over the components.
+	_Tp* const* begin() const {
+		return _M_component;
+	}
+
+	_Tp* const* end() const {
+		return _M_component + _M_size;
+	}
+
+	/// Sub-range [__begin, __end).
+	SystemSpan Slice(std::size_t __begin, std::size_t __end) const {
+		return SystemSpan(_M_component + __begin, _M_datapool + __begin, __end - __begin);
+	}
+
+private:
+	_Tp* const* _M_component;
+	datapool_type* const* _M_datapool;
+	std::size_t _M_size;
+};
+
+/// Type-erased part of a system, seen by the scene manager and the actors.
+class _System_Base {
+public:
+	_System_Base(std::size_t __priority) : _M_priority(__priority) { }
+	virtual ~_System_Base() { }
+
+	std::size_t GetPriority() const {
+		return _M_priority;
+	}
+
+	/// Start / stop driving a component.
+	virtual void _M_Attach(dynamics::Actor::Component* __component) = 0;
+	virtual void _M_Detach(dynamics::Actor::Component* __component) = 0;
+
+	/// The component, or its actor, was switched, put to sleep or woken.
+	virtual void _M_Sync(dynamics::Actor::Component* __component) = 0;
+
+	/// Call the callbacks, on the thread pool if there is one.
+	virtual void _M_Run(common::ThreadPool* __pool, std::size_t __chunk_size) = 0;
+	virtual void _M_Run_Anyway(common::ThreadPool* __pool, std::size_t __chunk_size) = 0;
+
+	/// Number of components driven.
+	virtual std::size_t _M_Size() const = 0;
+
+private:
+	std::size_t const _M_priority;
+};
+
+/// All components of the concrete type _Tp, stored contiguously and stepped by one callback per step. The
+/// components are grouped by actor, in the order of the actors' Ids, and in the order they were attached.
+/// On a thread pool, the components of one actor are always handed to the same call, so an actor may have
+/// several components of the type even when the scene runs more than one thread.
+template<typename _Tp>
+class System : public _System_Base {
+public:
+	/// Defines some types.
+	typedef SystemSpan<_Tp> span_type;
+	typedef std::function<void(span_type const&)> callback_type;
+
+	System(std::size_t __priority, callback_type const& __act, callback_type const& __act_anyway) :
+			_System_Base(__priority), _M_act(__act), _M_act_anyway(__act_anyway) {
+		_M_seq = 0;
+		_M_size = 0;
+		_M_act_changed = false;
+		_M_anyway_changed = false;
+	}
+	virtual ~System() { }
+
+	virtual void _M_Attach(dynamics::Actor::Component* __component) override {
+		auto actor = __component->GetActor();
+		auto const key = std::make_pair(static_cast<std::uint64_t>(actor->GetId()), _M_seq++);
+		__component->_M_system = this;
+		_M_act_partition.Push(static_cast<_Tp*>(__component), _S_Acts(__component), &__component->_M_system_slot, key);
+		if(__component->_M_act_anyway) {
+			_M_anyway_partition.Push(static_cast<_Tp*>(__component), !actor->IsSleeping(),
+					&__component->_M_system_anyway_slot, key);
+			_M_anyway_changed = true;
+		}
+		actor->_M_system_count++;
+		_M_size++;
+		_M_act_changed = true;
+	}
+
+	virtual void _M_Detach(dynamics::Actor::Component* __component) override {
+		_M_act_partition.Erase(&__component->_M_system_slot);
+		if(__component->_M_act_anyway) {
+			_M_anyway_partition.Erase(&__component->_M_system_anyway_slot);
+			_M_anyway_changed = true;
+		}
+		__component->GetActor()->_M_system_count--;
+		__component->_M_system = nullptr;
+		_M_size--;
+		_M_act_changed = true;
+	}
+
+	virtual void _M_Sync(dynamics::Actor::Component* __component) override {
+		bool const acts = _S_Acts(__component);
+		if(acts != _M_act_partition.IsActive(&__component->_M_system_slot)) {
+			_M_act_partition.SetActive(&__component->_M_system_slot, acts);
+			_M_act_changed = true;
+		}
+		bool const awake = !__component->GetActor()->IsSleeping();
+		if(__component->_M_act_anyway && awake != _M_anyway_partition.IsActive(&__component->_M_system_anyway_slot)) {
+			_M_anyway_partition.SetActive(&__component->_M_system_anyway_slot, awake);
+			_M_anyway_changed = true;
+		}
+	}
+
+	/// Active components of active, awake actors only.
+	virtual void _M_Run(common::ThreadPool* __pool, std::size_t __chunk_size) override {
+		if(!_M_act) {
+			return;
+		}
+		if(_M_act_changed) {
+			_S_Commit(_M_act_partition, _M_act_datapool);
+			_M_act_changed = false;
+		}
+		BUL_PROFILE_COMPONENT(typeid(_Tp), GetPriority());
+		_M_Call(_M_act, span_type(_M_act_partition.data(), _M_act_datapool.data(), _M_act_partition.ActiveSize()),
+				__pool, __chunk_size);
+	}
+
+	/// Components acting anyway (Configuration::ActAnyway) of awake actors, active or not, as the actors
+	/// call them.
+	virtual void _M_Run_Anyway(common::ThreadPool* __pool, std::size_t __chunk_size) override {
+		if(!_M_act_anyway) {
+			return;
+		}
+		if(_M_anyway_changed) {
+			_S_Commit(_M_anyway_partition, _M_anyway_datapool);
+			_M_anyway_changed = false;
+		}
+		BUL_PROFILE_COMPONENT(typeid(_Tp), GetPriority());
+		_M_Call(_M_act_anyway, span_type(_M_anyway_partition.data(), _M_anyway_datapool.data(),
+				_M_anyway_partition.ActiveSize()), __pool, __chunk_size);
+	}
+
+	virtual std::size_t _M_Size() const override {
+		return _M_size;
+	}
+
+private:
+	/// Components ordered by the Id of their actor, then by attachment.
+	typedef common::Partition<_Tp*, std::pair<std::uint64_t, std::uint64_t>> partition_type;
+
+	static bool _S_Acts(dynamics::Actor::Component const* __component) {
+		auto actor = __component->GetActor();
+		return __component->IsActive() && actor->IsActive() && !actor->IsSleeping();
+	}
+
+	/// Puts the active components back in order, and lists the data pools of their actors alongside.
+	static void _S_Commit(partition_type& __partition, std::vector<dynamics::Actor::datapool_type*>& __datapool) {
+		__partition.Commit();
+		__datapool.resize(__partition.ActiveSize());
+		for(std::size_t i = 0; i < __datapool.size(); i++) {
+			__datapool[i] = &__partition.data()[i]->GetActor()->GetDataPool();
+		}
+	}
+
+	/// The first position from __position on which starts an actor, or the end of the span.
+	static std::size_t _S_Boundary(span_type const& __span, std::size_t __position) {
+		if(__position >= __span.Size()) {
+			return __span.Size();
+		}
+		while(__position > 0 && __position < __span.Size() &&
+				__span[__position]->GetActor() == __span[__position - 1]->GetActor()) {
+			__position++;
+		}
+		return __position;
+	}
+
+	/// The whole span at once, or chunks of it on the thread pool. Chunks of about __chunk_size components are
+	/// cut at actor boundaries: only one thread may write a DataPool during a step, so all components of one
+	/// actor go to the same chunk.
+	static void _M_Call(callback_type const& __callback, span_type const& __span,
+			common::ThreadPool* __pool, std::size_t __chunk_size) {
+		if(__span.Empty()) {
+			return;
+		}
+		if(!__pool || __span.Size() <= __chunk_size) {
+			__callback(__span);
+			return;
+		}
+		std::size_t chunks = (__span.Size() + __chunk_size - 1) / __chunk_size;
+		__pool->ParallelFor(0, chunks, 1, [&__callback, &__span, __chunk_size](std::size_t __i) {
+			std::size_t begin = _S_Boundary(__span, __i * __chunk_size);
+			std::size_t end = _S_Boundary(__span, (__i + 1) * __chunk_size);
+			if(begin < end) {
+				__callback(__span.Slice(begin, end));
+			}
+		});
+	}
+
+	callback_type const _M_act;
+	callback_type const _M_act_anyway;
+
+	/// The components for _M_act and, if they act anyway, for _M_act_anyway, with the data pools of the
+	/// active ones; the lists are rebuilt before a call when the partition changed.
+	partition_type _M_act_partition;
+	partition_type _M_anyway_partition;
+	std::vector<dynamics::Actor::datapool_type*> _M_act_datapool;
+	std::vector<dynamics::Actor::datapool_type*> _M_anyway_datapool;
+	bool _M_act_changed;
+	bool _M_anyway_changed;
+	std::uint64_t _M_seq;
+	std::size_t _M_size;
+};
+
+} /* namespace manager */
+} /* namespace bul */
+
+#endif /* _BUL_MANAGER_SYSTEM_H */
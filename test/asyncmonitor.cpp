@@ -0,0 +1,130 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "../bulwark.h"
+#include "test.h"
+
+namespace bul {
+namespace test {
+namespace {
+/// Throws from PreStep() when the step reaches FailAt.
+class Scene : public manager::SceneMgr {
+public:
+	Scene(Configuration* __conf) : SceneMgr(__conf) { }
+
+	std::size_t FailAt = static_cast<std::size_t>(-1);
+
+protected:
+	virtual void PreStep() override {
+		if(GetCurrentStep() == FailAt) {
+			throw std::runtime_error("scene failure");
+		}
+	}
+
+	virtual void PostStep() override { }
+};
+
+class Idle : public dynamics::Actor {
+public:
+	Idle(Configuration* __conf) : Actor(__conf) { }
+
+protected:
+	virtual void PreAct() override { }
+	virtual void PostAct() override { }
+};
+
+/// Consumes slowly, throws on the snapshot of step FailAt.
+class Consumer : public manager::AsyncMonitor {
+public:
+	Consumer(Configuration* __conf) : AsyncMonitor(__conf), Finalized(false) { }
+
+	std::size_t FailAt = static_cast<std::size_t>(-1);
+	std::atomic<std::size_t> Seen { 0 };
+	bool Finalized;
+
+protected:
+	virtual void Initialize() override { }
+
+	virtual void Consume(manager::Snapshot const& __snapshot) override {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		if(__snapshot.Step == FailAt) {
+			throw std::runtime_error("consumer failure");
+		}
+		Seen++;
+	}
+
+	virtual void Finalize() override {
+		Finalized = true;
+	}
+};
+
+Scene::Configuration _Configuration() {
+	Scene::Configuration conf;
+	conf.MaxStep = 20;
+	return conf;
+}
+
+void _Populate(Scene& __scene) {
+	for(std::size_t id = 1; id <= 8; id++) {
+		Idle::Configuration conf;
+		conf.Id = id;
+		conf.DataPoolSize = 2;
+		__scene.AddNode<Idle>(&conf);
+	}
+}
+
+/// Runs __scene with two consumers and returns the message of what Run(...) threw, if anything.
+std::string _Run(Scene& __scene, Consumer& __first, Consumer& __second) {
+	try {
+		__scene.Run(&__first, &__second);
+	} catch(std::runtime_error const& __error) {
+		return __error.what();
+	}
+	return std::string();
+}
+
+} /* namespace */
+
+void RegisterAsyncMonitor(Runner& __runner) {
+	/// The scene fails: Run(...) lets the error through after the consumers drained their queue and stopped,
+	/// so they can be destroyed right away.
+	__runner.Add("AsyncMonitor::SceneFailure", []() {
+		Scene::Configuration conf = _Configuration();
+		Scene scene(&conf);
+		_Populate(scene);
+		scene.FailAt = 7;
+		Consumer::Configuration consumer_conf;
+		consumer_conf.QueueSize = 16;
+		Consumer first(&consumer_conf);
+		Consumer second(&consumer_conf);
+		BUL_CHECK(_Run(scene, first, second) == "scene failure");
+		BUL_CHECK(first.GetConsumed() == 7 && second.GetConsumed() == 7);
+		BUL_CHECK(!first.Finalized && !second.Finalized);
+	});
+
+	/// The first consumer fails: the second one is still finished and both are finalized before the error
+	/// comes out of Run(...).
+	__runner.Add("AsyncMonitor::ConsumerFailure", []() {
+		Scene::Configuration conf = _Configuration();
+		Scene scene(&conf);
+		_Populate(scene);
+		Consumer::Configuration consumer_conf;
+		consumer_conf.QueueSize = 64;
+		Consumer first(&consumer_conf);
+		first.FailAt = 19;
+		Consumer second(&consumer_conf);
+		BUL_CHECK(_Run(scene, first, second) == "consumer failure");
+		BUL_CHECK(first.Seen == 19 && second.Seen == 20);
+		BUL_CHECK(first.Finalized && second.Finalized);
+	});
+}
+
+} /* namespace test */
+} /* namespace bul */
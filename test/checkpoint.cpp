@@ -0,0 +1,297 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#include <cstdio>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "../bulwark.h"
+#include "test.h"
+
+namespace bul {
+namespace test {
+namespace {
+/// Steps of a run, the original scene writes its only checkpoint at _S_checkpoint_step.
+static const std::size_t _S_max_step = 30;
+static const std::size_t _S_checkpoint_step = 16;
+
+class Scene : public manager::SceneMgr {
+public:
+	Scene(Configuration* __conf) : SceneMgr(__conf), _M_traced(__conf->Threads <= 1) { }
+
+	/// Registers how the node and component types below are rebuilt.
+	void RegisterFactories();
+
+	/// Adds a walker with its two components.
+	void Populate(std::size_t __id);
+
+	/// Records which actor acted, in serial runs only.
+	void Trace(std::size_t __id) {
+		if(_M_traced) {
+			_M_trace.push_back(std::make_pair(GetCurrentStep(), __id));
+		}
+	}
+
+	std::vector<std::pair<std::size_t, std::size_t>> const& GetTrace() const {
+		return _M_trace;
+	}
+
+protected:
+	/// Structural changes and switches at fixed steps, before and after the checkpoint.
+	virtual void PreStep() override { }
+	virtual void PostStep() override;
+
+private:
+	bool const _M_traced;
+	std::vector<std::pair<std::size_t, std::size_t>> _M_trace;
+};
+
+class Walker : public dynamics::Actor {
+public:
+	Walker(Configuration* __conf) : Actor(__conf) { }
+
+protected:
+	virtual void PreAct() override {
+		static_cast<Scene*>(GetSceneMgr())->Trace(GetId());
+		for(int message : GetMessages<int>()) {
+			GetDataPool().Set<int>(2, GetDataPool().Get<int>(2) + message);
+		}
+	}
+
+	/// Every third walker naps for a few steps.
+	virtual void PostAct() override {
+		if(GetId() % 3 == 0) {
+			SleepUntil(GetSceneMgr()->GetCurrentStep() + 2 + GetId() % 5);
+		}
+	}
+};
+
+class Ticker : public dynamics::Trigger {
+public:
+	Ticker(Configuration* __conf) : Trigger(__conf) { }
+
+protected:
+	/// Bumps the first walker every third step.
+	virtual void Act() override {
+		auto& datapool = static_cast<dynamics::Actor*>(GetSceneMgr()->GetNodeById(1))->GetDataPool();
+		datapool.Set<int>(1, datapool.Get<int>(1) + 100);
+		SleepUntil(GetSceneMgr()->GetCurrentStep() + 3);
+	}
+};
+
+class Mixer : public dynamics::Actor::Component {
+public:
+	Mixer(Configuration* __conf) : Component(__conf) { }
+
+protected:
+	virtual void Act() override {
+		int value = GetSharedData<int>(0);
+		SetSharedData<int>(0, static_cast<int>((value * 31 + GetActor()->GetId() + GetSceneMgr()->GetCurrentStep()) % 100003));
+	}
+
+	virtual void Act_Anyway() override { }
+};
+
+class Counter : public dynamics::Actor::Component {
+public:
+	Counter(Configuration* __conf) : Component(__conf) { }
+
+protected:
+	/// Only meaningful after Mixer, which has a lower priority.
+	virtual void Act() override {
+		SetSharedData<int>(1, GetSharedData<int>(1) + GetSharedData<int>(0) % 13);
+	}
+
+	virtual void Act_Anyway() override { }
+};
+
+struct Position : common::Slot<float, 2> { };
+struct Moves : common::Slot<int> { };
+
+/// Keeps its whole state in schema slots, its DataPool is empty.
+class Body : public dynamics::SchemaActor<common::Schema<Position, Moves>> {
+public:
+	Body(Configuration* __conf) : SchemaActor(__conf) { }
+
+protected:
+	virtual void PreAct() override {
+		auto& slots = GetSlots();
+		slots.Set<Position, 0>(slots.Get<Position, 0>() + 0.5f + GetId());
+		slots.Set<Position, 1>(slots.Get<Position, 1>() * 0.75f + GetSceneMgr()->GetCurrentStep());
+		slots.Set<Moves>(slots.Get<Moves>() + 1);
+	}
+
+	virtual void PostAct() override { }
+};
+
+void Scene::RegisterFactories() {
+	RegisterNodeFactory<Walker>(1);
+	RegisterNodeFactory<Ticker>(2);
+	RegisterNodeFactory<Body>(3);
+	RegisterComponentFactory<Mixer>(10);
+	RegisterComponentFactory<Counter>(11);
+}
+
+void Scene::Populate(std::size_t __id) {
+	Walker::Configuration conf;
+	conf.Id = __id;
+	conf.DataPoolSize = 3;
+	auto walker = AddNode<Walker>(&conf);
+	for(std::size_t i = 0; i < 3; i++) {
+		walker->GetDataPool().Set<int>(i, 0);
+	}
+
+	Mixer::Configuration mixer_conf;
+	mixer_conf.Id = 1;
+	mixer_conf.ActAnyway = false;
+	walker->AddComponent<Mixer>(&mixer_conf);
+
+	Counter::Configuration counter_conf;
+	counter_conf.Id = 2;
+	counter_conf.Priority = 1;
+	counter_conf.ActAnyway = false;
+	counter_conf.Active = __id % 4 != 0;
+	walker->AddComponent<Counter>(&counter_conf);
+}
+
+void Scene::PostStep() {
+	std::size_t const step = GetCurrentStep();
+	if(step == 3) {
+		RemoveNode(GetNodeById(2));
+		Populate(100);
+	} else if(step == 5 || step == 20) {
+		auto walker = static_cast<dynamics::Actor*>(GetNodeById(step == 5 ? 7 : 11));
+		walker->GetComponentById(2)->SetActive(!walker->GetComponentById(2)->IsActive());
+	} else if(step == 12) {
+		static_cast<dynamics::Actor*>(GetNodeById(9))->SetActive(false);
+	} else if(step == 22) {
+		static_cast<dynamics::Actor*>(GetNodeById(9))->SetActive(true);
+	}
+}
+
+/// Builds the starting scene: twenty walkers, a ticker and four bodies.
+std::unique_ptr<Scene> _Build(std::size_t __threads, std::size_t __checkpoint_interval, std::string const& __path) {
+	Scene::Configuration conf;
+	conf.MaxStep = _S_max_step;
+	conf.Threads = __threads;
+	conf.ChunkSize = 4;
+	conf.CheckpointInterval = __checkpoint_interval;
+	conf.CheckpointPath = __path;
+	std::unique_ptr<Scene> scene(new Scene(&conf));
+	scene->RegisterFactories();
+	for(std::size_t id = 1; id <= 20; id++) {
+		scene->Populate(id);
+	}
+	dynamics::Trigger::Configuration ticker_conf;
+	ticker_conf.Id = 1000;
+	scene->AddNode<Ticker>(&ticker_conf);
+	for(std::size_t id = 200; id < 204; id++) {
+		Body::Configuration body_conf;
+		body_conf.Id = id;
+		scene->AddNode<Body>(&body_conf);
+	}
+	return scene;
+}
+
+/// What a run leaves behind, by node id.
+typedef std::map<std::size_t, std::tuple<int, int, int, bool, std::size_t, bool, bool>> State;
+
+State _Capture(Scene& __scene) {
+	State state;
+	for(auto node : __scene.GetNodesByType(dynamics::Node_Type::Actor)) {
+		if(dynamic_cast<Body*>(node)) {
+			continue;
+		}
+		auto actor = static_cast<dynamics::Actor*>(node);
+		auto const& datapool = actor->GetDataPool();
+		state[actor->GetId()] = std::make_tuple(datapool.Get<int>(0), datapool.Get<int>(1), datapool.Get<int>(2),
+				actor->IsSleeping(), actor->GetWakeStep(), actor->IsActive(), actor->GetComponentById(2)->IsActive());
+	}
+	for(auto node : __scene.GetNodesByType(dynamics::Node_Type::Trigger)) {
+		state[node->GetId()] = std::make_tuple(0, 0, 0, node->IsSleeping(), node->GetWakeStep(), true, true);
+	}
+	return state;
+}
+
+/// The schema slots of the bodies, by node id.
+typedef std::map<std::size_t, std::tuple<float, float, int>> BodyState;
+
+BodyState _Capture_Bodies(Scene& __scene) {
+	BodyState state;
+	for(auto node : __scene.GetNodesByType(dynamics::Node_Type::Actor)) {
+		if(auto body = dynamic_cast<Body*>(node)) {
+			auto const& slots = body->GetSlots();
+			state[body->GetId()] = std::make_tuple(slots.Get<Position, 0>(), slots.Get<Position, 1>(), slots.Get<Moves>());
+		}
+	}
+	return state;
+}
+
+/// The steps of a trace from __step on.
+std::vector<std::pair<std::size_t, std::size_t>> _Since(std::vector<std::pair<std::size_t, std::size_t>> const& __trace,
+		std::size_t __step) {
+	std::vector<std::pair<std::size_t, std::size_t>> since;
+	for(auto const& entry : __trace) {
+		if(entry.first >= __step) {
+			since.push_back(entry);
+		}
+	}
+	return since;
+}
+
+/// Runs the original scene with a checkpoint, then resumes from it in __restored, which must end in the same
+/// state and, if serial, call the actors in the same order.
+void _Check_Resume(std::size_t __threads, Scene& __restored, std::string const& __path) {
+	auto original = _Build(__threads, _S_checkpoint_step, __path);
+	original->Run();
+	original->WaitCheckpoint();
+
+	std::size_t const traced = __restored.GetTrace().size();
+	__restored.Restore(__path);
+	BUL_CHECK(__restored.GetCurrentStep() == _S_checkpoint_step);
+	__restored.Run();
+	std::remove(__path.c_str());
+
+	BUL_CHECK(_Capture(__restored) == _Capture(*original));
+	BUL_CHECK(_Capture_Bodies(__restored) == _Capture_Bodies(*original));
+	BUL_CHECK(std::get<2>(_Capture_Bodies(__restored)[200]) == static_cast<int>(_S_max_step));
+	std::vector<std::pair<std::size_t, std::size_t>> resumed(__restored.GetTrace().begin() + traced, __restored.GetTrace().end());
+	BUL_CHECK(resumed == _Since(original->GetTrace(), _S_checkpoint_step));
+}
+
+} /* namespace */
+
+void RegisterCheckpoint(Runner& __runner) {
+	for(std::size_t threads : { 1, 3 }) {
+		std::string const suffix = "/threads=" + std::to_string(threads);
+
+		/// Restored into a scene which never ran.
+		__runner.Add("Checkpoint::RoundTrip" + suffix, [threads]() {
+			Scene::Configuration conf;
+			conf.MaxStep = _S_max_step;
+			conf.Threads = threads;
+			conf.ChunkSize = 4;
+			Scene restored(&conf);
+			restored.RegisterFactories();
+			_Check_Resume(threads, restored, "checkpoint_round_trip.bin");
+		});
+
+		/// Restored into a scene which ran past the checkpoint, with nodes asleep and a message pending: the
+		/// wake-ups and the message of the old scene must not leak into the restored one.
+		__runner.Add("Checkpoint::RestoreOverRun" + suffix, [threads]() {
+			auto restored = _Build(threads, 0, "");
+			restored->Run();
+			auto walker = restored->GetNodeById(4);
+			restored->Send(walker->GetHandle(), 7);
+			_Check_Resume(threads, *restored, "checkpoint_over_run.bin");
+		});
+	}
+}
+
+} /* namespace test */
+} /* namespace bul */
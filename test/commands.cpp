@@ -0,0 +1,116 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#include <stdexcept>
+#include <string>
+
+#include "../bulwark.h"
+#include "test.h"
+
+namespace bul {
+namespace test {
+namespace {
+/// Step in which the duplicates are added.
+static const std::size_t _S_failing_step = 2;
+
+class Scene : public manager::SceneMgr {
+public:
+	Scene(Configuration* __conf) : SceneMgr(__conf) { }
+
+protected:
+	virtual void PreStep() override { }
+	virtual void PostStep() override { }
+};
+
+class Noop : public dynamics::Actor::Component {
+public:
+	Noop(Configuration* __conf) : Component(__conf) { }
+
+protected:
+	virtual void Act() override { }
+	virtual void Act_Anyway() override { }
+};
+
+/// In the failing step, adds a component and a node whose ids are taken, and keeps using them.
+class Adder : public dynamics::Actor {
+public:
+	Adder(Configuration* __conf) : Actor(__conf) { }
+
+protected:
+	virtual void PreAct() override {
+		if(GetSceneMgr()->GetCurrentStep() != _S_failing_step) {
+			return;
+		}
+		Noop::Configuration component_conf;
+		component_conf.Id = 1;
+		auto component = AddComponent<Noop>(&component_conf);
+		component->SetActive(false);
+		component->SetFlag(4);
+		RemoveComponent(component);
+
+		Adder::Configuration node_conf;
+		node_conf.Id = GetId() == 1 ? 2 : 1;
+		auto node = GetSceneMgr()->AddNode<Adder>(&node_conf);
+		node->SetFlag(4);
+		node->SetActive(false);
+		node->SleepUntil(_S_failing_step + 3);
+		GetSceneMgr()->RemoveNode(node);
+	}
+
+	virtual void PostAct() override { }
+};
+
+/// The failed insertions are reported by Run(...), the commands which follow them in the step are dropped and
+/// the scene keeps what it had. Without slabs, a freed node is given back to the heap, where memory checkers
+/// see it.
+void _Check_Duplicates(std::size_t __threads, std::size_t __slab_size) {
+	Scene::Configuration conf;
+	conf.MaxStep = 5;
+	conf.Threads = __threads;
+	conf.ChunkSize = 1;
+	conf.SlabSize = __slab_size;
+	Scene scene(&conf);
+	for(std::size_t id = 1; id <= 2; id++) {
+		Adder::Configuration adder_conf;
+		adder_conf.Id = id;
+		auto adder = scene.AddNode<Adder>(&adder_conf);
+		Noop::Configuration component_conf;
+		component_conf.Id = 1;
+		adder->AddComponent<Noop>(&component_conf);
+	}
+
+	bool thrown = false;
+	try {
+		scene.Run();
+	} catch(std::exception const&) {
+		thrown = true;
+	}
+	BUL_CHECK(thrown);
+	BUL_CHECK(scene.GetCurrentStep() == _S_failing_step);
+	BUL_CHECK(scene.CountNodesByType(dynamics::Node_Type::Actor) == 2);
+	for(std::size_t id = 1; id <= 2; id++) {
+		auto adder = static_cast<dynamics::Actor*>(scene.GetNodeById(id));
+		BUL_CHECK(adder->GetFlag() == 0 && adder->IsActive() && !adder->IsSleeping());
+		BUL_CHECK(adder->CountComponentById(1) == 1);
+		auto component = adder->GetComponentById(1);
+		BUL_CHECK(component->IsActive() && !component->GetHandle().IsNull());
+	}
+}
+
+} /* namespace */
+
+void RegisterCommands(Runner& __runner) {
+	for(std::size_t threads : { 1, 2 }) {
+		std::string const suffix = "/threads=" + std::to_string(threads);
+		__runner.Add("Commands::DuplicateIds" + suffix, [threads]() {
+			_Check_Duplicates(threads, 64 * 1024);
+		});
+		__runner.Add("Commands::DuplicateIds/heap" + suffix, [threads]() {
+			_Check_Duplicates(threads, 0);
+		});
+	}
+}
+
+} /* namespace test */
+} /* namespace bul */
@@ -0,0 +1,167 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#include <cstdint>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "../bulwark.h"
+#include "test.h"
+
+namespace bul {
+namespace test {
+namespace {
+typedef dynamics::Actor::datapool_type datapool_type;
+
+/// Number of actors in the ring and steps of a run.
+static const std::size_t _S_actors = 64;
+static const std::size_t _S_steps = 40;
+
+class Scene : public manager::SceneMgr {
+public:
+	Scene(Configuration* __conf) : SceneMgr(__conf) { }
+
+	/// The actors in ring order, each one reads the next.
+	std::vector<dynamics::Actor*> Ring;
+
+protected:
+	virtual void PreStep() override { }
+	virtual void PostStep() override { }
+};
+
+class Cell : public dynamics::Actor {
+public:
+	Cell(Configuration* __conf) : Actor(__conf) { }
+
+protected:
+	virtual void PreAct() override { }
+	virtual void PostAct() override { }
+};
+
+/// Value of the cell at __position when step __step starts.
+int _Expected(std::size_t __position, std::size_t __step) {
+	return static_cast<int>((__position + __step) % _S_actors + __step);
+}
+
+/// Takes the value of the next cell plus one. Its own write must not show before the step ends, and neither
+/// may the writes of the other cells, whichever ran first.
+class Shift : public dynamics::Actor::Component {
+public:
+	Shift(Configuration* __conf) : Component(__conf) { }
+
+	/// Set when a write of the current step was seen.
+	static std::atomic<bool> Leaked;
+
+protected:
+	virtual void Act() override {
+		auto const& ring = static_cast<Scene*>(GetSceneMgr())->Ring;
+		std::size_t const position = GetActor()->GetId() - 1;
+		int const own = GetSharedData<int>(0);
+		int const next = ring[(position + 1) % ring.size()]->GetDataPool().Get<int>(0);
+		/// A second write of the step replaces the first.
+		SetSharedData<int>(0, next);
+		SetSharedData<int>(0, next + 1);
+		if(GetSharedData<int>(0) != own || _Expected(position, GetSceneMgr()->GetCurrentStep()) != own) {
+			Leaked = true;
+		}
+	}
+
+	virtual void Act_Anyway() override { }
+};
+
+std::atomic<bool> Shift::Leaked(false);
+
+/// Runs the ring, adding the actors in ring order or in reverse.
+void _Check_Ring(std::size_t __threads, bool __reversed) {
+	Scene::Configuration conf;
+	conf.MaxStep = _S_steps;
+	conf.Threads = __threads;
+	conf.ChunkSize = 4;
+	Scene scene(&conf);
+	scene.Ring.resize(_S_actors);
+	for(std::size_t i = 0; i < _S_actors; i++) {
+		std::size_t const position = __reversed ? _S_actors - 1 - i : i;
+		Cell::Configuration cell_conf;
+		cell_conf.Id = position + 1;
+		cell_conf.DataPoolSize = 2;
+		cell_conf.DoubleBufferedData = true;
+		auto cell = scene.AddNode<Cell>(&cell_conf);
+		cell->GetDataPool().Set<int>(0, static_cast<int>(position));
+		cell->GetDataPool().Set<int>(1, -1);
+		scene.Ring[position] = cell;
+
+		Shift::Configuration shift_conf;
+		shift_conf.Id = 1;
+		shift_conf.ActAnyway = false;
+		cell->AddComponent<Shift>(&shift_conf);
+	}
+
+	Shift::Leaked = false;
+	scene.Run();
+	BUL_CHECK(!Shift::Leaked);
+	for(std::size_t position = 0; position < _S_actors; position++) {
+		auto const& datapool = scene.Ring[position]->GetDataPool();
+		BUL_CHECK(datapool.IsDoubleBuffered());
+		BUL_CHECK(datapool.Get<int>(0) == _Expected(position, _S_steps));
+		/// Never written during a step, the first write of each step copies it over.
+		BUL_CHECK(datapool.Get<int>(1) == -1);
+	}
+}
+
+} /* namespace */
+
+void RegisterDataPool(Runner& __runner) {
+	/// A pool bound to an epoch, driven by hand.
+	__runner.Add("DataPool::Epoch", []() {
+		std::uint64_t epoch = 0;
+		datapool_type datapool;
+		datapool.Resize(2);
+		datapool.Set<int>(0, 1);
+		datapool.Set<int>(1, 2);
+		datapool.SetEpoch(&epoch);
+		BUL_CHECK(datapool.Get<int>(0) == 1 && datapool.Get<int>(1) == 2);
+
+		/// Between steps, writes go in place.
+		datapool.Set<int>(0, 3);
+		BUL_CHECK(datapool.Get<int>(0) == 3);
+
+		epoch++;
+		datapool.Set<int>(0, 4);
+		datapool.Set<int>(0, 5);
+		BUL_CHECK(datapool.Get<int>(0) == 3);
+		datapool_type copy(datapool);
+		BUL_CHECK(!copy.IsDoubleBuffered() && copy.Get<int>(0) == 3);
+		epoch++;
+		BUL_CHECK(datapool.Get<int>(0) == 5 && datapool.Get<int>(1) == 2);
+
+		/// A step without writes keeps the values, the next write starts from them.
+		epoch += 2;
+		BUL_CHECK(datapool.Get<int>(0) == 5);
+		epoch++;
+		datapool.Set<int>(1, 6);
+		BUL_CHECK(datapool.Get<int>(0) == 5 && datapool.Get<int>(1) == 2);
+		epoch++;
+		BUL_CHECK(datapool.Get<int>(0) == 5 && datapool.Get<int>(1) == 6);
+
+		/// Unbinding keeps the committed values.
+		datapool.SetEpoch(nullptr);
+		BUL_CHECK(!datapool.IsDoubleBuffered());
+		BUL_CHECK(datapool.Get<int>(0) == 5 && datapool.Get<int>(1) == 6);
+	});
+
+	for(std::size_t threads : { 1, 4 }) {
+		std::string const suffix = "/threads=" + std::to_string(threads);
+		__runner.Add("DataPool::DoubleBufferedScene" + suffix, [threads]() {
+			_Check_Ring(threads, false);
+		});
+		__runner.Add("DataPool::DoubleBufferedScene/reversed" + suffix, [threads]() {
+			_Check_Ring(threads, true);
+		});
+	}
+}
+
+} /* namespace test */
+} /* namespace bul */
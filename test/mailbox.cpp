@@ -0,0 +1,178 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#include <cstdint>
+
+#include <algorithm>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "../bulwark.h"
+#include "test.h"
+
+namespace bul {
+namespace test {
+namespace {
+/// Number of senders and steps of a run, every sender posts _S_burst notes per step.
+static const std::size_t _S_senders = 40;
+static const std::size_t _S_steps = 12;
+static const std::uint32_t _S_burst = 3;
+
+/// Sender 0 stands for the scene, which posts from PostStep() and PreStep().
+struct Note {
+	std::uint32_t From;
+	std::uint32_t Sequence;
+	std::uint32_t Step;
+};
+
+bool operator==(Note const& __a, Note const& __b) {
+	return __a.From == __b.From && __a.Sequence == __b.Sequence && __a.Step == __b.Step;
+}
+
+bool operator<(Note const& __a, Note const& __b) {
+	return std::make_tuple(__a.From, __a.Sequence, __a.Step) < std::make_tuple(__b.From, __b.Sequence, __b.Step);
+}
+
+class Scene : public manager::SceneMgr {
+public:
+	Scene(Configuration* __conf) : SceneMgr(__conf) { }
+
+	common::Handle Sink;
+	common::Handle Gone;
+
+protected:
+	/// Delivered at the start of the same step.
+	virtual void PreStep() override {
+		Send(Sink, Note { 0, 1, static_cast<std::uint32_t>(GetCurrentStep()) });
+		Send(Sink, static_cast<int>(GetCurrentStep()));
+		Send(Gone, Note { 0, 2, static_cast<std::uint32_t>(GetCurrentStep()) });
+	}
+
+	/// Delivered at the start of the next step, after what the actors sent.
+	virtual void PostStep() override {
+		Send(Sink, Note { 0, 0, static_cast<std::uint32_t>(GetCurrentStep()) });
+	}
+};
+
+class Sender : public dynamics::Actor {
+public:
+	Sender(Configuration* __conf) : Actor(__conf) { }
+
+protected:
+	virtual void PreAct() override {
+		auto scene = static_cast<Scene*>(GetSceneMgr());
+		for(std::uint32_t i = 0; i < _S_burst; i++) {
+			Send(scene->Sink, Note { static_cast<std::uint32_t>(GetId()), i, static_cast<std::uint32_t>(scene->GetCurrentStep()) });
+		}
+	}
+
+	virtual void PostAct() override { }
+};
+
+/// Keeps what it received, step by step.
+class Sink : public dynamics::Actor {
+public:
+	Sink(Configuration* __conf) : Actor(__conf) { }
+
+	std::vector<std::vector<Note>> Notes;
+	std::vector<std::vector<int>> Numbers;
+	std::size_t Strays = 0;
+
+protected:
+	virtual void PreAct() override {
+		auto notes = GetMessages<Note>();
+		Notes.push_back(std::vector<Note>(notes.begin(), notes.end()));
+		auto numbers = GetMessages<int>();
+		Numbers.push_back(std::vector<int>(numbers.begin(), numbers.end()));
+		Strays += GetMessages<double>().size();
+	}
+
+	virtual void PostAct() override { }
+};
+
+/// What the sink should get in step __step, in sending order for a serial run.
+std::vector<Note> _Expected(std::size_t __step) {
+	std::uint32_t const step = static_cast<std::uint32_t>(__step);
+	std::vector<Note> notes;
+	if(__step > 0) {
+		for(std::uint32_t from = 1; from <= _S_senders; from++) {
+			for(std::uint32_t i = 0; i < _S_burst; i++) {
+				notes.push_back(Note { from, i, step - 1 });
+			}
+		}
+		notes.push_back(Note { 0, 0, step - 1 });
+	}
+	notes.push_back(Note { 0, 1, step });
+	return notes;
+}
+
+void _Check_Delivery(std::size_t __threads) {
+	Scene::Configuration conf;
+	conf.MaxStep = _S_steps;
+	conf.Threads = __threads;
+	conf.ChunkSize = 4;
+	Scene scene(&conf);
+
+	Sink::Configuration sink_conf;
+	sink_conf.Id = 1000;
+	auto sink = scene.AddNode<Sink>(&sink_conf);
+	scene.Sink = sink->GetHandle();
+	for(std::size_t id = 1; id <= _S_senders; id++) {
+		Sender::Configuration sender_conf;
+		sender_conf.Id = id;
+		scene.AddNode<Sender>(&sender_conf);
+	}
+
+	/// A handle whose node is gone, and one whose slot was reused by another node.
+	Sender::Configuration gone_conf;
+	gone_conf.Id = 2000;
+	scene.Gone = scene.AddNode<Sender>(&gone_conf)->GetHandle();
+	scene.Send(scene.Gone, Note { 0, 3, 0 });
+	scene.RemoveNode(scene.GetNodeById(2000));
+	dynamics::Object::Configuration reused_conf;
+	reused_conf.Id = 2001;
+	scene.AddNode<dynamics::Object>(&reused_conf);
+
+	scene.Run();
+
+	BUL_CHECK(sink->Notes.size() == _S_steps);
+	for(std::size_t step = 0; step < _S_steps; step++) {
+		std::vector<Note> expected = _Expected(step);
+		std::vector<Note> received = sink->Notes[step];
+		if(__threads == 1) {
+			BUL_CHECK(received == expected);
+		} else {
+			/// Worker by worker: each sender's notes keep their order, senders may interleave.
+			for(std::uint32_t from = 1; from <= _S_senders; from++) {
+				std::vector<Note> own;
+				for(auto const& note : received) {
+					if(note.From == from) {
+						own.push_back(note);
+					}
+				}
+				BUL_CHECK(std::is_sorted(own.begin(), own.end()));
+			}
+			std::sort(expected.begin(), expected.end());
+			std::sort(received.begin(), received.end());
+			BUL_CHECK(received == expected);
+		}
+		BUL_CHECK(sink->Numbers[step] == std::vector<int>(1, static_cast<int>(step)));
+	}
+	BUL_CHECK(sink->Strays == 0);
+	BUL_CHECK(scene.Receive<Note>(scene.Gone).empty());
+}
+
+} /* namespace */
+
+void RegisterMailbox(Runner& __runner) {
+	for(std::size_t threads : { 1, 4 }) {
+		__runner.Add("Mailbox::Delivery/threads=" + std::to_string(threads), [threads]() {
+			_Check_Delivery(threads);
+		});
+	}
+}
+
+} /* namespace test */
+} /* namespace bul */
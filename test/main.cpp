@@ -0,0 +1,65 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#include <exception>
+#include <iostream>
+#include <string>
+
+#include "test.h"
+
+namespace bul {
+namespace test {
+std::size_t Runner::Run(std::string const& __filter) const {
+	std::size_t failures = 0;
+	std::size_t count = 0;
+	for(auto const& test_case : _M_case) {
+		if(!__filter.empty() && test_case.Name.find(__filter) == std::string::npos) {
+			continue;
+		}
+		count++;
+		try {
+			test_case.Body();
+			std::cerr << test_case.Name << " : ok" << std::endl;
+		} catch(std::exception const& e) {
+			std::cerr << test_case.Name << " : FAILED, " << e.what() << std::endl;
+			failures++;
+		}
+	}
+	std::cerr << count - failures << " / " << count << " passed" << std::endl;
+	return failures;
+}
+
+} /* namespace test */
+} /* namespace bul */
+
+static void _S_Usage(const char* __program) {
+	std::cerr << "usage: " << __program << " [--filter TEXT]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+	std::string filter;
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if(arg == "--filter" && i + 1 < argc) {
+			filter = argv[++i];
+		} else {
+			_S_Usage(argv[0]);
+			return 1;
+		}
+	}
+
+	bul::test::Runner runner;
+	bul::test::RegisterAsyncMonitor(runner);
+	bul::test::RegisterCommands(runner);
+	bul::test::RegisterCheckpoint(runner);
+	bul::test::RegisterDataPool(runner);
+	bul::test::RegisterMailbox(runner);
+	bul::test::RegisterOrder(runner);
+	bul::test::RegisterProfiler(runner);
+	bul::test::RegisterReplay(runner);
+	bul::test::RegisterSpatial(runner);
+	bul::test::RegisterSystem(runner);
+
+	return runner.Run(filter) == 0 ? 0 : 1;
+}
@@ -0,0 +1,281 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "../bulwark.h"
+#include "test.h"
+
+namespace bul {
+namespace test {
+namespace {
+/// Records the calls of a serial run, and checks them after every step.
+class Scene : public manager::SceneMgr {
+public:
+	Scene(Configuration* __conf) : SceneMgr(__conf), Mismatches(0) { }
+
+	/// The actors record 1000 * their Id, the components 1000 * the Id of their actor + their own Id.
+	std::vector<std::size_t> Trace;
+	std::size_t Mismatches;
+
+	/// Compares the trace of the step with the expected one, and may change the scene.
+	std::function<std::vector<std::size_t>()> Expected;
+	std::function<void()> Change;
+
+protected:
+	virtual void PreStep() override { }
+
+	virtual void PostStep() override {
+		if(Trace != Expected()) {
+			Mismatches++;
+		}
+		Trace.clear();
+		if(Change) {
+			Change();
+		}
+	}
+};
+
+std::vector<std::size_t>& _Trace(dynamics::Node* __node) {
+	return static_cast<Scene*>(__node->GetSceneMgr())->Trace;
+}
+
+class Mark : public dynamics::Actor::Component {
+public:
+	Mark(Configuration* __conf) : Component(__conf) { }
+
+protected:
+	virtual void Act() override {
+		_Trace(this).push_back(1000 * GetActor()->GetId() + GetId());
+	}
+
+	virtual void Act_Anyway() override { }
+};
+
+/// Step in which Switch switches the other components.
+static const std::size_t _S_switch_step = 3;
+
+/// In step _S_switch_step, deactivates component 3 and activates component 4 of its actor.
+class Switch : public Mark {
+public:
+	Switch(Configuration* __conf) : Mark(__conf) { }
+
+protected:
+	virtual void Act() override {
+		Mark::Act();
+		if(GetSceneMgr()->GetCurrentStep() == _S_switch_step) {
+			GetActor()->GetComponentById(3)->SetActive(false);
+			GetActor()->GetComponentById(4)->SetActive(true);
+		}
+	}
+};
+
+class Traced : public dynamics::Actor {
+public:
+	Traced(Configuration* __conf) : Actor(__conf) { }
+
+protected:
+	virtual void PreAct() override {
+		_Trace(this).push_back(1000 * GetId());
+	}
+
+	virtual void PostAct() override { }
+};
+
+/// Records _Code when it acts.
+template<std::size_t _Priority, std::size_t _Code>
+struct StaticMark : public dynamics::StaticComponent<_Priority> {
+	void Act(dynamics::Actor& __actor) {
+		_Trace(&__actor).push_back(_Code);
+	}
+};
+
+class Composed : public dynamics::StaticActor<StaticMark<0, 1900>, StaticMark<2, 1902>, StaticMark<4, 1904>,
+		StaticMark<2, 1912>> {
+public:
+	Composed(Configuration* __conf) : StaticActor(__conf) { }
+
+protected:
+	virtual void PreAct() override {
+		_Trace(this).push_back(1000 * GetId());
+	}
+};
+
+Scene::Configuration _Configuration() {
+	Scene::Configuration conf;
+	conf.MaxStep = 40;
+	conf.Threads = 1;
+	return conf;
+}
+
+dynamics::Actor* _Add_Actor(Scene& __scene, std::size_t __id) {
+	Traced::Configuration conf;
+	conf.Id = __id;
+	conf.DataPoolSize = 0;
+	return __scene.AddNode<Traced>(&conf);
+}
+
+template<typename _Tp>
+dynamics::Actor::Component* _Add_Component(dynamics::Actor* __actor, std::size_t __id, std::size_t __priority,
+		bool __active = true) {
+	typename _Tp::Configuration conf;
+	conf.Id = __id;
+	conf.Priority = __priority;
+	conf.Active = __active;
+	return __actor->AddComponent<_Tp>(&conf);
+}
+
+} /* namespace */
+
+void RegisterOrder(Runner& __runner) {
+	/// A serial run steps the active actors in the order they were added, whatever their Ids, while actors are
+	/// switched, removed and added between the steps.
+	__runner.Add("Order::Actors", []() {
+		Scene::Configuration conf = _Configuration();
+		Scene scene(&conf);
+		std::vector<std::size_t> order;
+		for(std::size_t id : { 7, 3, 12, 1, 9, 4, 11, 2, 8, 5, 10, 6 }) {
+			_Add_Actor(scene, id);
+			order.push_back(id);
+		}
+		std::mt19937 random(3);
+		std::size_t next_id = 999;
+		scene.Expected = [&scene, &order]() {
+			std::vector<std::size_t> expected;
+			for(std::size_t id : order) {
+				if(static_cast<dynamics::Actor*>(scene.GetNodeById(id))->IsActive()) {
+					expected.push_back(1000 * id);
+				}
+			}
+			return expected;
+		};
+		scene.Change = [&scene, &order, &random, &next_id]() {
+			for(std::size_t i = 0; i < 3; i++) {
+				auto actor = static_cast<dynamics::Actor*>(scene.GetNodeById(order[random() % order.size()]));
+				actor->SetActive(!actor->IsActive());
+			}
+			if(random() % 3 == 0) {
+				std::size_t const index = random() % order.size();
+				scene.RemoveNode(scene.GetNodeById(order[index]));
+				order.erase(order.begin() + index);
+				_Add_Actor(scene, next_id);
+				order.push_back(next_id--);
+			}
+		};
+		scene.Run();
+		BUL_CHECK(scene.Mismatches == 0);
+	});
+
+	/// An actor calls its active components by priority, then in the order they were added, while components
+	/// are switched, removed and added between the steps.
+	__runner.Add("Order::Components", []() {
+		Scene::Configuration conf = _Configuration();
+		Scene scene(&conf);
+		auto actor = _Add_Actor(scene, 1);
+		/// The Ids and priorities of the components, in the order they were added.
+		std::vector<std::pair<std::size_t, std::size_t>> added;
+		std::size_t next_id = 1;
+		std::mt19937 random(11);
+		auto const add = [actor, &added, &next_id, &random]() {
+			std::size_t const priority = random() % 4;
+			_Add_Component<Mark>(actor, next_id, priority);
+			added.push_back(std::make_pair(next_id++, priority));
+		};
+		for(std::size_t i = 0; i < 10; i++) {
+			add();
+		}
+		scene.Expected = [actor, &added]() {
+			std::vector<std::pair<std::size_t, std::size_t>> sorted = added;
+			std::stable_sort(sorted.begin(), sorted.end(), [](std::pair<std::size_t, std::size_t> const& __a,
+					std::pair<std::size_t, std::size_t> const& __b) {
+				return __a.second < __b.second;
+			});
+			std::vector<std::size_t> expected(1, 1000);
+			for(auto const& component : sorted) {
+				if(actor->GetComponentById(component.first)->IsActive()) {
+					expected.push_back(1000 + component.first);
+				}
+			}
+			return expected;
+		};
+		scene.Change = [actor, &added, &random, &add]() {
+			for(std::size_t i = 0; i < 3; i++) {
+				auto component = actor->GetComponentById(added[random() % added.size()].first);
+				component->SetActive(!component->IsActive());
+			}
+			if(random() % 3 == 0) {
+				std::size_t const index = random() % added.size();
+				actor->RemoveComponent(actor->GetComponentById(added[index].first));
+				added.erase(added.begin() + index);
+				add();
+			}
+		};
+		scene.Run();
+		BUL_CHECK(scene.Mismatches == 0);
+	});
+
+	/// A component deactivated during a step is skipped in that step, one activated joins in the next step.
+	__runner.Add("Order::ComponentsSwitchedInStep", []() {
+		Scene::Configuration conf = _Configuration();
+		conf.MaxStep = 6;
+		Scene scene(&conf);
+		auto actor = _Add_Actor(scene, 1);
+		_Add_Component<Switch>(actor, 1, 0);
+		_Add_Component<Mark>(actor, 2, 2);
+		_Add_Component<Mark>(actor, 3, 5);
+		_Add_Component<Mark>(actor, 4, 5, false);
+		scene.Expected = [&scene]() {
+			std::vector<std::size_t> expected { 1000, 1001, 1002 };
+			if(scene.GetCurrentStep() < _S_switch_step) {
+				expected.push_back(1003);
+			} else if(scene.GetCurrentStep() > _S_switch_step) {
+				expected.push_back(1004);
+			}
+			return expected;
+		};
+		scene.Run();
+		BUL_CHECK(scene.Mismatches == 0);
+	});
+
+	/// The static components of a StaticActor act among its runtime ones by priority, before the runtime ones
+	/// of equal priority, whether the runtime ones are active or not.
+	__runner.Add("Order::StaticInterleave", []() {
+		Scene::Configuration conf = _Configuration();
+		conf.MaxStep = 6;
+		Scene scene(&conf);
+		Composed::Configuration actor_conf;
+		actor_conf.Id = 1;
+		actor_conf.DataPoolSize = 0;
+		auto actor = scene.AddNode<Composed>(&actor_conf);
+		for(std::size_t id : { 5, 2, 10, 3, 1 }) {
+			_Add_Component<Mark>(actor, id, id == 10 ? 0 : id);
+		}
+		scene.Expected = [actor]() {
+			std::vector<std::size_t> expected;
+			for(std::size_t code : { 1000, 1900, 1010, 1001, 1902, 1912, 1002, 1003, 1904, 1005 }) {
+				if(code < 1900 && code > 1000 && !actor->GetComponentById(code - 1000)->IsActive()) {
+					continue;
+				}
+				expected.push_back(code);
+			}
+			return expected;
+		};
+		/// Switches off the runtime components one by one, until only the static ones are left.
+		scene.Change = [&scene, actor]() {
+			std::size_t const off[] = { 2, 10, 5, 1, 3 };
+			if(scene.GetCurrentStep() < 5) {
+				actor->GetComponentById(off[scene.GetCurrentStep()])->SetActive(false);
+			}
+		};
+		scene.Run();
+		BUL_CHECK(scene.Mismatches == 0);
+	});
+}
+
+} /* namespace test */
+} /* namespace bul */
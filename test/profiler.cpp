@@ -0,0 +1,56 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#include <string>
+#include <vector>
+
+#include "../bulwark.h"
+#include "test.h"
+
+namespace bul {
+namespace test {
+namespace {
+class First { };
+class Second { };
+
+/// The entry named __name, or an empty one.
+common::ProfileEntry _Find(std::vector<common::ProfileEntry> const& __entries, std::string const& __name) {
+	for(auto const& entry : __entries) {
+		if(entry.Name == __name) {
+			return entry;
+		}
+	}
+	return common::ProfileEntry();
+}
+
+} /* namespace */
+
+void RegisterProfiler(Runner& __runner) {
+	/// Calls are grouped by kind, Id and type: another node, even one allocated where a removed node was, gets
+	/// its own record and name.
+	__runner.Add("Profiler::NodeRecords", []() {
+		auto& profiler = common::Profiler::Instance();
+		profiler.Reset();
+		profiler.RecordNode("Actor", 1, typeid(First), 100);
+		profiler.RecordNode("Actor", 1, typeid(First), 50);
+		profiler.RecordNode("Actor", 2, typeid(First), 10);
+		profiler.RecordNode("Actor", 1, typeid(Second), 20);
+		profiler.RecordNode("Trigger", 1, typeid(First), 5);
+		auto const nodes = profiler.TopNodes(10);
+		profiler.Reset();
+
+		BUL_CHECK(nodes.size() == 4);
+		BUL_CHECK(nodes[0].Name == std::string("Actor #1 (") + typeid(First).name() + ")");
+		BUL_CHECK(nodes[0].Time.Count == 2 && nodes[0].Time.Total == 150);
+		auto const other = _Find(nodes, std::string("Actor #2 (") + typeid(First).name() + ")");
+		BUL_CHECK(other.Time.Count == 1 && other.Time.Total == 10);
+		auto const type = _Find(nodes, std::string("Actor #1 (") + typeid(Second).name() + ")");
+		BUL_CHECK(type.Time.Count == 1 && type.Time.Total == 20);
+		auto const kind = _Find(nodes, std::string("Trigger #1 (") + typeid(First).name() + ")");
+		BUL_CHECK(kind.Time.Count == 1 && kind.Time.Total == 5);
+	});
+}
+
+} /* namespace test */
+} /* namespace bul */
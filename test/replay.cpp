@@ -0,0 +1,221 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#include <cstdio>
+
+#include <map>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "../bulwark.h"
+#include "test.h"
+
+namespace bul {
+namespace test {
+namespace {
+/// Steps of a run and frames between two keyframes.
+static const std::size_t _S_steps = 120;
+static const std::size_t _S_keyframe_interval = 16;
+
+/// Id which changes hands every _S_reuse_period steps: the node holding it is removed and another one, of
+/// the other type, is added in its place within the same step.
+static const std::size_t _S_reused_id = 500;
+static const std::size_t _S_reuse_period = 7;
+
+class Walker : public dynamics::Actor {
+public:
+	Walker(Configuration* __conf) : Actor(__conf), _M_random(__conf->Id) { }
+
+protected:
+	/// Writes a few slots, now and then changes the flag or grows the pool.
+	virtual void PreAct() override {
+		auto& datapool = GetDataPool();
+		for(std::size_t i = 0; i < 3; i++) {
+			std::size_t const slot = _M_random() % datapool.Size();
+			if(_M_random() % 2 == 0) {
+				datapool.Set<int>(slot, datapool.Get<int>(slot) + static_cast<int>(_M_random() % 2001) - 1000);
+			} else {
+				datapool.Set<float>(slot, datapool.Get<float>(slot) * 0.5f + static_cast<float>(_M_random() % 100));
+			}
+		}
+		if(_M_random() % 20 == 0) {
+			SetFlag(_M_random() % 16);
+		}
+		if(_M_random() % 100 == 0) {
+			datapool.Resize(datapool.Size() + 1);
+		}
+	}
+
+	virtual void PostAct() override { }
+
+private:
+	std::mt19937 _M_random;
+};
+
+class Scene : public manager::SceneMgr {
+public:
+	Scene(Configuration* __conf) : SceneMgr(__conf), _M_random(5), _M_next_id(1000) { }
+
+protected:
+	/// Removes and adds walkers, and hands _S_reused_id over to a new node.
+	virtual void PreStep() override {
+		std::size_t const step = GetCurrentStep();
+		if(step > 0 && _M_random() % 3 == 0) {
+			auto const& actors = GetNodesByType(dynamics::Node_Type::Actor);
+			auto victim = actors[_M_random() % actors.size()];
+			if(victim->GetId() != _S_reused_id) {
+				RemoveNode(victim);
+			}
+		}
+		if(_M_random() % 2 == 0) {
+			_M_Add_Walker(_M_next_id++, 0);
+		}
+		if(step % _S_reuse_period == 0) {
+			bool const object = step / _S_reuse_period % 2 == 1;
+			if(step > 0) {
+				RemoveNode(GetNodeById(_S_reused_id));
+			}
+			if(object) {
+				dynamics::Object::Configuration conf;
+				conf.Id = _S_reused_id;
+				conf.Tag = 3;
+				conf.Flag = 1;
+				AddNode<dynamics::Object>(&conf);
+			} else {
+				_M_Add_Walker(_S_reused_id, 2);
+			}
+		}
+	}
+
+	virtual void PostStep() override { }
+
+private:
+	void _M_Add_Walker(std::size_t __id, unsigned int __tag) {
+		Walker::Configuration conf;
+		conf.Id = __id;
+		conf.Tag = __tag;
+		conf.DataPoolSize = 1 + _M_random() % 8;
+		conf.TrackDirtyData = _M_random() % 2 == 0;
+		AddNode<Walker>(&conf);
+	}
+
+	std::mt19937 _M_random;
+	std::size_t _M_next_id;
+};
+
+/// What the reader should rebuild for a node: type, tag, flag and the int and float views of its slots.
+typedef std::tuple<dynamics::Node_Type, unsigned int, unsigned int, std::vector<int>, std::vector<float>> NodeTruth;
+typedef std::map<std::size_t, NodeTruth> Truth;
+
+/// Captures the scene after each step, as the recorder sees it.
+class Capture : public manager::Monitor {
+public:
+	std::vector<Truth> Steps;
+
+protected:
+	virtual void Initialize() override { }
+
+	virtual void Step() override {
+		Truth truth;
+		for(auto type : { dynamics::Node_Type::Actor, dynamics::Node_Type::Object, dynamics::Node_Type::Trigger }) {
+			if(GetSceneMgr()->CountNodesByType(type) == 0) {
+				continue;
+			}
+			for(auto node : GetSceneMgr()->GetNodesByType(type)) {
+				NodeTruth& entry = truth[node->GetId()];
+				entry = NodeTruth(type, node->GetTag(), node->GetFlag(), std::vector<int>(), std::vector<float>());
+				if(type == dynamics::Node_Type::Actor) {
+					auto const& datapool = static_cast<dynamics::Actor const*>(node)->GetDataPool();
+					for(std::size_t i = 0; i < datapool.Size(); i++) {
+						std::get<3>(entry).push_back(datapool.Get<int>(i));
+						std::get<4>(entry).push_back(datapool.Get<float>(i));
+					}
+				}
+			}
+		}
+		Steps.push_back(truth);
+	}
+
+	virtual void Finalize() override { }
+};
+
+/// The state of the reader must be exactly the captured one.
+void _Check_State(manager::ReplayReader const& __reader, Truth const& __truth) {
+	BUL_CHECK(__reader.GetState().size() == __truth.size());
+	for(auto const& entry : __truth) {
+		auto node = __reader.GetNode(entry.first);
+		BUL_CHECK(node != nullptr);
+		NodeTruth const& truth = entry.second;
+		BUL_CHECK(node->Type == std::get<0>(truth) && node->Tag == std::get<1>(truth) && node->Flag == std::get<2>(truth));
+		BUL_CHECK(node->Ints == std::get<3>(truth) && node->Floats == std::get<4>(truth));
+	}
+}
+
+void _Check_Replay(std::size_t __threads) {
+	std::string const path = "replay_" + std::to_string(__threads) + ".bin";
+	Scene::Configuration conf;
+	conf.MaxStep = _S_steps;
+	conf.Threads = __threads;
+	conf.ChunkSize = 4;
+	Scene scene(&conf);
+	for(std::size_t id = 1; id <= 40; id++) {
+		Walker::Configuration walker_conf;
+		walker_conf.Id = id;
+		walker_conf.DataPoolSize = 6;
+		walker_conf.TrackDirtyData = id % 2 == 0;
+		scene.AddNode<Walker>(&walker_conf);
+	}
+
+	manager::ReplayRecorder::Configuration recorder_conf;
+	recorder_conf.Path = path;
+	recorder_conf.KeyframeInterval = _S_keyframe_interval;
+	/// Small chunks, so that the writing thread sees many of them.
+	recorder_conf.ChunkSize = 512;
+	recorder_conf.QueueSize = 2;
+	manager::ReplayRecorder recorder(&recorder_conf);
+	Capture capture;
+	scene.Run(&recorder, &capture);
+	BUL_CHECK(capture.Steps.size() == _S_steps);
+
+	{
+		manager::ReplayReader reader(path);
+		BUL_CHECK(reader.IsComplete());
+		BUL_CHECK(reader.GetFrameCount() == _S_steps && reader.GetLastStep() == _S_steps - 1);
+		BUL_CHECK(reader.GetKeyframes().size() == (_S_steps + _S_keyframe_interval - 1) / _S_keyframe_interval);
+
+		/// Frame by frame.
+		std::size_t step = 0;
+		while(reader.Next()) {
+			BUL_CHECK(reader.GetStep() == step);
+			_Check_State(reader, capture.Steps[step]);
+			step++;
+		}
+		BUL_CHECK(step == _S_steps);
+
+		/// Back and forth, from the keyframes and from the current frame.
+		std::mt19937 random(3);
+		for(std::size_t i = 0; i < 60; i++) {
+			std::size_t const target = i % 3 == 0 ? (i / 3) * _S_keyframe_interval % _S_steps : random() % _S_steps;
+			BUL_CHECK(reader.Seek(target));
+			BUL_CHECK(reader.GetStep() == target);
+			_Check_State(reader, capture.Steps[target]);
+		}
+	}
+	std::remove(path.c_str());
+}
+
+} /* namespace */
+
+void RegisterReplay(Runner& __runner) {
+	for(std::size_t threads : { 1, 4 }) {
+		__runner.Add("Replay::RecordAndRead/threads=" + std::to_string(threads), [threads]() {
+			_Check_Replay(threads);
+		});
+	}
+}
+
+} /* namespace test */
+} /* namespace bul */
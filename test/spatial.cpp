@@ -0,0 +1,212 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../bulwark.h"
+#include "test.h"
+
+namespace bul {
+namespace test {
+namespace {
+typedef common::SpatialGrid<std::size_t> grid_type;
+
+/// Points stored with three coordinates, the third one 0 in 2D.
+typedef std::vector<float> Points;
+
+/// Squared distance computed as the grid does, so that results compare exactly.
+float _Distance(float const* __a, float const* __b) {
+	float const dx = __a[0] - __b[0];
+	float const dy = __a[1] - __b[1];
+	float const dz = __a[2] - __b[2];
+	return dx * dx + dy * dy + dz * dz;
+}
+
+/// A dense cluster, a uniform spread and a few far outliers, so that the grid coarsens its cells.
+Points _Scatter(std::size_t __dimensions, std::size_t __count, std::mt19937& __random) {
+	std::uniform_real_distribution<float> spread(-50.0f, 50.0f);
+	std::normal_distribution<float> cluster(10.0f, 1.5f);
+	Points points(__count * 3, 0.0f);
+	for(std::size_t i = 0; i < __count; i++) {
+		for(std::size_t d = 0; d < __dimensions; d++) {
+			float& x = points[i * 3 + d];
+			x = i % 3 == 0 ? cluster(__random) : spread(__random);
+			if(i % 97 == 0) {
+				x *= 40.0f;
+			}
+		}
+	}
+	return points;
+}
+
+grid_type _Build(std::size_t __dimensions, float __cell_size, Points const& __points) {
+	grid_type grid(__dimensions, __cell_size);
+	for(std::size_t i = 0; i < __points.size() / 3; i++) {
+		grid.Push(i, &__points[i * 3]);
+	}
+	grid.Build();
+	return grid;
+}
+
+/// The k nearest of __points by brute force, as squared distances in increasing order.
+std::vector<float> _Nearest(Points const& __points, float const* __center, std::size_t __k) {
+	std::vector<float> distances;
+	for(std::size_t i = 0; i < __points.size() / 3; i++) {
+		distances.push_back(_Distance(&__points[i * 3], __center));
+	}
+	std::sort(distances.begin(), distances.end());
+	distances.resize(std::min(__k, distances.size()));
+	return distances;
+}
+
+/// QueryNearest(...) must find the brute-force distances, and report each one for the right point.
+void _Check_Nearest(grid_type const& __grid, Points const& __points, float const* __center, std::size_t __k) {
+	std::vector<grid_type::Hit> hits;
+	__grid.QueryNearest(__center, __k, hits);
+	std::vector<float> distances;
+	for(auto const& hit : hits) {
+		BUL_CHECK(hit.DistanceSquared == _Distance(&__points[hit.Value * 3], __center));
+		distances.push_back(hit.DistanceSquared);
+	}
+	BUL_CHECK(distances == _Nearest(__points, __center, __k));
+}
+
+void _Check_Grid(std::size_t __dimensions) {
+	std::mt19937 random(__dimensions);
+	Points const points = _Scatter(__dimensions, 2000, random);
+	for(float cell_size : { 0.5f, 4.0f, 1000.0f }) {
+		grid_type const grid = _Build(__dimensions, cell_size, points);
+		BUL_CHECK(grid.Size() == points.size() / 3);
+
+		std::uniform_real_distribution<float> center(-80.0f, 80.0f);
+		for(std::size_t query = 0; query < 100; query++) {
+			float position[3] = { 0.0f, 0.0f, 0.0f };
+			for(std::size_t d = 0; d < __dimensions; d++) {
+				/// Some centers far outside of the points.
+				position[d] = query % 10 == 0 ? center(random) * 100.0f : center(random);
+			}
+			for(std::size_t k : { 1, 7, 64 }) {
+				_Check_Nearest(grid, points, position, k);
+			}
+
+			/// QueryRadius(...) returns exactly the points within the radius.
+			float const radius = 2.0f + query % 8;
+			std::vector<std::size_t> found;
+			grid.QueryRadius(position, radius, found);
+			std::sort(found.begin(), found.end());
+			std::vector<std::size_t> expected;
+			for(std::size_t i = 0; i < points.size() / 3; i++) {
+				if(_Distance(&points[i * 3], position) <= radius * radius) {
+					expected.push_back(i);
+				}
+			}
+			BUL_CHECK(found == expected);
+		}
+
+		/// More neighbours asked for than there are points.
+		float origin[3] = { 0.0f, 0.0f, 0.0f };
+		_Check_Nearest(grid, points, origin, points.size() + 5);
+	}
+}
+
+class Scene : public manager::SceneMgr {
+public:
+	Scene(Configuration* __conf) : SceneMgr(__conf), Mismatches(0), _M_random(7) { }
+
+	std::vector<dynamics::Actor*> Walkers;
+	std::size_t Mismatches;
+
+protected:
+	virtual void PreStep() override { }
+
+	/// Checks what the components found against brute force, then moves every walker.
+	virtual void PostStep() override {
+		Points points;
+		for(auto walker : Walkers) {
+			auto const& datapool = walker->GetDataPool();
+			points.push_back(datapool.Get<float>(0));
+			points.push_back(datapool.Get<float>(1));
+			points.push_back(0.0f);
+		}
+		for(std::size_t i = 0; i < Walkers.size(); i++) {
+			auto& datapool = Walkers[i]->GetDataPool();
+			std::vector<float> nearest = _Nearest(points, &points[i * 3], 2);
+			/// The nearest other walker is the second nearest point, the walker itself being the first.
+			if(datapool.Get<float>(2) != nearest[1]) {
+				Mismatches++;
+			}
+		}
+
+		std::uniform_real_distribution<float> step(-1.0f, 1.0f);
+		for(auto walker : Walkers) {
+			auto& datapool = walker->GetDataPool();
+			datapool.Set<float>(0, datapool.Get<float>(0) + step(_M_random));
+			datapool.Set<float>(1, datapool.Get<float>(1) + step(_M_random));
+		}
+	}
+
+private:
+	std::mt19937 _M_random;
+};
+
+class Walker : public dynamics::Actor {
+public:
+	Walker(Configuration* __conf) : Actor(__conf) { }
+
+protected:
+	/// Queries the index from the workers: the distance to the nearest other walker goes in slot 2.
+	virtual void PreAct() override {
+		float const position[2] = { GetDataPool().Get<float>(0), GetDataPool().Get<float>(1) };
+		std::vector<common::SpatialGrid<common::Handle>::Hit> hits;
+		GetSceneMgr()->QueryNearest(position, 2, hits);
+		GetDataPool().Set<float>(2, hits.size() == 2 ? hits[1].DistanceSquared : -1.0f);
+	}
+
+	virtual void PostAct() override { }
+};
+
+void _Check_Scene(std::size_t __threads) {
+	Scene::Configuration conf;
+	conf.MaxStep = 20;
+	conf.Threads = __threads;
+	conf.ChunkSize = 16;
+	conf.PositionSlots = { 0, 1 };
+	conf.CellSize = 2.0f;
+	Scene scene(&conf);
+	std::mt19937 random(11);
+	std::uniform_real_distribution<float> coordinate(0.0f, 30.0f);
+	for(std::size_t id = 1; id <= 300; id++) {
+		Walker::Configuration walker_conf;
+		walker_conf.Id = id;
+		walker_conf.DataPoolSize = 3;
+		auto walker = scene.AddNode<Walker>(&walker_conf);
+		walker->GetDataPool().Set<float>(0, coordinate(random));
+		walker->GetDataPool().Set<float>(1, coordinate(random));
+		scene.Walkers.push_back(walker);
+	}
+	scene.Run();
+	BUL_CHECK(scene.Mismatches == 0);
+}
+
+} /* namespace */
+
+void RegisterSpatial(Runner& __runner) {
+	__runner.Add("Spatial::Grid/2d", []() {
+		_Check_Grid(2);
+	});
+	__runner.Add("Spatial::Grid/3d", []() {
+		_Check_Grid(3);
+	});
+	for(std::size_t threads : { 1, 4 }) {
+		__runner.Add("Spatial::Scene/threads=" + std::to_string(threads), [threads]() {
+			_Check_Scene(threads);
+		});
+	}
+}
+
+} /* namespace test */
+} /* namespace bul */
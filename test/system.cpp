@@ -0,0 +1,229 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../bulwark.h"
+#include "test.h"
+
+namespace bul {
+namespace test {
+namespace {
+/// A component by the Id of its actor and its own.
+typedef std::pair<std::size_t, std::size_t> Key;
+
+class Tick : public dynamics::Actor::Component {
+public:
+	Tick(Configuration* __conf) : Component(__conf) { }
+
+protected:
+	virtual void Act() override { }
+	virtual void Act_Anyway() override { }
+};
+
+class Body : public dynamics::Actor {
+public:
+	Body(Configuration* __conf) : Actor(__conf) { }
+
+protected:
+	virtual void PreAct() override { }
+	virtual void PostAct() override { }
+};
+
+/// Switches, puts to sleep, adds and removes actors and components after every step, and checks what the
+/// system was given during the step.
+class Scene : public manager::SceneMgr {
+public:
+	Scene(Configuration* __conf) : SceneMgr(__conf), Mismatches(0), _M_random(17), _M_next_id(100) { }
+
+	/// Adds an actor with a few Tick components, every other one acting anyway.
+	void Populate(std::size_t __id) {
+		Body::Configuration conf;
+		conf.Id = __id;
+		conf.DataPoolSize = 1;
+		auto body = AddNode<Body>(&conf);
+		std::size_t const count = _M_random() % 3;
+		for(std::size_t i = 1; i <= count; i++) {
+			_M_Add_Tick(body, i);
+		}
+	}
+
+	/// What the system was given in the current step, in calling order. The components of one actor must come
+	/// in one call: an actor already seen in an earlier call of the pass is a mismatch.
+	void Seen(bool __anyway, manager::SystemSpan<Tick> const& __span) {
+		std::lock_guard<std::mutex> lock(_M_mutex);
+		auto& seen = __anyway ? _M_seen_anyway : _M_seen;
+		std::set<std::size_t> actors;
+		for(std::size_t i = 0; i < __span.Size(); i++) {
+			if(&__span.GetDataPool(i) != &__span[i]->GetActor()->GetDataPool()) {
+				Mismatches++;
+			}
+			actors.insert(__span[i]->GetActor()->GetId());
+			seen.push_back(Key(__span[i]->GetActor()->GetId(), __span[i]->GetId()));
+		}
+		auto& called = __anyway ? _M_called_anyway : _M_called;
+		for(std::size_t actor : actors) {
+			if(!called.insert(actor).second) {
+				Mismatches++;
+			}
+		}
+	}
+
+	std::size_t Mismatches;
+
+protected:
+	virtual void PreStep() override { }
+
+	virtual void PostStep() override {
+		_M_Check();
+		_M_Change();
+	}
+
+private:
+	void _M_Add_Tick(dynamics::Actor* __actor, std::size_t __id) {
+		Tick::Configuration conf;
+		conf.Id = __id;
+		conf.ActAnyway = __id % 2 == 1;
+		conf.Active = _M_random() % 4 != 0;
+		__actor->AddComponent<Tick>(&conf);
+	}
+
+	/// Nothing changes during the step, so the expected components are those of the state left by the step.
+	void _M_Check() {
+		std::vector<Key> expected;
+		std::vector<Key> expected_anyway;
+		for(auto node : GetNodesByType(dynamics::Node_Type::Actor)) {
+			auto actor = static_cast<dynamics::Actor*>(node);
+			for(std::size_t id = 1; id <= 3; id++) {
+				if(actor->CountComponentById(id) == 0) {
+					continue;
+				}
+				auto component = actor->GetComponentById(id);
+				if(component->IsActive() && actor->IsActive() && !actor->IsSleeping()) {
+					expected.push_back(Key(actor->GetId(), id));
+				}
+				if(id % 2 == 1 && !actor->IsSleeping()) {
+					expected_anyway.push_back(Key(actor->GetId(), id));
+				}
+			}
+		}
+		_M_Compare(_M_seen, expected);
+		_M_Compare(_M_seen_anyway, expected_anyway);
+		_M_seen.clear();
+		_M_seen_anyway.clear();
+		_M_called.clear();
+		_M_called_anyway.clear();
+	}
+
+	/// In a serial run the system goes actor by actor, in the order of their Ids.
+	void _M_Compare(std::vector<Key>& __seen, std::vector<Key>& __expected) {
+		std::sort(__expected.begin(), __expected.end());
+		if(GetThreads() == 1) {
+			std::vector<std::size_t> actors;
+			for(auto const& key : __seen) {
+				actors.push_back(key.first);
+			}
+			if(!std::is_sorted(actors.begin(), actors.end())) {
+				Mismatches++;
+			}
+		}
+		std::sort(__seen.begin(), __seen.end());
+		if(__seen != __expected) {
+			Mismatches++;
+		}
+	}
+
+	void _M_Change() {
+		auto const actors = GetNodesByType(dynamics::Node_Type::Actor);
+		for(std::size_t i = 0; i < 6; i++) {
+			auto actor = static_cast<dynamics::Actor*>(actors[_M_random() % actors.size()]);
+			std::size_t const id = 1 + _M_random() % 3;
+			switch(_M_random() % 6) {
+			case 0:
+				actor->SetActive(!actor->IsActive());
+				break;
+			case 1:
+				actor->SleepUntil(GetCurrentStep() + 1 + _M_random() % 3);
+				break;
+			case 2:
+				if(actor->CountComponentById(id) == 1) {
+					auto component = actor->GetComponentById(id);
+					component->SetActive(!component->IsActive());
+				}
+				break;
+			case 3:
+				if(actor->CountComponentById(id) == 1) {
+					actor->RemoveComponent(actor->GetComponentById(id));
+				} else {
+					_M_Add_Tick(actor, id);
+				}
+				break;
+			case 4:
+				actor->Wake();
+				break;
+			default:
+				RemoveNode(actor);
+				Populate(_M_next_id++);
+				return;
+			}
+		}
+	}
+
+	std::mutex _M_mutex;
+	std::vector<Key> _M_seen;
+	std::vector<Key> _M_seen_anyway;
+	std::set<std::size_t> _M_called;
+	std::set<std::size_t> _M_called_anyway;
+	std::mt19937 _M_random;
+	std::size_t _M_next_id;
+};
+
+void _Check_Passes(std::size_t __threads, bool __registered_first) {
+	Scene::Configuration conf;
+	conf.MaxStep = 60;
+	conf.Threads = __threads;
+	conf.ChunkSize = 3;
+	Scene scene(&conf);
+	auto const act = [&scene](manager::SystemSpan<Tick> const& __span) {
+		scene.Seen(false, __span);
+	};
+	auto const act_anyway = [&scene](manager::SystemSpan<Tick> const& __span) {
+		scene.Seen(true, __span);
+	};
+	/// Components attached as they are added, or taken over from the actors when the system is registered.
+	if(__registered_first) {
+		scene.RegisterSystem<Tick>(0, act, act_anyway);
+	}
+	for(std::size_t id = 1; id <= 40; id++) {
+		scene.Populate(id);
+	}
+	if(!__registered_first) {
+		scene.RegisterSystem<Tick>(0, act, act_anyway);
+	}
+	scene.Run();
+	BUL_CHECK(scene.Mismatches == 0);
+}
+
+} /* namespace */
+
+void RegisterSystem(Runner& __runner) {
+	for(std::size_t threads : { 1, 4 }) {
+		std::string const suffix = "/threads=" + std::to_string(threads);
+		__runner.Add("System::Passes" + suffix, [threads]() {
+			_Check_Passes(threads, true);
+		});
+		__runner.Add("System::Passes/registered-late" + suffix, [threads]() {
+			_Check_Passes(threads, false);
+		});
+	}
+}
+
+} /* namespace test */
+} /* namespace bul */
@@ -0,0 +1,68 @@
+// Copyright (C) 2015-2016 Wei@OHK, Hiroshima University.
+// This file is part of the "bulwark framework".
+// For conditions of distribution and use, see copyright notice in bulwark.h
+
+#ifndef _BUL_TEST_TEST_H
+#define _BUL_TEST_TEST_H
+
+#include <stdexcept>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bul {
+namespace test {
+/// Thrown by Check(...) when an expectation does not hold.
+class Failure : public std::runtime_error {
+public:
+	Failure(std::string const& __what) : std::runtime_error(__what) { }
+};
+
+/// Fails the running case unless __condition holds.
+inline void Check(bool __condition, const char* __expression, const char* __file, int __line) {
+	if(!__condition) {
+		throw Failure(std::string(__file) + ":" + std::to_string(__line) + ": " + __expression);
+	}
+}
+
+#define BUL_CHECK(__expression) ::bul::test::Check((__expression), #__expression, __FILE__, __LINE__)
+
+/// Holds the registered cases and runs those matching the filter.
+class Runner {
+public:
+	typedef std::function<void()> body_type;
+
+	/// Register a case.
+	void Add(std::string const& __name, body_type const& __body) {
+		_M_case.push_back(_Case { __name, __body });
+	}
+
+	/// Run every case whose name contains __filter, returns the number of failures.
+	std::size_t Run(std::string const& __filter) const;
+
+private:
+	struct _Case {
+		std::string Name;
+		body_type Body;
+	};
+
+	std::vector<_Case> _M_case;
+};
+
+/// Registration functions, one per source file.
+void RegisterAsyncMonitor(Runner& __runner);
+void RegisterCommands(Runner& __runner);
+void RegisterCheckpoint(Runner& __runner);
+void RegisterDataPool(Runner& __runner);
+void RegisterMailbox(Runner& __runner);
+void RegisterOrder(Runner& __runner);
+void RegisterProfiler(Runner& __runner);
+void RegisterReplay(Runner& __runner);
+void RegisterSpatial(Runner& __runner);
+void RegisterSystem(Runner& __runner);
+
+} /* namespace test */
+} /* namespace bul */
+
+#endif /* _BUL_TEST_TEST_H */